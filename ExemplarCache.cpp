@@ -0,0 +1,83 @@
+#include "ExemplarCache.h"
+
+#include <QFileInfo>
+#include <QMutexLocker>
+
+std::shared_ptr<ExemplarCache::Entry> ExemplarCache::EntryFor(const QString& path, const QDateTime& modified)
+{
+	QMutexLocker lock{&entriesMutex};
+	std::shared_ptr<Entry>& entry = entries[path];
+	if (entry == nullptr || entry->modified != modified) {
+		entry = std::make_shared<Entry>();
+		entry->modified = modified;
+	}
+	entry->lastUse = ++useCount;
+	const std::shared_ptr<Entry> used = entry;
+
+	// a job still holding a dropped entry finishes with it, nothing new starts from it
+	if (entries.size() > MAX_EXEMPLARS) {
+		auto oldest = entries.begin();
+		for (auto it = entries.begin(); it != entries.end(); ++it) {
+			if (it.value()->lastUse < oldest.value()->lastUse) {
+				oldest = it;
+			}
+		}
+		entries.erase(oldest);
+	}
+	return used;
+}
+
+std::shared_ptr<TextureSynthesiser> ExemplarCache::Prepare(
+	const SynthesisSettings& settings,
+	const ProgressCallback& progressCallback,
+	const CancellationToken& cancellation
+)
+{
+	// the synthesiser does not check the exemplar, it has to be there
+	const QFileInfo exemplarInfo(settings.exemplarPath);
+	if (exemplarInfo.isFile() == false || settings.width <= 0 || settings.height <= 0) {
+		return nullptr;
+	}
+	const std::shared_ptr<Entry> entry = EntryFor(exemplarInfo.absoluteFilePath(), exemplarInfo.lastModified());
+
+	const Dimension outputDimension{settings.width, settings.height};
+	const auto generationMode = TextureSynthesiser::GenerationMode(settings.generationMode);
+	QMutexLocker lock{&entry->mutex};
+	std::shared_ptr<TextureSynthesiser> synthesiser;
+	if (entry->analysis) {
+		synthesiser = std::make_shared<TextureSynthesiser>(
+			*entry->analysis,
+			outputDimension,
+			settings.neighbourSize,
+			settings.similarityThreshold,
+			generationMode,
+			settings.coherenceThreshold
+		);
+	} else {
+		synthesiser = std::make_shared<TextureSynthesiser>(
+			settings.exemplarPath.toStdString(),
+			outputDimension,
+			settings.neighbourSize,
+			settings.similarityThreshold,
+			generationMode,
+			settings.coherenceThreshold
+		);
+		if (synthesiser->IsInputLoaded() == false) {
+			return nullptr;
+		}
+	}
+	synthesiser->Analyse(progressCallback, cancellation);
+
+	// a stopped analysis leaves out what it was building, the entry keeps what it had of that
+	TextureSynthesiser::ExemplarAnalysis analysis = synthesiser->GetExemplarAnalysis();
+	if (entry->analysis) {
+		if (analysis.coherenceMap == nullptr) {
+			analysis.coherenceMap = entry->analysis->coherenceMap;
+		}
+		if (analysis.overlapMatching == nullptr) {
+			analysis.overlapMatching = entry->analysis->overlapMatching;
+		}
+	}
+	entry->analysis = std::make_shared<const TextureSynthesiser::ExemplarAnalysis>(std::move(analysis));
+	return synthesiser;
+}
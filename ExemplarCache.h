@@ -0,0 +1,53 @@
+#pragma once
+
+#include <memory>
+
+#include <QDateTime>
+#include <QHash>
+#include <QMutex>
+#include <QString>
+
+#include "SynthesisWorker.h"
+#include "TextureSynthesiser.h"
+
+/*
+	The analysed exemplars, shared by every job of the GUI. The first job on an exemplar decodes it, every later
+	one starts from the analysis the jobs before it left (see TextureSynthesiser::ExemplarAnalysis): the pixels
+	and the overlap matching setup are always shared, the coherence map as long as the analysis parameters stay
+	the same. Only the analysis is kept, never a job's output buffers, and the jobs share the pixels instead of
+	copying them. The analysis is done under a lock per exemplar, so jobs started together on one exemplar
+	analyse it once and the others wait for it. An exemplar file changing on disk starts it over; past
+	MAX_EXEMPLARS the least recently used exemplar is dropped.
+*/
+class ExemplarCache {
+
+public:
+	static constexpr int MAX_EXEMPLARS = 8;
+
+private:
+	struct Entry {
+		QMutex								mutex;
+		QDateTime							modified;
+		quint64								lastUse = 0;
+		// under mutex
+		std::shared_ptr<const TextureSynthesiser::ExemplarAnalysis>
+											analysis;
+	};
+
+	QMutex									entriesMutex;
+	QHash<QString, std::shared_ptr<Entry>>	entries;
+	quint64									useCount = 0;
+
+	std::shared_ptr<Entry> EntryFor(const QString& path, const QDateTime& modified);
+
+public:
+	// A synthesiser for the settings with its exemplar analysed as far as the generation mode needs it, from
+	// any thread; nullptr if the exemplar is not there or does not decode. A job stopped while analysing gets
+	// its synthesiser all the same, its Generate() stops right away.
+	std::shared_ptr<TextureSynthesiser> Prepare(
+		const SynthesisSettings& settings,
+		const ProgressCallback& progressCallback,
+		const CancellationToken& cancellation
+	);
+
+};
@@ -0,0 +1,66 @@
+#include "PreviewImageProvider.h"
+
+PreviewImageProvider::PreviewImageProvider():
+	QQuickImageProvider(QQuickImageProvider::Image)
+{}
+
+void PreviewImageProvider::SetSource(const std::shared_ptr<TextureSynthesiser>& synthesiser)
+{
+	QVector<QRgb> colors;
+	if (synthesiser) {
+		const std::vector<Pixel>& pixels = synthesiser->GetInputPixels();
+		colors.resize(int(pixels.size()));
+		for (int i = 0; i < colors.size(); ++i) {
+			const Pixel& pixel = pixels[i];
+			// truncated like TextureSynthesiser::PackOutputPixels(), the preview matches the saved file
+			colors[i] = qRgb(int(pixel.r * 255.f), int(pixel.g * 255.f), int(pixel.b * 255.f));
+		}
+	}
+	QMutexLocker lock{&sourceMutex};
+	source = synthesiser;
+	exemplarColors.swap(colors);
+}
+
+QImage PreviewImageProvider::requestImage(const QString& id, QSize* size, const QSize& requestedSize)
+{
+	Q_UNUSED(id);
+	QMutexLocker lock{&sourceMutex};
+	if (source == nullptr) {
+		if (size) {
+			*size = QSize(1, 1);
+		}
+		QImage empty(1, 1, QImage::Format_ARGB32);
+		empty.fill(Qt::transparent);
+		return empty;
+	}
+
+	const Dimension& outputDimension = source->GetOutputDimension();
+	if (size) {
+		*size = QSize(outputDimension.width, outputDimension.height);
+	}
+	// the largest scale within the requested size, never up
+	double scale = 1.0;
+	if (requestedSize.width() > 0) {
+		scale = mymin(scale, double(requestedSize.width()) / outputDimension.width);
+	}
+	if (requestedSize.height() > 0) {
+		scale = mymin(scale, double(requestedSize.height()) / outputDimension.height);
+	}
+	const int width = mymax(int(outputDimension.width * scale), 1);
+	const int height = mymax(int(outputDimension.height * scale), 1);
+
+	QImage image(width, height, QImage::Format_ARGB32);
+	const int* references = source->GetOutputReferences();
+	const QRgb* colors = exemplarColors.constData();
+	const unsigned int colorCount = unsigned(exemplarColors.size());
+	for (int y = 0; y < height; ++y) {
+		const int* referenceRow = references + (y * outputDimension.height / height) * outputDimension.width;
+		QRgb* imageRow = reinterpret_cast<QRgb*>(image.scanLine(y));
+		for (int x = 0; x < width; ++x) {
+			const int reference = LoadRelaxed(referenceRow[x * outputDimension.width / width]);
+			// nothing placed there yet
+			imageRow[x] = (unsigned(reference) < colorCount) ? colors[reference] : qRgba(0, 0, 0, 0);
+		}
+	}
+	return image;
+}
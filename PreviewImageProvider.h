@@ -0,0 +1,34 @@
+#pragma once
+
+#include <memory>
+
+#include <QImage>
+#include <QMutex>
+#include <QQuickImageProvider>
+#include <QVector>
+
+#include "TextureSynthesiser.h"
+
+/*
+	Serves the output of the synthesis under way as image://synthesis/<frame>; the frame number only
+	makes the Image reload. Nothing is copied out of the synthesiser: every request reads the reference map
+	in place, while the worker keeps writing it, and looks the pixels up in the exemplar colours, which are
+	converted once per job. Both sides access the map with relaxed atomics, so a request reads every pixel
+	as either its old or its new value. Only as many pixels are looked up as the requested size holds.
+*/
+class PreviewImageProvider : public QQuickImageProvider {
+
+private:
+	QMutex								sourceMutex;
+	std::shared_ptr<TextureSynthesiser>	source;
+	QVector<QRgb>						exemplarColors;
+
+public:
+	PreviewImageProvider();
+
+	// the synthesiser to show, from any thread; kept alive until the next one replaces it
+	void SetSource(const std::shared_ptr<TextureSynthesiser>& synthesiser);
+
+	QImage requestImage(const QString& id, QSize* size, const QSize& requestedSize) override;
+
+};
@@ -0,0 +1,306 @@
+#include "SynthesisJobQueue.h"
+
+#include <QDir>
+#include <QFileInfo>
+#include <QRunnable>
+#include <QThread>
+#include <QUrl>
+
+#include "ExemplarCache.h"
+
+namespace {
+
+// in the order of TextureSynthesiser::GenerationMode
+const char* const GENERATION_MODE_NAMES[] = {"Brute force", "K-coherence", "Patch based", "Graph cut"};
+const char* const GENERATION_MODE_KEYS[] = {"bf", "kc", "patch", "graphcut"};
+const char* const JOB_STATUS_NAMES[] = {"queued", "running", "done", "cancelled", "failed"};
+
+constexpr int MAX_CONCURRENT_JOBS = 16;
+
+class SynthesisJobRunnable : public QRunnable {
+
+private:
+	QObject*			queue;
+	ExemplarCache&		exemplars;
+	const int			jobId;
+	const SynthesisSettings	settings;
+	const QString		outputPath;
+	const int			workerCount;
+	const std::shared_ptr<CancellationToken>
+						cancellation;
+
+public:
+	SynthesisJobRunnable(
+		QObject* queue,
+		ExemplarCache& exemplars,
+		int jobId,
+		const SynthesisSettings& settings,
+		const QString& outputPath,
+		int workerCount,
+		const std::shared_ptr<CancellationToken>& cancellation
+	):
+		queue(queue),
+		exemplars(exemplars),
+		jobId(jobId),
+		settings(settings),
+		outputPath(outputPath),
+		workerCount(workerCount),
+		cancellation(cancellation)
+	{}
+
+	void run() override
+	{
+		const auto reportProgress = [this](const ProgressEvent& event){
+			QMetaObject::invokeMethod(queue, "onJobProgressed", Qt::QueuedConnection,
+				Q_ARG(int, jobId),
+				Q_ARG(double, event.Fraction()),
+				Q_ARG(QString, QString::fromLatin1(ProgressEvent::PhaseName(event.phase))));
+		};
+		int status = SynthesisJobQueue::FAILED;
+		const std::shared_ptr<TextureSynthesiser> synthesiser = exemplars.Prepare(settings, reportProgress, *cancellation);
+		if (synthesiser) {
+			synthesiser->SetRandomSeed(settings.seed);
+			synthesiser->SetWorkerCount(workerCount);
+			const TextureSynthesiser::GenerationResult result = synthesiser->Generate(reportProgress, *cancellation);
+			if (result.status == TextureSynthesiser::COMPLETED) {
+				QDir().mkpath(QFileInfo(outputPath).absolutePath());
+				synthesiser->SaveToFile(outputPath.toStdString());
+				status = SynthesisJobQueue::COMPLETED;
+			} else {
+				status = SynthesisJobQueue::CANCELLED;
+			}
+		}
+		QMetaObject::invokeMethod(queue, "onJobFinished", Qt::QueuedConnection, Q_ARG(int, jobId), Q_ARG(int, status));
+	}
+
+};
+
+}
+
+SynthesisJobQueue::SynthesisJobQueue(ExemplarCache& exemplars, QObject* parent):
+	QAbstractListModel(parent),
+	exemplars(exemplars),
+	concurrentJobCount(mymax(QThread::idealThreadCount() / 2, 1))
+{
+	pool.setMaxThreadCount(concurrentJobCount);
+}
+
+SynthesisJobQueue::~SynthesisJobQueue()
+{
+	shutdown();
+}
+
+void SynthesisJobQueue::shutdown()
+{
+	for (int row = 0; row < int(jobs.size()); ++row) {
+		if (jobs[row].status == QUEUED) {
+			jobs[row].status = CANCELLED;
+			emit dataChanged(index(row), index(row));
+		}
+		jobs[row].cancellation->Cancel();
+	}
+	pool.waitForDone();
+}
+
+int SynthesisJobQueue::rowCount(const QModelIndex& parent) const
+{
+	return parent.isValid() ? 0 : int(jobs.size());
+}
+
+QVariant SynthesisJobQueue::data(const QModelIndex& index, int role) const
+{
+	if (index.isValid() == false || index.row() >= int(jobs.size())) {
+		return QVariant();
+	}
+	const Job& job = jobs[index.row()];
+	switch (role) {
+	case JOB_ID_ROLE:
+		return job.id;
+	case EXEMPLAR_NAME_ROLE:
+		return QFileInfo(job.settings.exemplarPath).fileName();
+	case DESCRIPTION_ROLE:
+		return QStringLiteral("%1 x %2, %3, seed %4")
+			.arg(job.settings.width)
+			.arg(job.settings.height)
+			.arg(QString::fromLatin1(GENERATION_MODE_NAMES[job.settings.generationMode]))
+			.arg(job.settings.seed);
+	case STATUS_ROLE:
+		return int(job.status);
+	case STATUS_NAME_ROLE:
+		return QString::fromLatin1(JOB_STATUS_NAMES[job.status]);
+	case PROGRESS_ROLE:
+		return job.progress;
+	case PHASE_ROLE:
+		return job.phase;
+	case PRIORITY_ROLE:
+		return job.priority;
+	case OUTPUT_SOURCE_ROLE:
+		return (job.status == COMPLETED) ? QUrl::fromLocalFile(job.outputPath).toString() : QString();
+	}
+	return QVariant();
+}
+
+QHash<int, QByteArray> SynthesisJobQueue::roleNames() const
+{
+	return {
+		{JOB_ID_ROLE, "jobId"},
+		{EXEMPLAR_NAME_ROLE, "exemplarName"},
+		{DESCRIPTION_ROLE, "description"},
+		{STATUS_ROLE, "status"},
+		{STATUS_NAME_ROLE, "statusName"},
+		{PROGRESS_ROLE, "progress"},
+		{PHASE_ROLE, "phase"},
+		{PRIORITY_ROLE, "priority"},
+		{OUTPUT_SOURCE_ROLE, "outputSource"}
+	};
+}
+
+void SynthesisJobQueue::setConcurrentJobs(int count)
+{
+	count = Clamp(count, 1, MAX_CONCURRENT_JOBS);
+	if (count != concurrentJobCount) {
+		// running jobs keep their worker count, the next ones get the new share
+		concurrentJobCount = count;
+		pool.setMaxThreadCount(count);
+		emit concurrentJobsChanged();
+		Dispatch();
+	}
+}
+
+int SynthesisJobQueue::RowOf(int jobId) const
+{
+	for (int row = 0; row < int(jobs.size()); ++row) {
+		if (jobs[row].id == jobId) {
+			return row;
+		}
+	}
+	return -1;
+}
+
+int SynthesisJobQueue::enqueue(
+	const QString& exemplarPath,
+	int width,
+	int height,
+	int neighbourSize,
+	double similarityThreshold,
+	int generationMode,
+	int seed,
+	int priority
+)
+{
+	Job job;
+	job.id = nextJobId++;
+	job.settings.exemplarPath = exemplarPath;
+	job.settings.width = width;
+	job.settings.height = height;
+	job.settings.neighbourSize = neighbourSize;
+	job.settings.similarityThreshold = float(similarityThreshold);
+	job.settings.generationMode = Clamp(generationMode, 0, int(TextureSynthesiser::PATCH_GRAPH_CUT));
+	job.settings.seed = unsigned(seed);
+	job.priority = priority;
+	// named after everything that makes the output, the same job gives the same file
+	const QFileInfo exemplar(exemplarPath);
+	job.outputPath = QStringLiteral("%1/variations/%2_%3x%4_%5_n%6_t%7_s%8.jpg")
+		.arg(exemplar.absolutePath())
+		.arg(exemplar.completeBaseName())
+		.arg(width)
+		.arg(height)
+		.arg(QString::fromLatin1(GENERATION_MODE_KEYS[job.settings.generationMode]))
+		.arg(neighbourSize)
+		.arg(similarityThreshold)
+		.arg(job.settings.seed);
+
+	const int row = int(jobs.size());
+	beginInsertRows(QModelIndex(), row, row);
+	jobs.push_back(std::move(job));
+	endInsertRows();
+	Dispatch();
+	return jobs[row].id;
+}
+
+void SynthesisJobQueue::cancel(int jobId)
+{
+	const int row = RowOf(jobId);
+	if (row < 0) {
+		return;
+	}
+	Job& job = jobs[row];
+	if (job.status == QUEUED) {
+		job.status = CANCELLED;
+		emit dataChanged(index(row), index(row));
+	} else if (job.status == RUNNING) {
+		job.cancellation->Cancel();
+	}
+}
+
+void SynthesisJobQueue::setPriority(int jobId, int priority)
+{
+	const int row = RowOf(jobId);
+	if (row >= 0 && jobs[row].priority != priority) {
+		jobs[row].priority = priority;
+		emit dataChanged(index(row), index(row));
+	}
+}
+
+void SynthesisJobQueue::removeFinished()
+{
+	for (int row = int(jobs.size()) - 1; row >= 0; --row) {
+		if (jobs[row].status != QUEUED && jobs[row].status != RUNNING) {
+			beginRemoveRows(QModelIndex(), row, row);
+			jobs.erase(jobs.begin() + row);
+			endRemoveRows();
+		}
+	}
+}
+
+void SynthesisJobQueue::Dispatch()
+{
+	while (runningJobCount < concurrentJobCount) {
+		// the highest priority, the earliest of equal ones
+		int next = -1;
+		for (int row = 0; row < int(jobs.size()); ++row) {
+			if (jobs[row].status == QUEUED && (next < 0 || jobs[row].priority > jobs[next].priority)) {
+				next = row;
+			}
+		}
+		if (next < 0) {
+			return;
+		}
+		Start(next);
+	}
+}
+
+void SynthesisJobQueue::Start(int row)
+{
+	Job& job = jobs[row];
+	job.status = RUNNING;
+	runningJobCount++;
+	// the patch based modes run workers of their own, the jobs split the cores between them
+	const int workerCount = mymax(QThread::idealThreadCount() / concurrentJobCount, 1);
+	pool.start(new SynthesisJobRunnable(this, exemplars, job.id, job.settings, job.outputPath, workerCount, job.cancellation));
+	emit dataChanged(index(row), index(row));
+}
+
+void SynthesisJobQueue::onJobProgressed(int jobId, double fraction, const QString& phase)
+{
+	const int row = RowOf(jobId);
+	if (row >= 0 && jobs[row].status == RUNNING) {
+		jobs[row].progress = fraction;
+		jobs[row].phase = phase;
+		emit dataChanged(index(row), index(row), {PROGRESS_ROLE, PHASE_ROLE});
+	}
+}
+
+void SynthesisJobQueue::onJobFinished(int jobId, int status)
+{
+	runningJobCount--;
+	const int row = RowOf(jobId);
+	if (row >= 0) {
+		Job& job = jobs[row];
+		job.status = JobStatus(status);
+		job.progress = (job.status == COMPLETED) ? 1.0 : job.progress;
+		job.phase.clear();
+		emit dataChanged(index(row), index(row));
+	}
+	Dispatch();
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include <QAbstractListModel>
+#include <QString>
+#include <QThreadPool>
+
+#include "SynthesisWorker.h"
+
+class ExemplarCache;
+
+/*
+	Queued variations, registered as the "jobQueue" context property and listed in the jobs panel. Up to
+	concurrentJobs of them run at once on the queue's thread pool, each with its share of the cores for its own
+	patch workers; the rest wait, the highest priority first, the earlier of equal ones. A priority only
+	matters while the job waits. The jobs take their exemplars from the ExemplarCache the interactive synthesis
+	uses too, so an exemplar is analysed once however many jobs are queued on it. A finished job leaves its
+	output in a "variations" folder next to the exemplar.
+*/
+class SynthesisJobQueue : public QAbstractListModel {
+
+	Q_OBJECT
+	Q_PROPERTY(int concurrentJobs READ concurrentJobs WRITE setConcurrentJobs NOTIFY concurrentJobsChanged)
+
+public:
+	enum JobStatus : int {
+		QUEUED,
+		RUNNING,
+		COMPLETED,
+		CANCELLED,
+		FAILED
+	};
+	enum Role : int {
+		JOB_ID_ROLE = Qt::UserRole + 1,
+		EXEMPLAR_NAME_ROLE,
+		DESCRIPTION_ROLE,
+		STATUS_ROLE,
+		STATUS_NAME_ROLE,
+		PROGRESS_ROLE,
+		PHASE_ROLE,
+		PRIORITY_ROLE,
+		OUTPUT_SOURCE_ROLE
+	};
+
+private:
+	struct Job {
+		int					id;
+		SynthesisSettings	settings;
+		int					priority;
+		JobStatus			status = QUEUED;
+		double				progress = 0.0;
+		QString				phase;
+		QString				outputPath;
+		// shared with the job's runnable, which may outlive the row
+		std::shared_ptr<CancellationToken>
+							cancellation = std::make_shared<CancellationToken>();
+	};
+
+	ExemplarCache&		exemplars;
+	QThreadPool			pool;
+	std::vector<Job>	jobs;	// in the order they were queued
+	int					nextJobId = 1;
+	int					concurrentJobCount;
+	int					runningJobCount = 0;
+
+	int RowOf(int jobId) const;
+	void Dispatch();
+	void Start(int row);
+
+public:
+	explicit SynthesisJobQueue(ExemplarCache& exemplars, QObject* parent = nullptr);
+	~SynthesisJobQueue() override;
+
+	int rowCount(const QModelIndex& parent = QModelIndex()) const override;
+	QVariant data(const QModelIndex& index, int role) const override;
+	QHash<int, QByteArray> roleNames() const override;
+
+	int concurrentJobs() const { return concurrentJobCount; }
+	void setConcurrentJobs(int count);
+
+	// returns the id of the job
+	Q_INVOKABLE int enqueue(
+		const QString& exemplarPath,
+		int width,
+		int height,
+		int neighbourSize,
+		double similarityThreshold,
+		int generationMode,
+		int seed,
+		int priority
+	);
+	// a running job stops at its next pixel or patch
+	Q_INVOKABLE void cancel(int jobId);
+	Q_INVOKABLE void setPriority(int jobId, int priority);
+	Q_INVOKABLE void removeFinished();
+
+public slots:
+	// cancels every job and waits for the running ones
+	void shutdown();
+
+signals:
+	void concurrentJobsChanged();
+
+private slots:
+	// from the pool threads, queued
+	void onJobProgressed(int jobId, double fraction, const QString& phase);
+	void onJobFinished(int jobId, int status);
+
+};
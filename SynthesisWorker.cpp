@@ -0,0 +1,165 @@
+#include "SynthesisWorker.h"
+
+#include <memory>
+
+#include "ExemplarCache.h"
+#include "PreviewImageProvider.h"
+
+SynthesisWorker::SynthesisWorker(PreviewImageProvider* preview, ExemplarCache& exemplars, const CancellationToken& cancellation):
+	preview(preview),
+	exemplars(exemplars),
+	cancellation(cancellation)
+{}
+
+void SynthesisWorker::run(const SynthesisSettings& settings)
+{
+	const auto reportProgress = [this](const ProgressEvent& event){
+		emit progressChanged(event.Fraction(), QString::fromLatin1(ProgressEvent::PhaseName(event.phase)), event.etaSeconds);
+	};
+	const std::shared_ptr<TextureSynthesiser> synthesiser = exemplars.Prepare(settings, reportProgress, cancellation);
+	if (synthesiser == nullptr) {
+		emit finished(false, TextureSynthesiser::COMPLETED);
+		return;
+	}
+	synthesiser->SetRandomSeed(settings.seed);
+	preview->SetSource(synthesiser);
+	lastPreview = std::chrono::steady_clock::time_point{};
+
+	const std::chrono::steady_clock::duration previewInterval = std::chrono::milliseconds(1000 / MAX_PREVIEW_FPS);
+	const TextureSynthesiser::GenerationResult result = synthesiser->Generate(
+		[&](const ProgressEvent& event){
+			reportProgress(event);
+			const auto now = std::chrono::steady_clock::now();
+			if (now - lastPreview >= previewInterval) {
+				lastPreview = now;
+				emit previewChanged();
+			}
+		},
+		cancellation
+	);
+	emit previewChanged();
+	emit finished(true, result.status);
+}
+
+SynthesisController::SynthesisController(PreviewImageProvider* preview, ExemplarCache& exemplars, QObject* parent):
+	QObject(parent)
+{
+	qRegisterMetaType<SynthesisSettings>();
+	regenerationTimer.setSingleShot(true);
+	regenerationTimer.setInterval(REGENERATION_DELAY_MS);
+	connect(&regenerationTimer, &QTimer::timeout, this, &SynthesisController::startPendingJob);
+	SynthesisWorker* worker = new SynthesisWorker(preview, exemplars, cancellation);
+	worker->moveToThread(&workerThread);
+	connect(&workerThread, &QThread::finished, worker, &QObject::deleteLater);
+	connect(this, &SynthesisController::runRequested, worker, &SynthesisWorker::run);
+	connect(worker, &SynthesisWorker::progressChanged, this, &SynthesisController::onProgressChanged);
+	connect(worker, &SynthesisWorker::previewChanged, this, &SynthesisController::onPreviewChanged);
+	connect(worker, &SynthesisWorker::finished, this, &SynthesisController::onFinished);
+	workerThread.start();
+}
+
+SynthesisController::~SynthesisController()
+{
+	shutdown();
+}
+
+void SynthesisController::shutdown()
+{
+	regenerationTimer.stop();
+	hasPendingJob = false;
+	if (workerThread.isRunning()) {
+		cancellation.Cancel();
+		workerThread.quit();
+		workerThread.wait();
+	}
+}
+
+void SynthesisController::setExemplarPath(const QString& path)
+{
+	if (path != currentExemplarPath) {
+		currentExemplarPath = path;
+		emit exemplarPathChanged();
+	}
+}
+
+QString SynthesisController::previewSource() const
+{
+	return previewFrame ? QStringLiteral("image://synthesis/%1").arg(previewFrame) : QString();
+}
+
+void SynthesisController::generate(int width, int height, int neighbourSize, double similarityThreshold, int generationMode, int seed)
+{
+	pendingSettings = SynthesisSettings{};
+	pendingSettings.exemplarPath = currentExemplarPath;
+	pendingSettings.width = width;
+	pendingSettings.height = height;
+	pendingSettings.neighbourSize = neighbourSize;
+	pendingSettings.similarityThreshold = float(similarityThreshold);
+	pendingSettings.generationMode = generationMode;
+	pendingSettings.seed = unsigned(seed);
+	// the job under way is out of date, its finishing starts the pending one unless more edits follow
+	if (isRunning) {
+		cancellation.Cancel();
+	}
+	const bool wasRunning = running();
+	hasPendingJob = true;
+	regenerationTimer.start();
+	if (wasRunning == false) {
+		emit runningChanged();
+	}
+}
+
+void SynthesisController::cancel()
+{
+	regenerationTimer.stop();
+	if (hasPendingJob) {
+		hasPendingJob = false;
+		if (isRunning == false) {
+			emit runningChanged();
+		}
+	}
+	cancellation.Cancel();
+}
+
+void SynthesisController::startPendingJob()
+{
+	// a job still stopping starts the pending one when it finishes
+	if (isRunning || hasPendingJob == false) {
+		return;
+	}
+	// no job is running, a cancel from now on is meant for this one
+	cancellation.Reset();
+	hasPendingJob = false;
+	isRunning = true;
+	currentProgress = 0.0;
+	currentPhase.clear();
+	currentEtaSeconds = -1.0;
+	emit progressChanged();
+	emit runRequested(pendingSettings);
+}
+
+void SynthesisController::onProgressChanged(double fraction, const QString& phase, double etaSeconds)
+{
+	currentProgress = fraction;
+	currentPhase = phase;
+	currentEtaSeconds = etaSeconds;
+	emit progressChanged();
+}
+
+void SynthesisController::onPreviewChanged()
+{
+	previewFrame++;
+	emit previewSourceChanged();
+}
+
+void SynthesisController::onFinished(bool succeeded, int status)
+{
+	isRunning = false;
+	emit finished(succeeded, status);
+	if (regenerationTimer.isActive() == false) {
+		startPendingJob();
+	}
+	if (running() == false) {
+		emit runningChanged();
+	}
+}
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <chrono>
+
+#include <QObject>
+#include <QString>
+#include <QThread>
+#include <QTimer>
+
+#include "TextureSynthesiser.h"
+
+class ExemplarCache;
+class PreviewImageProvider;
+
+struct SynthesisSettings {
+	QString		exemplarPath;
+	int			width = 256;
+	int			height = 256;
+	int			neighbourSize = 5;
+	float		similarityThreshold = 0.02f;
+	int			generationMode = TextureSynthesiser::PATCH_BASED;
+	float		coherenceThreshold = 0.2f;
+	unsigned int	seed = 0;
+};
+Q_DECLARE_METATYPE(SynthesisSettings)
+
+/*
+	Runs the synthesis jobs on the thread it is moved to. The progress events come from the synthesis
+	threads; the worker passes them on as queued signals and asks for a new preview frame at most
+	MAX_PREVIEW_FPS times a second. The preview itself is drawn by PreviewImageProvider.
+	The exemplars come analysed from the ExemplarCache, so changing the output size, the mode or the seed
+	goes straight to the synthesis.
+*/
+class SynthesisWorker : public QObject {
+
+	Q_OBJECT
+
+public:
+	static constexpr int MAX_PREVIEW_FPS = 10;
+
+private:
+	PreviewImageProvider*					preview;
+	ExemplarCache&							exemplars;
+	const CancellationToken&				cancellation;
+	std::chrono::steady_clock::time_point	lastPreview;
+
+public:
+	SynthesisWorker(PreviewImageProvider* preview, ExemplarCache& exemplars, const CancellationToken& cancellation);
+
+public slots:
+	void run(const SynthesisSettings& settings);
+
+signals:
+	void progressChanged(double fraction, const QString& phase, double etaSeconds);
+	void previewChanged();
+	void finished(bool succeeded, int status);
+
+};
+
+/*
+	The synthesis as QML sees it, registered as the "synthesis" context property. generate() is meant to be
+	called on every edit of the settings: it stops the job under way and starts one with the new settings
+	once they have not changed for REGENERATION_DELAY_MS. cancel() stops the job at the next pixel or patch
+	and drops the one waiting. One job runs at a time; running covers the one waiting too.
+*/
+class SynthesisController : public QObject {
+
+	Q_OBJECT
+	Q_PROPERTY(QString exemplarPath READ exemplarPath WRITE setExemplarPath NOTIFY exemplarPathChanged)
+	Q_PROPERTY(bool running READ running NOTIFY runningChanged)
+	Q_PROPERTY(double progress READ progress NOTIFY progressChanged)
+	Q_PROPERTY(QString phase READ phase NOTIFY progressChanged)
+	Q_PROPERTY(double etaSeconds READ etaSeconds NOTIFY progressChanged)
+	Q_PROPERTY(QString previewSource READ previewSource NOTIFY previewSourceChanged)
+
+public:
+	static constexpr int REGENERATION_DELAY_MS = 150;
+
+private:
+	QThread				workerThread;
+	CancellationToken	cancellation;
+	QTimer				regenerationTimer;
+	QString				currentExemplarPath;
+	bool				isRunning = false;	// a job is on the worker thread
+	bool				hasPendingJob = false;
+	SynthesisSettings	pendingSettings;
+	double				currentProgress = 0.0;
+	QString				currentPhase;
+	double				currentEtaSeconds = -1.0;
+	int					previewFrame = 0;
+
+public:
+	SynthesisController(PreviewImageProvider* preview, ExemplarCache& exemplars, QObject* parent = nullptr);
+	~SynthesisController() override;
+
+	QString exemplarPath() const { return currentExemplarPath; }
+	void setExemplarPath(const QString& path);
+	bool running() const { return isRunning || hasPendingJob; }
+	double progress() const { return currentProgress; }
+	QString phase() const { return currentPhase; }
+	double etaSeconds() const { return currentEtaSeconds; }
+	QString previewSource() const;
+
+	Q_INVOKABLE void generate(int width, int height, int neighbourSize, double similarityThreshold, int generationMode, int seed);
+	Q_INVOKABLE void cancel();
+
+public slots:
+	// stops the job and the thread; before the QML engine, which owns the preview provider, goes away
+	void shutdown();
+
+signals:
+	void exemplarPathChanged();
+	void runningChanged();
+	void progressChanged();
+	void previewSourceChanged();
+	void finished(bool succeeded, int status);
+	void runRequested(const SynthesisSettings& settings);
+
+private slots:
+	void startPendingJob();
+	void onProgressChanged(double fraction, const QString& phase, double etaSeconds);
+	void onPreviewChanged();
+	void onFinished(bool succeeded, int status);
+
+};
@@ -1,8 +1,28 @@
 QT += qml quick
 
-CONFIG += c++11
+# the algorithm headers need C++17
+CONFIG += c++1z
 
-SOURCES += main.cpp
+INCLUDEPATH += algorithm
+# the algorithm includes Windows.h, whose min and max macros break the Qt headers
+win32: DEFINES += NOMINMAX
+
+HEADERS += \
+    ExemplarCache.h \
+    PreviewImageProvider.h \
+    SynthesisJobQueue.h \
+    SynthesisWorker.h \
+    ThumbnailProvider.h
+
+SOURCES += \
+    main.cpp \
+    ExemplarCache.cpp \
+    PreviewImageProvider.cpp \
+    SynthesisJobQueue.cpp \
+    SynthesisWorker.cpp \
+    ThumbnailProvider.cpp \
+    algorithm/jpeg-compressor/jpgd.cpp \
+    algorithm/jpeg-compressor/jpge.cpp
 
 RESOURCES += qml.qrc
 
@@ -0,0 +1,192 @@
+#include "ThumbnailProvider.h"
+
+#include <cstdlib>
+
+#include <QDateTime>
+#include <QDir>
+#include <QMutexLocker>
+#include <QRunnable>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QThread>
+#include <QUrl>
+
+#include "ExemplarBundle.h"
+#include "Utils.h"
+#include "jpeg-compressor/jpgd.h"
+
+namespace {
+
+class ThumbnailResponse : public QQuickImageResponse, public QRunnable {
+
+private:
+	ThumbnailCache&		cache;
+	const QString		path;
+	const QSize			requestedSize;
+	std::atomic<bool>	cancelled;
+	QImage				image;
+
+public:
+	ThumbnailResponse(ThumbnailCache& cache, const QString& path, const QSize& requestedSize):
+		cache(cache),
+		path(path),
+		requestedSize(requestedSize),
+		cancelled(false)
+	{
+		// the engine deletes the response once it has finished
+		setAutoDelete(false);
+	}
+
+	QQuickTextureFactory* textureFactory() const override
+	{
+		return QQuickTextureFactory::textureFactoryForImage(image);
+	}
+
+	void cancel() override
+	{
+		cancelled = true;
+	}
+
+	void run() override
+	{
+		if (cancelled == false) {
+			image = cache.Get(path);
+			if (image.isNull() == false && requestedSize.isValid() &&
+				(requestedSize.width() < image.width() || requestedSize.height() < image.height())
+			) {
+				image = image.scaled(requestedSize, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+			}
+		}
+		emit finished();
+	}
+
+};
+
+}
+
+ThumbnailCache::ThumbnailCache(const QString& directory):
+	memory(MEMORY_THUMBNAILS),
+	directory(directory),
+	storesSincePrune(0)
+{
+	QDir().mkpath(directory);
+}
+
+quint64 ThumbnailCache::KeyFor(const QFileInfo& info)
+{
+	const QByteArray identity =
+		info.absoluteFilePath().toUtf8() + '\n' +
+		QByteArray::number(info.size()) + '\n' +
+		QByteArray::number(info.lastModified().toMSecsSinceEpoch());
+	return HashBytes(reinterpret_cast<const unsigned char*>(identity.constData()), size_t(identity.size()));
+}
+
+QImage ThumbnailCache::Decode(const QString& path)
+{
+	MappedFile file;
+	if (file.Open(path.toStdString()) == false) {
+		return QImage();
+	}
+	// one decoder per pool thread, it keeps its memory blocks from image to image
+	thread_local jpgd::jpeg_decoder decoder;
+	jpgd::jpeg_decoder_mem_stream stream(file.Data(), unsigned(file.Size()));
+	if (decoder.reset(&stream) != jpgd::JPGD_SUCCESS) {
+		return QImage();
+	}
+	const int longerSide = mymax(decoder.get_width(), decoder.get_height());
+	int scaleShift = 0;
+	while (scaleShift < 3 && (longerSide >> (scaleShift + 1)) >= THUMBNAIL_SIZE) {
+		scaleShift++;
+	}
+
+	stream.open(file.Data(), unsigned(file.Size()));
+	int width, height, actualComponents;
+	unsigned char* pixels = jpgd::decompress_jpeg_image_from_stream(
+		decoder, &stream, &width, &height, &actualComponents, 4, scaleShift);
+	if (pixels == nullptr) {
+		return QImage();
+	}
+	const QImage decoded(pixels, width, height, width * 4, QImage::Format_RGBA8888, free, pixels);
+	return decoded.scaled(THUMBNAIL_SIZE, THUMBNAIL_SIZE, Qt::KeepAspectRatio, Qt::SmoothTransformation)
+		.convertToFormat(QImage::Format_RGB32);
+}
+
+QString ThumbnailCache::DiskPathFor(quint64 key) const
+{
+	return directory + QLatin1Char('/') + QString::number(key, 16) + QStringLiteral(".png");
+}
+
+void ThumbnailCache::StoreOnDisk(quint64 key, const QImage& thumbnail)
+{
+	// written aside and renamed, another thread never reads half a file
+	QSaveFile file(DiskPathFor(key));
+	if (file.open(QIODevice::WriteOnly) && thumbnail.save(&file, "PNG")) {
+		file.commit();
+	}
+	if (storesSincePrune++ % DISK_PRUNE_INTERVAL == 0) {
+		PruneDisk();
+	}
+}
+
+void ThumbnailCache::PruneDisk()
+{
+	// the newest first, a hit moves the file to the front by touching it
+	const QFileInfoList thumbnails = QDir(directory).entryInfoList(
+		QStringList{QStringLiteral("*.png")}, QDir::Files, QDir::Time);
+	for (int i = DISK_THUMBNAILS; i < thumbnails.size(); ++i) {
+		QFile::remove(thumbnails[i].absoluteFilePath());
+	}
+}
+
+QImage ThumbnailCache::Get(const QString& path)
+{
+	const QFileInfo info(path);
+	if (info.isFile() == false) {
+		return QImage();
+	}
+	const quint64 key = KeyFor(info);
+	{
+		QMutexLocker lock{&memoryMutex};
+		if (const QImage* thumbnail = memory.object(key)) {
+			return *thumbnail;
+		}
+	}
+
+	const QString diskPath = DiskPathFor(key);
+	QImage thumbnail(diskPath, "PNG");
+	if (thumbnail.isNull() == false) {
+		QFile file(diskPath);
+		if (file.open(QIODevice::ReadWrite)) {
+			file.setFileTime(QDateTime::currentDateTimeUtc(), QFileDevice::FileModificationTime);
+		}
+	} else {
+		thumbnail = Decode(path);
+		if (thumbnail.isNull()) {
+			return thumbnail;
+		}
+		StoreOnDisk(key, thumbnail);
+	}
+
+	QMutexLocker lock{&memoryMutex};
+	memory.insert(key, new QImage(thumbnail));
+	return thumbnail;
+}
+
+ThumbnailProvider::ThumbnailProvider():
+	cache(QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + QStringLiteral("/thumbnails"))
+{
+	pool.setMaxThreadCount(mymax(QThread::idealThreadCount(), 1));
+}
+
+ThumbnailProvider::~ThumbnailProvider()
+{
+	pool.clear();
+	pool.waitForDone();
+}
+
+QQuickImageResponse* ThumbnailProvider::requestImageResponse(const QString& id, const QSize& requestedSize)
+{
+	ThumbnailResponse* response = new ThumbnailResponse(cache, QUrl::fromPercentEncoding(id.toUtf8()), requestedSize);
+	pool.start(response);
+	return response;
+}
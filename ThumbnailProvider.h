@@ -0,0 +1,66 @@
+#pragma once
+
+#include <atomic>
+
+#include <QCache>
+#include <QFileInfo>
+#include <QImage>
+#include <QMutex>
+#include <QQuickAsyncImageProvider>
+#include <QString>
+#include <QThreadPool>
+
+/*
+	Exemplar thumbnails, at most THUMBNAIL_SIZE on the longer side. A thumbnail is looked up in memory, then
+	on disk, and only then decoded, at the largest DCT reduction that still leaves THUMBNAIL_SIZE pixels,
+	so most of a large exemplar is never inverse transformed. Both caches drop the least recently used
+	thumbnails: the memory one past MEMORY_THUMBNAILS, the disk one past DISK_THUMBNAILS, checked every
+	DISK_PRUNE_INTERVAL stores. Thumbnails are keyed by the path, the size and the modification time of the
+	file; hashing the content would read the whole file on every lookup. Get() may be called from any thread.
+*/
+class ThumbnailCache {
+
+public:
+	static constexpr int THUMBNAIL_SIZE = 128;
+	static constexpr int MEMORY_THUMBNAILS = 512;
+	static constexpr int DISK_THUMBNAILS = 20000;
+	static constexpr int DISK_PRUNE_INTERVAL = 256;
+
+private:
+	QMutex					memoryMutex;
+	QCache<quint64, QImage>	memory;
+	QString					directory;
+	std::atomic<int>		storesSincePrune;
+
+	static quint64 KeyFor(const QFileInfo& info);
+	static QImage Decode(const QString& path);
+	QString DiskPathFor(quint64 key) const;
+	void StoreOnDisk(quint64 key, const QImage& thumbnail);
+	void PruneDisk();
+
+public:
+	explicit ThumbnailCache(const QString& directory);
+
+	// a null image if the file is not a JPEG it can decode
+	QImage Get(const QString& path);
+
+};
+
+/*
+	Serves image://thumbnails/<percent encoded path>. Every request is a job on the provider's own thread
+	pool, so scrolling through a folder of exemplars never waits for a decode; the jobs of delegates scrolled
+	out of view are cancelled by the engine and skip the decode if they have not started yet.
+*/
+class ThumbnailProvider : public QQuickAsyncImageProvider {
+
+private:
+	ThumbnailCache	cache;
+	QThreadPool		pool;
+
+public:
+	ThumbnailProvider();
+	~ThumbnailProvider() override;
+
+	QQuickImageResponse* requestImageResponse(const QString& id, const QSize& requestedSize) override;
+
+};
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+
+/*
+	Stops a Generate() call from another thread: Cancel() or a wall clock deadline, whichever comes first.
+	The pixel modes check the token before each output pixel and each coherence map pixel, the patch modes
+	before each patch and while waiting on one, so a call stops within one of those and returns what it has
+	so far with a status telling why. The token may be set before or during the call,
+	from any thread, and serves one call at a time.
+*/
+class CancellationToken {
+
+public:
+	using Clock = std::chrono::steady_clock;
+
+private:
+	static constexpr Clock::rep NO_DEADLINE = Clock::duration::max().count();
+
+	std::atomic<bool>		cancelled;
+	std::atomic<Clock::rep>	deadlineTicks;	// since the clock's epoch
+
+public:
+	CancellationToken():
+		cancelled(false),
+		deadlineTicks(NO_DEADLINE)
+	{}
+
+	CancellationToken(const CancellationToken&) = delete;
+	CancellationToken& operator=(const CancellationToken&) = delete;
+
+	// a token nobody holds, for calls that cannot be stopped
+	static const CancellationToken& None(){
+		static const CancellationToken none;
+		return none;
+	}
+
+	void Cancel(){
+		cancelled.store(true, std::memory_order_relaxed);
+	}
+
+	void SetDeadline(Clock::time_point deadline){
+		deadlineTicks.store(deadline.time_since_epoch().count(), std::memory_order_relaxed);
+	}
+
+	void SetTimeout(double seconds){
+		SetDeadline(Clock::now() + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(seconds)));
+	}
+
+	void ClearDeadline(){
+		deadlineTicks.store(NO_DEADLINE, std::memory_order_relaxed);
+	}
+
+	// both reset, for the next call
+	void Reset(){
+		cancelled.store(false, std::memory_order_relaxed);
+		ClearDeadline();
+	}
+
+	bool IsCancelled() const {
+		return cancelled.load(std::memory_order_relaxed);
+	}
+
+	bool IsPastDeadline() const {
+		const Clock::rep deadline = deadlineTicks.load(std::memory_order_relaxed);
+		return deadline != NO_DEADLINE && Clock::now().time_since_epoch().count() >= deadline;
+	}
+
+};
@@ -0,0 +1,246 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <fstream>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Read-only view of a whole file, backed by the OS page cache.
+class MappedFile {
+
+private:
+	const unsigned char* data = nullptr;
+	size_t size = 0;
+#ifdef _WIN32
+	HANDLE fileHandle = INVALID_HANDLE_VALUE;
+	HANDLE mappingHandle = nullptr;
+#endif
+
+public:
+	MappedFile() = default;
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	~MappedFile(){
+		Close();
+	}
+
+	bool Open(const std::string& path){
+		Close();
+#ifdef _WIN32
+		fileHandle = CreateFileA(
+			path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+			OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr
+		);
+		if (fileHandle == INVALID_HANDLE_VALUE){
+			return false;
+		}
+		LARGE_INTEGER fileSize;
+		if (GetFileSizeEx(fileHandle, &fileSize) == FALSE || fileSize.QuadPart == 0){
+			Close();
+			return false;
+		}
+		mappingHandle = CreateFileMappingA(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (mappingHandle == nullptr){
+			Close();
+			return false;
+		}
+		data = static_cast<const unsigned char*>(MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0));
+		size = size_t(fileSize.QuadPart);
+#else
+		const int fd = open(path.c_str(), O_RDONLY);
+		if (fd < 0){
+			return false;
+		}
+		struct stat fileStat;
+		if (fstat(fd, &fileStat) != 0 || fileStat.st_size == 0){
+			close(fd);
+			return false;
+		}
+		void* mapping = mmap(nullptr, size_t(fileStat.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+		close(fd);
+		if (mapping == MAP_FAILED){
+			return false;
+		}
+		data = static_cast<const unsigned char*>(mapping);
+		size = size_t(fileStat.st_size);
+#endif
+		if (data == nullptr){
+			Close();
+			return false;
+		}
+		return true;
+	}
+
+	void Close(){
+#ifdef _WIN32
+		if (data != nullptr){
+			UnmapViewOfFile(data);
+		}
+		if (mappingHandle != nullptr){
+			CloseHandle(mappingHandle);
+			mappingHandle = nullptr;
+		}
+		if (fileHandle != INVALID_HANDLE_VALUE){
+			CloseHandle(fileHandle);
+			fileHandle = INVALID_HANDLE_VALUE;
+		}
+#else
+		if (data != nullptr){
+			munmap(const_cast<unsigned char*>(data), size);
+		}
+#endif
+		data = nullptr;
+		size = 0;
+	}
+
+	const unsigned char* Data() const {
+		return data;
+	}
+
+	size_t Size() const {
+		return size;
+	}
+
+};
+
+// 64-bit FNV-1a, used to key bundles by the exemplar file content.
+inline uint64_t HashBytes(const unsigned char* bytes, size_t length){
+	uint64_t hash = 14695981039346656037ull;
+	for (size_t i = 0; i < length; ++i){
+		hash ^= bytes[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+/*
+	Exemplar bundle layout (all little endian, sections 16 byte aligned):
+		Header
+		Section[sectionCount]
+		section payloads
+	A bundle is only valid for the exemplar bytes and analysis parameters
+	stored in its header; anything else is rebuilt from the JPEG.
+*/
+namespace ExemplarBundle {
+
+	static constexpr char MAGIC[4] = {'T', 'S', 'E', 'B'};
+	static constexpr uint32_t VERSION = 2;
+	static constexpr uint32_t SECTION_ALIGNMENT = 16;
+
+	enum SectionID : uint32_t {
+		PIXELS = 1,			// Pixel[width * height]
+		PIXEL_IDS,			// int[width * height], coherence cluster of each pixel
+		SIMILAR_OFFSETS,	// int[width * height + 1], cluster ranges in SIMILAR_IDS
+		SIMILAR_IDS			// int[], flattened cluster members
+	};
+
+	struct Header {
+		char		magic[4];
+		uint32_t	version;
+		uint64_t	contentHash;
+		int32_t		scaleShift;			// exemplar was decoded at 1/2^scaleShift of its size
+		int32_t		width;
+		int32_t		height;
+		int32_t		neighbourSize;
+		float		similarityThreshold;
+		float		coherenceThreshold;
+		uint32_t	sectionCount;
+	};
+
+	struct Section {
+		uint32_t	id;
+		uint32_t	reserved;
+		uint64_t	offset;
+		uint64_t	size;
+	};
+
+	struct Payload {
+		SectionID	id;
+		const void*	data;
+		uint64_t	size;
+	};
+
+	inline std::string PathFor(const std::string& imagePath){
+		return imagePath + ".bundle";
+	}
+
+	inline uint64_t AlignOffset(uint64_t offset){
+		return (offset + SECTION_ALIGNMENT - 1) & ~uint64_t(SECTION_ALIGNMENT - 1);
+	}
+
+	inline bool Write(const std::string& path, Header header, const std::vector<Payload>& payloads){
+		std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+		header.version = VERSION;
+		header.sectionCount = uint32_t(payloads.size());
+
+		std::vector<Section> sections;
+		uint64_t offset = AlignOffset(sizeof(Header) + payloads.size() * sizeof(Section));
+		for (const Payload& payload : payloads){
+			sections.push_back(Section{payload.id, 0, offset, payload.size});
+			offset = AlignOffset(offset + payload.size);
+		}
+
+		std::ofstream file{path, std::ofstream::binary | std::ofstream::trunc};
+		if (file.good() == false){
+			return false;
+		}
+		const char padding[SECTION_ALIGNMENT] = {0};
+		file.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+		file.write(reinterpret_cast<const char*>(sections.data()), sections.size() * sizeof(Section));
+		uint64_t written = sizeof(Header) + sections.size() * sizeof(Section);
+		for (size_t i = 0; i < payloads.size(); ++i){
+			file.write(padding, std::streamsize(sections[i].offset - written));
+			file.write(static_cast<const char*>(payloads[i].data), std::streamsize(payloads[i].size));
+			written = sections[i].offset + payloads[i].size;
+		}
+		return file.good();
+	}
+
+	// Returns the header if the file is a bundle of the current version.
+	inline const Header* ReadHeader(const MappedFile& file){
+		if (file.Size() < sizeof(Header)){
+			return nullptr;
+		}
+		const Header* header = reinterpret_cast<const Header*>(file.Data());
+		if (std::memcmp(header->magic, MAGIC, sizeof(MAGIC)) != 0 ||
+			header->version != VERSION ||
+			file.Size() < sizeof(Header) + uint64_t(header->sectionCount) * sizeof(Section)
+		){
+			return nullptr;
+		}
+		return header;
+	}
+
+	// Returns the payload of a section, or nullptr if it is missing, truncated or misaligned.
+	inline const unsigned char* FindSection(const MappedFile& file, SectionID id, uint64_t expectedSize){
+		const Header* header = reinterpret_cast<const Header*>(file.Data());
+		const Section* sections = reinterpret_cast<const Section*>(file.Data() + sizeof(Header));
+		for (uint32_t i = 0; i < header->sectionCount; ++i){
+			if (sections[i].id == id){
+				// offset and size come from the file, their sum may wrap; payloads are read as typed arrays
+				if (sections[i].size != expectedSize ||
+					sections[i].offset > file.Size() ||
+					sections[i].size > file.Size() - sections[i].offset ||
+					sections[i].offset % SECTION_ALIGNMENT != 0
+				){
+					return nullptr;
+				}
+				return file.Data() + sections[i].offset;
+			}
+		}
+		return nullptr;
+	}
+
+}
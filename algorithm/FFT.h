@@ -0,0 +1,130 @@
+#pragma once
+
+#include <climits>
+#include <cmath>
+#include <complex>
+#include <vector>
+
+#include "Utils.h"
+#include "ImageUtils.h"
+
+using Complex = std::complex<float>;
+
+inline int NextPowerOf2(int num) {
+	int powerOf2 = 1;
+	while (powerOf2 < num) {
+		powerOf2 <<= 1;
+	}
+	return powerOf2;
+}
+
+// Plain complex products; operator* of std::complex takes a slow path for the C99 inf/nan rules.
+inline Complex MultiplyComplex(const Complex& a, const Complex& b) {
+	return Complex(a.real() * b.real() - a.imag() * b.imag(), a.real() * b.imag() + a.imag() * b.real());
+}
+
+// a * conj(b)
+inline Complex MultiplyConjugate(const Complex& a, const Complex& b) {
+	return Complex(a.real() * b.real() + a.imag() * b.imag(), a.imag() * b.real() - a.real() * b.imag());
+}
+
+// In place radix-2 FFT of count (a power of 2) values, stride apart.
+// twiddles holds exp(-2*pi*i*k/count) for k < count/2; the inverse is unscaled.
+inline void FFT1D(Complex* data, int count, int stride, const Complex* twiddles, bool inverse) {
+	for (int i = 1, j = 0; i < count; ++i) {
+		int bit = count >> 1;
+		for (; j & bit; bit >>= 1) {
+			j ^= bit;
+		}
+		j ^= bit;
+		if (i < j) {
+			std::swap(data[i * stride], data[j * stride]);
+		}
+	}
+	for (int length = 2; length <= count; length <<= 1) {
+		const int half = length >> 1;
+		const int twiddleStep = count / length;
+		for (int k = 0; k < half; ++k) {
+			const Complex twiddle = inverse ? std::conj(twiddles[k * twiddleStep]) : twiddles[k * twiddleStep];
+			for (int start = 0; start < count; start += length) {
+				Complex& even = data[(start + k) * stride];
+				Complex& odd = data[(start + k + half) * stride];
+				const Complex product = MultiplyComplex(odd, twiddle);
+				odd = even - product;
+				even += product;
+			}
+		}
+	}
+}
+
+// 2D FFT over a power of 2 sized, row major grid.
+class FFT2D {
+
+private:
+	Dimension				dimension;
+	std::vector<Complex>	rowTwiddles;
+	std::vector<Complex>	columnTwiddles;
+
+	static std::vector<Complex> MakeTwiddles(int count) {
+		std::vector<Complex> twiddles(count / 2);
+		const double angleStep = -2.0 * 3.14159265358979323846 / double(count);
+		for (int k = 0; k < count / 2; ++k) {
+			twiddles[k] = Complex(float(std::cos(angleStep * k)), float(std::sin(angleStep * k)));
+		}
+		return twiddles;
+	}
+
+	void TransformRows(std::vector<Complex>& data, int rowCount, bool inverse) const {
+		for (int h = 0; h < rowCount; ++h) {
+			FFT1D(&data[h * dimension.width], dimension.width, 1, rowTwiddles.data(), inverse);
+		}
+	}
+
+	void TransformColumns(std::vector<Complex>& data, bool inverse) const {
+		// columns go through a contiguous copy, striding the grid directly thrashes the cache
+		std::vector<Complex> column(dimension.height);
+		for (int w = 0; w < dimension.width; ++w) {
+			for (int h = 0; h < dimension.height; ++h) {
+				column[h] = data[h * dimension.width + w];
+			}
+			FFT1D(column.data(), dimension.height, 1, columnTwiddles.data(), inverse);
+			for (int h = 0; h < dimension.height; ++h) {
+				data[h * dimension.width + w] = column[h];
+			}
+		}
+	}
+
+public:
+	FFT2D(const Dimension& dimension = Dimension{1, 1}):
+		dimension(dimension),
+		rowTwiddles(MakeTwiddles(dimension.width)),
+		columnTwiddles(MakeTwiddles(dimension.height))
+	{
+		AssertRT(IsPowerOf2(dimension.width));
+		AssertRT(IsPowerOf2(dimension.height));
+	}
+
+	const Dimension& GetDimension() const {
+		return dimension;
+	}
+
+	// rows from nonZeroRows on must be zero, they are skipped in the row pass
+	void Forward(std::vector<Complex>& data, int nonZeroRows = INT_MAX) const {
+		AssertRT(data.size() == size_t(dimension.size()));
+		TransformRows(data, mymin(nonZeroRows, dimension.height), false);
+		TransformColumns(data, false);
+	}
+
+	// scaled by 1/size, so Inverse(Forward(x)) == x; only the first neededRows rows of the result are valid
+	void Inverse(std::vector<Complex>& data, int neededRows = INT_MAX) const {
+		AssertRT(data.size() == size_t(dimension.size()));
+		neededRows = mymin(neededRows, dimension.height);
+		TransformColumns(data, true);
+		TransformRows(data, neededRows, true);
+		const float scale = 1.f / float(dimension.size());
+		for (int i = 0; i < neededRows * dimension.width; ++i) {
+			data[i] *= scale;
+		}
+	}
+
+};
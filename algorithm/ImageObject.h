@@ -43,10 +43,29 @@ public:
 		return At(coord.x, coord.y);
 	}
 
+	const DataType& At(unsigned int offset) const {
+		AssertRT(offset < data.size());
+		return data.data()[offset];
+	}
+
+	const DataType& At(unsigned int x, unsigned int y) const {
+		AssertRT(x * y < unsigned int(dimension.size()));
+		AssertRT(x * y < unsigned int(data.size()));
+		return data[y * dimension.width + x];
+	}
+
+	const DataType& At(const Coordinate& coord) const {
+		return At(coord.x, coord.y);
+	}
+
 	std::vector<DataType>& Data(){
 		return data;
 	}
 
+	const std::vector<DataType>& Data() const {
+		return data;
+	}
+
 	void Set(unsigned int x, unsigned int y, const DataType& variable) {
 		At(x, y) = variable;
 	}
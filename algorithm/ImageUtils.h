@@ -1,5 +1,7 @@
 #pragma once
 
+#include <emmintrin.h>
+
 class HSVData {
 
 public:
@@ -169,4 +171,36 @@ RGBData HsvToRgb(HSVData in) {
 		break;
 	}
 	return out;
-}
\ No newline at end of file
+}
+
+inline void RgbaToPixels(const unsigned char* rgba, Pixel* pixels, int pixelCount) {
+	// RGBA bytes in, normalized RGB floats out. Four pixels are expanded per
+	// step, scaled by the reciprocal and repacked into three stores so the
+	// alpha lane never reaches the destination.
+	static_assert(sizeof(Pixel) == 3 * sizeof(float), "Pixel must be three packed floats");
+	const float scaleScalar = 1.f / 255.f;
+	const __m128 scale = _mm_set1_ps(scaleScalar);
+	const __m128i zero = _mm_setzero_si128();
+	float* out = &pixels[0].r;
+	int i = 0;
+	for (; i + 4 <= pixelCount; i += 4) {
+		const __m128i packed = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rgba + i * 4));
+		const __m128i lo = _mm_unpacklo_epi8(packed, zero);
+		const __m128i hi = _mm_unpackhi_epi8(packed, zero);
+		const __m128 p0 = _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, zero)), scale);
+		const __m128 p1 = _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, zero)), scale);
+		const __m128 p2 = _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, zero)), scale);
+		const __m128 p3 = _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(hi, zero)), scale);
+		// (r0 g0 b0 r1) (g1 b1 r2 g2) (b2 r3 g3 b3)
+		const __m128 b0r1 = _mm_shuffle_ps(p0, p1, _MM_SHUFFLE(0, 0, 2, 2));
+		const __m128 b2r3 = _mm_shuffle_ps(p2, p3, _MM_SHUFFLE(0, 0, 2, 2));
+		_mm_storeu_ps(out + i * 3 + 0, _mm_shuffle_ps(p0, b0r1, _MM_SHUFFLE(2, 0, 1, 0)));
+		_mm_storeu_ps(out + i * 3 + 4, _mm_shuffle_ps(p1, p2, _MM_SHUFFLE(1, 0, 2, 1)));
+		_mm_storeu_ps(out + i * 3 + 8, _mm_shuffle_ps(b2r3, p3, _MM_SHUFFLE(2, 1, 2, 0)));
+	}
+	for (; i < pixelCount; ++i) {
+		pixels[i].r = float(rgba[i * 4 + 0]) * scaleScalar;
+		pixels[i].g = float(rgba[i * 4 + 1]) * scaleScalar;
+		pixels[i].b = float(rgba[i * 4 + 2]) * scaleScalar;
+	}
+}
@@ -0,0 +1,324 @@
+#pragma once
+
+#include <vector>
+
+#include "Utils.h"
+
+/*
+	Boykov-Kolmogorov max-flow / min-cut
+	(An Experimental Comparison of Min-Cut/Max-Flow Algorithms for Energy Minimization in Vision, 2004).
+	Two search trees grow from the source and the sink until they touch, the path found is augmented,
+	and the nodes cut off by saturated arcs are adopted back into the trees instead of regrowing them.
+
+	Nodes and arcs live in flat arrays; arcs are added in pairs, so the reverse of arc a is a ^ 1.
+	Reset() keeps the allocations, a graph is meant to be rebuilt for every patch.
+*/
+class MaxFlowGraph {
+
+public:
+	using Capacity = float;
+
+private:
+	static constexpr int NO_ARC = -1;
+	static constexpr int NO_PARENT = -1;		// free node, in neither tree
+	static constexpr int TERMINAL_PARENT = -2;	// attached to its terminal directly
+	static constexpr int ORPHAN_PARENT = -3;	// cut off from its tree, waiting for adoption
+	static constexpr int NOT_ACTIVE = -1;
+
+	struct Node {
+		int			firstArc;
+		int			parentArc;		// arc from the node to its parent in the tree, or one of the *_PARENT values
+		int			nextActive;		// the last active node points to itself
+		int			timestamp;		// when distance was last known to be right
+		int			distance;		// to the terminal along the tree
+		Capacity	terminalCapacity;	// > 0: residual capacity from the source, < 0: to the sink
+		bool		inSinkTree;
+	};
+
+	struct Arc {
+		int			head;
+		int			next;			// next arc leaving the same node
+		Capacity	capacity;		// residual
+	};
+
+	std::vector<Node>	nodes;
+	std::vector<Arc>	arcs;
+	std::vector<int>	orphans;
+	int					firstActive = NOT_ACTIVE;
+	int					lastActive = NOT_ACTIVE;
+	int					time = 0;
+	Capacity			flow = 0;
+
+	void SetActive(int node){
+		if (nodes[node].nextActive == NOT_ACTIVE){
+			nodes[node].nextActive = node;
+			if (lastActive == NOT_ACTIVE){
+				firstActive = node;
+			} else {
+				nodes[lastActive].nextActive = node;
+			}
+			lastActive = node;
+		}
+	}
+
+	int NextActive(){
+		while (firstActive != NOT_ACTIVE){
+			const int node = firstActive;
+			firstActive = (nodes[node].nextActive == node) ? NOT_ACTIVE : nodes[node].nextActive;
+			if (firstActive == NOT_ACTIVE){
+				lastActive = NOT_ACTIVE;
+			}
+			nodes[node].nextActive = NOT_ACTIVE;
+			// nodes freed since they were queued are skipped
+			if (nodes[node].parentArc != NO_PARENT){
+				return node;
+			}
+		}
+		return NOT_ACTIVE;
+	}
+
+	void MakeOrphan(int node){
+		nodes[node].parentArc = ORPHAN_PARENT;
+		orphans.push_back(node);
+	}
+
+	// middleArc goes from the source tree to the sink tree
+	void Augment(int middleArc){
+		Capacity bottleneck = arcs[middleArc].capacity;
+		int node = arcs[middleArc ^ 1].head;
+		for (; nodes[node].parentArc != TERMINAL_PARENT; node = arcs[nodes[node].parentArc].head){
+			bottleneck = mymin(bottleneck, arcs[nodes[node].parentArc ^ 1].capacity);
+		}
+		bottleneck = mymin(bottleneck, nodes[node].terminalCapacity);
+		node = arcs[middleArc].head;
+		for (; nodes[node].parentArc != TERMINAL_PARENT; node = arcs[nodes[node].parentArc].head){
+			bottleneck = mymin(bottleneck, arcs[nodes[node].parentArc].capacity);
+		}
+		bottleneck = mymin(bottleneck, -nodes[node].terminalCapacity);
+
+		arcs[middleArc].capacity -= bottleneck;
+		arcs[middleArc ^ 1].capacity += bottleneck;
+		// source tree, flow runs from the parents down to the middle arc
+		node = arcs[middleArc ^ 1].head;
+		while (nodes[node].parentArc != TERMINAL_PARENT){
+			const int parentArc = nodes[node].parentArc;
+			arcs[parentArc].capacity += bottleneck;
+			arcs[parentArc ^ 1].capacity -= bottleneck;
+			const int parent = arcs[parentArc].head;
+			if (arcs[parentArc ^ 1].capacity == 0){
+				MakeOrphan(node);
+			}
+			node = parent;
+		}
+		nodes[node].terminalCapacity -= bottleneck;
+		if (nodes[node].terminalCapacity == 0){
+			MakeOrphan(node);
+		}
+		// sink tree, flow runs from the middle arc up to the parents
+		node = arcs[middleArc].head;
+		while (nodes[node].parentArc != TERMINAL_PARENT){
+			const int parentArc = nodes[node].parentArc;
+			arcs[parentArc].capacity -= bottleneck;
+			arcs[parentArc ^ 1].capacity += bottleneck;
+			const int parent = arcs[parentArc].head;
+			if (arcs[parentArc].capacity == 0){
+				MakeOrphan(node);
+			}
+			node = parent;
+		}
+		nodes[node].terminalCapacity += bottleneck;
+		if (nodes[node].terminalCapacity == 0){
+			MakeOrphan(node);
+		}
+		flow += bottleneck;
+	}
+
+	// residual capacity along which node could hang below neighbour through arc (leaving node)
+	Capacity TreeCapacity(const Node& node, int arc) const {
+		return node.inSinkTree ? arcs[arc].capacity : arcs[arc ^ 1].capacity;
+	}
+
+	void Adopt(int orphan){
+		Node& node = nodes[orphan];
+		int bestArc = NO_ARC;
+		int bestDistance = INT_MAX;
+		for (int arc = node.firstArc; arc != NO_ARC; arc = arcs[arc].next){
+			if (TreeCapacity(node, arc) == 0){
+				continue;
+			}
+			const int neighbour = arcs[arc].head;
+			if (nodes[neighbour].inSinkTree != node.inSinkTree || nodes[neighbour].parentArc == NO_PARENT){
+				continue;
+			}
+			// the neighbour is a valid parent if its own path still reaches the terminal
+			int distance = 0;
+			int current = neighbour;
+			bool rooted = false;
+			while (true){
+				if (nodes[current].timestamp == time){
+					distance += nodes[current].distance;
+					rooted = true;
+					break;
+				}
+				const int parentArc = nodes[current].parentArc;
+				distance++;
+				if (parentArc == TERMINAL_PARENT){
+					nodes[current].timestamp = time;
+					nodes[current].distance = 1;
+					rooted = true;
+					break;
+				}
+				if (parentArc == ORPHAN_PARENT){
+					break;
+				}
+				current = arcs[parentArc].head;
+			}
+			if (rooted == false){
+				continue;
+			}
+			if (distance < bestDistance){
+				bestArc = arc;
+				bestDistance = distance;
+			}
+			// cache the distances along the path for the next searches of this round
+			for (current = neighbour; nodes[current].timestamp != time; current = arcs[nodes[current].parentArc].head){
+				nodes[current].timestamp = time;
+				nodes[current].distance = distance--;
+			}
+		}
+
+		if (bestArc != NO_ARC){
+			node.parentArc = bestArc;
+			node.timestamp = time;
+			node.distance = bestDistance + 1;
+			return;
+		}
+
+		// no parent: the node becomes free, its children become orphans and its neighbours may grow into it
+		for (int arc = node.firstArc; arc != NO_ARC; arc = arcs[arc].next){
+			const int neighbour = arcs[arc].head;
+			Node& neighbourNode = nodes[neighbour];
+			if (neighbourNode.inSinkTree != node.inSinkTree || neighbourNode.parentArc == NO_PARENT){
+				continue;
+			}
+			if (TreeCapacity(node, arc) != 0){
+				SetActive(neighbour);
+			}
+			if (neighbourNode.parentArc >= 0 && arcs[neighbourNode.parentArc].head == orphan){
+				MakeOrphan(neighbour);
+			}
+		}
+		node.parentArc = NO_PARENT;
+	}
+
+public:
+	void Reset(){
+		nodes.clear();
+		arcs.clear();
+		orphans.clear();
+		firstActive = lastActive = NOT_ACTIVE;
+		time = 0;
+		flow = 0;
+	}
+
+	int AddNode(){
+		nodes.push_back(Node{NO_ARC, NO_PARENT, NOT_ACTIVE, 0, 0, 0, false});
+		return int(nodes.size()) - 1;
+	}
+
+	int NodeCount() const {
+		return int(nodes.size());
+	}
+
+	// adds to the capacities from the source and to the sink; only their difference has to be kept
+	void AddTerminalWeights(int node, Capacity source, Capacity sink){
+		const Capacity current = nodes[node].terminalCapacity;
+		if (current > 0){
+			source += current;
+		} else {
+			sink -= current;
+		}
+		flow += mymin(source, sink);
+		nodes[node].terminalCapacity = source - sink;
+	}
+
+	void AddEdge(int from, int to, Capacity capacity, Capacity reverseCapacity){
+		const int arc = int(arcs.size());
+		arcs.push_back(Arc{to, nodes[from].firstArc, capacity});
+		arcs.push_back(Arc{from, nodes[to].firstArc, reverseCapacity});
+		nodes[from].firstArc = arc;
+		nodes[to].firstArc = arc + 1;
+	}
+
+	Capacity MaxFlow(){
+		for (int i = 0; i < int(nodes.size()); ++i){
+			Node& node = nodes[i];
+			if (node.terminalCapacity != 0){
+				node.inSinkTree = node.terminalCapacity < 0;
+				node.parentArc = TERMINAL_PARENT;
+				node.timestamp = 0;
+				node.distance = 1;
+				SetActive(i);
+			}
+		}
+
+		int current = NOT_ACTIVE;
+		while (true){
+			// keep growing from the node that found the last path, it often has more
+			if (current == NOT_ACTIVE || nodes[current].parentArc == NO_PARENT){
+				current = NextActive();
+				if (current == NOT_ACTIVE){
+					break;
+				}
+			}
+
+			int middleArc = NO_ARC;
+			Node& node = nodes[current];
+			for (int arc = node.firstArc; arc != NO_ARC; arc = arcs[arc].next){
+				if ((node.inSinkTree ? arcs[arc ^ 1].capacity : arcs[arc].capacity) == 0){
+					continue;
+				}
+				const int neighbour = arcs[arc].head;
+				Node& neighbourNode = nodes[neighbour];
+				if (neighbourNode.parentArc == NO_PARENT){
+					neighbourNode.inSinkTree = node.inSinkTree;
+					neighbourNode.parentArc = arc ^ 1;
+					neighbourNode.timestamp = node.timestamp;
+					neighbourNode.distance = node.distance + 1;
+					SetActive(neighbour);
+				} else if (neighbourNode.inSinkTree != node.inSinkTree){
+					middleArc = node.inSinkTree ? (arc ^ 1) : arc;
+					break;
+				} else if (neighbourNode.timestamp <= node.timestamp && neighbourNode.distance > node.distance){
+					// shorter path to the terminal through this node
+					neighbourNode.parentArc = arc ^ 1;
+					neighbourNode.timestamp = node.timestamp;
+					neighbourNode.distance = node.distance + 1;
+				}
+			}
+
+			time++;
+			if (middleArc == NO_ARC){
+				current = NOT_ACTIVE;
+				continue;
+			}
+
+			// the node stays active, it may lead to more paths
+			node.nextActive = current;
+			Augment(middleArc);
+			while (orphans.empty() == false){
+				const int orphan = orphans.back();
+				orphans.pop_back();
+				Adopt(orphan);
+			}
+			node.nextActive = NOT_ACTIVE;
+		}
+		return flow;
+	}
+
+	// after MaxFlow(): which side of the minimum cut a node ended up on
+	bool IsSourceSide(int node) const {
+		return nodes[node].parentArc == NO_PARENT ? true : nodes[node].inSinkTree == false;
+	}
+
+};
@@ -0,0 +1,144 @@
+#pragma once
+
+/*
+	Hardware counters of the calling process through Linux perf_event_open: cycles, instructions, L1D read
+	misses, last level cache misses and branch misses, user space only. Each counter is opened on its own with
+	inherit set, so the threads started while counting (synthesis workers, the parallel codecs) are counted too;
+	a group would be read atomically but cannot inherit. When the kernel multiplexes the counters the values
+	are scaled up by enabled / running time.
+	Counters that cannot be opened (no PMU in a VM, perf_event_paranoid, a container's seccomp profile, or not
+	Linux at all) are left unavailable and read as invalid, the rest keep working.
+*/
+
+#include <cstdint>
+#include <cstring>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+class PerfCounters {
+
+public:
+	enum Counter {
+		CYCLES,
+		INSTRUCTIONS,
+		L1D_MISSES,
+		LLC_MISSES,
+		BRANCH_MISSES,
+		COUNTER_COUNT
+	};
+
+	struct Reading {
+		double	values[COUNTER_COUNT] = {};
+		bool	valid[COUNTER_COUNT] = {};
+	};
+
+	static const char* Name(int counter){
+		static const char* const names[COUNTER_COUNT] = {"cycles", "instructions", "l1dMisses", "llcMisses", "branchMisses"};
+		return names[counter];
+	}
+
+private:
+	int	descriptors[COUNTER_COUNT];
+
+#ifdef __linux__
+	static int Open(std::uint32_t type, std::uint64_t config){
+		perf_event_attr attributes;
+		std::memset(&attributes, 0, sizeof(attributes));
+		attributes.size = sizeof(attributes);
+		attributes.type = type;
+		attributes.config = config;
+		attributes.disabled = 1;
+		attributes.inherit = 1;
+		attributes.exclude_kernel = 1;
+		attributes.exclude_hv = 1;
+		attributes.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+		// this process on any cpu, no group
+		return int(syscall(__NR_perf_event_open, &attributes, 0, -1, -1, 0));
+	}
+
+	static std::uint64_t CacheConfig(std::uint64_t cache){
+		return cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+	}
+#endif
+
+public:
+	PerfCounters(){
+		for (int& descriptor : descriptors) {
+			descriptor = -1;
+		}
+#ifdef __linux__
+		descriptors[CYCLES] = Open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+		descriptors[INSTRUCTIONS] = Open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+		descriptors[L1D_MISSES] = Open(PERF_TYPE_HW_CACHE, CacheConfig(PERF_COUNT_HW_CACHE_L1D));
+		descriptors[LLC_MISSES] = Open(PERF_TYPE_HW_CACHE, CacheConfig(PERF_COUNT_HW_CACHE_LL));
+		descriptors[BRANCH_MISSES] = Open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+#endif
+	}
+
+	PerfCounters(const PerfCounters&) = delete;
+	PerfCounters& operator=(const PerfCounters&) = delete;
+
+	~PerfCounters(){
+#ifdef __linux__
+		for (const int descriptor : descriptors) {
+			if (descriptor >= 0) {
+				close(descriptor);
+			}
+		}
+#endif
+	}
+
+	bool Available(int counter) const {
+		return descriptors[counter] >= 0;
+	}
+
+	bool AnyAvailable() const {
+		for (int counter = 0; counter < COUNTER_COUNT; ++counter) {
+			if (Available(counter)) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void Start(){
+#ifdef __linux__
+		for (const int descriptor : descriptors) {
+			if (descriptor >= 0) {
+				ioctl(descriptor, PERF_EVENT_IOC_RESET, 0);
+				ioctl(descriptor, PERF_EVENT_IOC_ENABLE, 0);
+			}
+		}
+#endif
+	}
+
+	Reading Stop(){
+		Reading reading;
+#ifdef __linux__
+		for (const int descriptor : descriptors) {
+			if (descriptor >= 0) {
+				ioctl(descriptor, PERF_EVENT_IOC_DISABLE, 0);
+			}
+		}
+		for (int counter = 0; counter < COUNTER_COUNT; ++counter) {
+			if (Available(counter) == false) {
+				continue;
+			}
+			// value, time enabled, time running
+			std::uint64_t values[3];
+			if (read(descriptors[counter], values, sizeof(values)) != ssize_t(sizeof(values)) || values[2] == 0) {
+				continue;
+			}
+			reading.values[counter] = double(values[0]) * (double(values[1]) / double(values[2]));
+			reading.valid[counter] = true;
+		}
+#endif
+		return reading;
+	}
+
+};
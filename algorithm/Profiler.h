@@ -0,0 +1,216 @@
+#pragma once
+
+//#define ENABLE_PROFILER
+
+/*
+	Hierarchical scoped profiler on the jpeg-compressor timer (jpeg-compressor/timer.cpp has to be built with it).
+	PROFILE_SCOPE("name") times the rest of the enclosing block as a zone nested in the zone open on the same
+	thread. Zones are aggregated per call path: count, total time and self time (total minus the nested zones).
+	Every thread records into a tree of its own, PROFILE_REPORT merges them by path; zones opened on worker
+	threads start from the root. A thread's tree is merged into a retired one when the thread exits, so worker
+	threads coming and going do not pile up trees. The report and reset are meant for when no other thread is
+	inside a zone.
+	With ENABLE_TRACER every zone is also recorded on the timeline, see Tracer.h.
+	Without ENABLE_PROFILER the macros expand to nothing (PROFILE_SCOPE to the trace event only).
+*/
+
+#include "Tracer.h"
+
+#ifdef ENABLE_PROFILER
+
+#include <cstring>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "jpeg-compressor/timer.h"
+
+class Profiler {
+
+public:
+	struct Zone {
+		const char*			name;
+		unsigned long long	count = 0;
+		timer_ticks			totalTicks = 0;
+		std::vector<std::unique_ptr<Zone>>
+							children;
+
+		explicit Zone(const char* name):
+			name(name)
+		{}
+
+		// zone names are literals, the pointer compare is enough unless the same name comes from two places
+		Zone* Child(const char* childName){
+			for (const std::unique_ptr<Zone>& child : children) {
+				if (child->name == childName || std::strcmp(child->name, childName) == 0) {
+					return child.get();
+				}
+			}
+			children.push_back(std::make_unique<Zone>(childName));
+			return children.back().get();
+		}
+	};
+
+private:
+	// the tree of one thread, retired by the thread's exit
+	struct ThreadTree {
+		Zone*	root = nullptr;
+		Zone*	current = nullptr;
+
+		~ThreadTree(){
+			if (root != nullptr) {
+				Instance().Retire(root);
+			}
+		}
+	};
+
+	std::mutex							threadRootsMutex;
+	// under threadRootsMutex
+	std::vector<std::unique_ptr<Zone>>	threadRoots;	// of the running threads
+	Zone								retiredRoot{"root"};	// the exited threads' trees merged
+
+	Profiler(){
+		timer::init();
+	}
+
+	void Retire(Zone* root){
+		std::lock_guard<std::mutex> lock{threadRootsMutex};
+		for (auto it = threadRoots.begin(); it != threadRoots.end(); ++it) {
+			if (it->get() == root) {
+				Merge(*root, retiredRoot);
+				threadRoots.erase(it);
+				return;
+			}
+		}
+	}
+
+	static Profiler& Instance(){
+		static Profiler profiler;
+		return profiler;
+	}
+
+	static void Merge(const Zone& from, Zone& into){
+		into.count += from.count;
+		into.totalTicks += from.totalTicks;
+		for (const std::unique_ptr<Zone>& child : from.children) {
+			Merge(*child, *into.Child(child->name));
+		}
+	}
+
+	static void Clear(Zone& zone){
+		zone.count = 0;
+		zone.totalTicks = 0;
+		for (const std::unique_ptr<Zone>& child : zone.children) {
+			Clear(*child);
+		}
+	}
+
+	static void Print(std::ostream& stream, const Zone& zone, int depth){
+		if (zone.count == 0) {
+			return;
+		}
+		timer_ticks childTicks = 0;
+		for (const std::unique_ptr<Zone>& child : zone.children) {
+			childTicks += child->totalTicks;
+		}
+		const std::string name = std::string(depth * 2, ' ') + zone.name;
+		stream
+			<< std::left << std::setw(40) << name << std::right
+			<< std::setw(12) << zone.count
+			<< std::setw(14) << std::fixed << std::setprecision(3) << timer::ticks_to_ms(zone.totalTicks)
+			<< std::setw(14) << timer::ticks_to_ms(zone.totalTicks - childTicks)
+			<< std::endl;
+		for (const std::unique_ptr<Zone>& child : zone.children) {
+			Print(stream, *child, depth + 1);
+		}
+	}
+
+public:
+	// the innermost open zone of the calling thread, the root of its tree if none is open
+	static Zone*& CurrentZone(){
+		thread_local ThreadTree tree;
+		if (tree.current == nullptr) {
+			Profiler& profiler = Instance();
+			std::lock_guard<std::mutex> lock{profiler.threadRootsMutex};
+			profiler.threadRoots.push_back(std::make_unique<Zone>("root"));
+			tree.root = profiler.threadRoots.back().get();
+			tree.current = tree.root;
+		}
+		return tree.current;
+	}
+
+	static void Report(std::ostream& stream){
+		Profiler& profiler = Instance();
+		Zone merged{"root"};
+		{
+			std::lock_guard<std::mutex> lock{profiler.threadRootsMutex};
+			Merge(profiler.retiredRoot, merged);
+			for (const std::unique_ptr<Zone>& threadRoot : profiler.threadRoots) {
+				Merge(*threadRoot, merged);
+			}
+		}
+		stream
+			<< std::left << std::setw(40) << "zone" << std::right
+			<< std::setw(12) << "count"
+			<< std::setw(14) << "total ms"
+			<< std::setw(14) << "self ms"
+			<< std::endl;
+		for (const std::unique_ptr<Zone>& child : merged.children) {
+			Print(stream, *child, 0);
+		}
+	}
+
+	static void Reset(){
+		Profiler& profiler = Instance();
+		std::lock_guard<std::mutex> lock{profiler.threadRootsMutex};
+		Clear(profiler.retiredRoot);
+		for (const std::unique_ptr<Zone>& threadRoot : profiler.threadRoots) {
+			Clear(*threadRoot);
+		}
+	}
+
+};
+
+class ScopedProfileZone {
+
+private:
+	Profiler::Zone*	zone;
+	Profiler::Zone*	parent;
+	timer_ticks		startTicks;
+
+public:
+	explicit ScopedProfileZone(const char* name){
+		Profiler::Zone*& current = Profiler::CurrentZone();
+		parent = current;
+		zone = current->Child(name);
+		current = zone;
+		startTicks = timer::get_ticks();
+	}
+
+	ScopedProfileZone(const ScopedProfileZone&) = delete;
+	ScopedProfileZone& operator=(const ScopedProfileZone&) = delete;
+
+	~ScopedProfileZone(){
+		zone->totalTicks += timer::get_ticks() - startTicks;
+		zone->count++;
+		Profiler::CurrentZone() = parent;
+	}
+
+};
+
+#define PROFILE_CONCATENATE_DELAY(a, b) a##b
+#define PROFILE_CONCATENATE(a, b) PROFILE_CONCATENATE_DELAY(a, b)
+#define PROFILE_SCOPE(name) ScopedProfileZone PROFILE_CONCATENATE(profileZone, __LINE__){name}; TRACE_SCOPE(name)
+#define PROFILE_REPORT(stream) Profiler::Report(stream)
+#define PROFILE_RESET() Profiler::Reset()
+
+#else // ENABLE_PROFILER
+
+#define PROFILE_SCOPE(name) TRACE_SCOPE(name)
+#define PROFILE_REPORT(stream)
+#define PROFILE_RESET()
+
+#endif // ENABLE_PROFILER
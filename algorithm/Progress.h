@@ -0,0 +1,124 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+
+/*
+	Progress of a long running call as structured events: the phase, the work items of the phase done and
+	in total (rows, patches), the time since the call started and an estimate of what is left of the phase.
+	The synthesis loops tell a ProgressReporter every time they finish an item, the reporter turns that into
+	an event at most once per interval (and always at the start and the end of a phase), so the callback
+	sees a few events per second however fast the rows go. Advance() may be called from any thread; the
+	callback is only ever invoked by one thread at a time, but not necessarily by the one that started the
+	call, and must not call back into the reporter.
+*/
+struct ProgressEvent {
+	enum Phase : int {
+		NOISE_FILL,
+		COHERENCE_BUILD,
+		PIXEL_SYNTHESIS,
+		OVERLAP_MATCHING_SETUP,
+		RANDOM_PATCHES,
+		PATCH_QUILTING,
+		SEAM_REFINEMENT,
+		BUNDLE_WRITE
+	};
+
+	Phase		phase;
+	uint64_t	done;
+	uint64_t	total;
+	double		elapsedSeconds;	// since the reporter was created
+	double		etaSeconds;		// to the end of the phase at its rate so far, negative until there is a rate
+
+	float Fraction() const {
+		return total ? float(double(done) / double(total)) : 1.f;
+	}
+
+	static const char* PhaseName(Phase phase){
+		switch (phase) {
+		case NOISE_FILL: return "filling output with noise";
+		case COHERENCE_BUILD: return "building coherence map";
+		case PIXEL_SYNTHESIS: return "filling output image";
+		case OVERLAP_MATCHING_SETUP: return "preparing overlap matching";
+		case RANDOM_PATCHES: return "placing random patches";
+		case PATCH_QUILTING: return "quilting patches";
+		case SEAM_REFINEMENT: return "refining seams";
+		case BUNDLE_WRITE: return "writing exemplar bundle";
+		}
+		return "";
+	}
+};
+
+using ProgressCallback = std::function<void(const ProgressEvent&)>;
+
+class ProgressReporter {
+
+public:
+	static constexpr double DEFAULT_INTERVAL_SECONDS = 0.1;
+
+private:
+	using Clock = std::chrono::steady_clock;
+
+	const ProgressCallback		callback;
+	const Clock::duration		interval;
+	const Clock::time_point		startTime;
+	std::atomic<Clock::rep>		nextReportTicks;	// since startTime, the first thread past it reports
+	std::mutex					deliveryMutex;
+	// under deliveryMutex
+	ProgressEvent::Phase		phase = ProgressEvent::NOISE_FILL;
+	uint64_t					total = 0;
+	uint64_t					lastDone = 0;
+	Clock::duration				phaseStart{0};
+
+	void Deliver(uint64_t done, Clock::duration now){
+		lastDone = done;
+		const double elapsed = std::chrono::duration<double>(now).count();
+		const double phaseElapsed = std::chrono::duration<double>(now - phaseStart).count();
+		const double eta = (done > 0) ? phaseElapsed / double(done) * double(total - done) : -1.0;
+		callback(ProgressEvent{phase, done, total, elapsed, eta});
+	}
+
+public:
+	explicit ProgressReporter(const ProgressCallback& callback, double intervalSeconds = DEFAULT_INTERVAL_SECONDS):
+		callback(callback),
+		interval(std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(intervalSeconds))),
+		startTime(Clock::now()),
+		nextReportTicks(0)
+	{}
+
+	ProgressReporter(const ProgressReporter&) = delete;
+	ProgressReporter& operator=(const ProgressReporter&) = delete;
+
+	void BeginPhase(ProgressEvent::Phase newPhase, uint64_t newTotal){
+		const Clock::duration now = Clock::now() - startTime;
+		std::lock_guard<std::mutex> lock{deliveryMutex};
+		phase = newPhase;
+		total = newTotal;
+		phaseStart = now;
+		Deliver(0, now);
+		nextReportTicks.store((now + interval).count(), std::memory_order_relaxed);
+	}
+
+	// done items of the given phase; dropped if the phase is over already or a larger count went out
+	void Advance(ProgressEvent::Phase donePhase, uint64_t done){
+		const Clock::duration now = Clock::now() - startTime;
+		Clock::rep due = nextReportTicks.load(std::memory_order_relaxed);
+		if (now.count() < due || nextReportTicks.compare_exchange_strong(due, (now + interval).count()) == false) {
+			return;
+		}
+		std::lock_guard<std::mutex> lock{deliveryMutex};
+		if (donePhase == phase && done > lastDone && done < total) {
+			Deliver(done, now);
+		}
+	}
+
+	void EndPhase(){
+		const Clock::duration now = Clock::now() - startTime;
+		std::lock_guard<std::mutex> lock{deliveryMutex};
+		Deliver(total, now);
+	}
+
+};
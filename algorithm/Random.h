@@ -14,12 +14,16 @@ private:
 
 public:
 
-	RandomGenerator(double from, double to):
+	static unsigned int DefaultSeed(){
 #ifdef FREEZE_RANDOM
-		generator(0),
+		return 0;
 #else
-		generator((unsigned int)std::time(nullptr)),
+		return (unsigned int)std::time(nullptr);
 #endif
+	}
+
+	RandomGenerator(double from, double to, unsigned int seed = DefaultSeed()):
+		generator(seed),
 		rand_get(double(from), double(to)){}
 
 	double operator () (){
@@ -33,6 +33,7 @@ private:
 	using ReferenceImage = Image<int>;
 #endif
 	static constexpr int COLOR_COMPONENTS  = 3;
+	static constexpr int DECODED_PIXEL_SIZE = 4;
 	static constexpr int UNSET_PIXEL_VALUE = -1;
 
 private:
@@ -75,24 +76,21 @@ public:
 	}
 
 	void LoadInputImage(){
+		// jpgd unpacks to 32bpp internally, so asking for RGBA is a plain copy
 		int actualPixelSize;
 		unsigned char *imageData = jpgd::decompress_jpeg_image_from_file(
 			inputImagePath.c_str(),
 			&inputDimension.width,
 			&inputDimension.height,
 			&actualPixelSize,
-			COLOR_COMPONENTS
+			DECODED_PIXEL_SIZE
 		);
+		AssertRT(imageData != nullptr);
 		AssertRT(actualPixelSize == COLOR_COMPONENTS);
 
 		inputImage.SetDimension(inputDimension);
-		int inputImageRawSize = inputDimension.size() * 3;
-		for (int i = 0; i < inputImageRawSize; i += 3){
-			float r = float(imageData[i + 0]) / 255.f;
-			float g = float(imageData[i + 1]) / 255.f;
-			float b = float(imageData[i + 2]) / 255.f;
-			inputImage.Data().emplace_back(r, g, b);
-		}
+		inputImage.Data().resize(inputDimension.size());
+		RgbaToPixels(imageData, inputImage.Data().data(), inputDimension.size());
 		free(imageData);
 	}
 
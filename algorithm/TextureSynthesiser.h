@@ -4,6 +4,9 @@
 #include <algorithm>
 #include <functional>
 #include <thread>
+#include <atomic>
+#include <memory>
+#include <limits>
 
 #include "jpeg-compressor/jpgd.h"
 #include "jpeg-compressor/jpge.h"
@@ -12,34 +15,176 @@
 #include "ImageObject.h"
 #include "ImageUtils.h"
 #include "Random.h"
+#include "ExemplarBundle.h"
+#include "FFT.h"
+#include "MaxFlow.h"
+#include "Progress.h"
+#include "Cancellation.h"
+#include "Profiler.h"
 
 class TextureSynthesiser {
 
 public:
-	using ProgressCallbackType = const std::function<void(float, std::string)>&;
+	using ProgressCallbackType = const ProgressCallback&;
 	enum GenerationMode : int {
 		BRUTE_FORCE,
 		K_COHERENCE,
-		PATCH_BASED
+		PATCH_BASED,
+		PATCH_GRAPH_CUT
 	};
 	enum ValueDistanceMode: int {
 		INPUT_INPUT,
 		INPUT_OUTPUT
 	};
+	enum GenerationStatus : int {
+		COMPLETED,
+		CANCELLED,
+		DEADLINE_EXCEEDED,
+		BUDGET_SPENT		// GenerateWithinBudget(): the output is whole, but could have been refined further
+	};
+	// Algorithmic work of a Generate() call, for tuning the thresholds. Every thread counts into its own copy,
+	// the copies are summed at the end.
+	struct SynthesisStats {
+		// pixel based modes (distance evaluations also counts the blocks scored by the patch based modes)
+		uint64_t	distanceEvaluations = 0;
+		uint64_t	tapsAccumulated = 0;		// pixel pairs summed into those distances
+		uint64_t	rejectedByBorder = 0;		// neighbourhood cut off by the input border
+		uint64_t	rejectedBySimilarity = 0;	// within similarityThreshold, too similar to be used
+		uint64_t	rejectedByEarlyExit = 0;	// BRUTE_FORCE candidates skipped after a good enough match
+		uint64_t	goodEnoughHits = 0;
+		uint64_t	similarListsScanned = 0;	// K_COHERENCE lists searched, and their total length
+		uint64_t	similarListEntries = 0;
+		uint64_t	coherenceClusters = 0;		// ids in the coherence map
+		// patch based modes
+		uint64_t	patchesPlaced = 0;
+		uint64_t	candidatesWithinTolerance = 0;
+		uint64_t	seamGraphNodes = 0;
+
+		double AverageSimilarListLength() const {
+			return similarListsScanned ? double(similarListEntries) / double(similarListsScanned) : 0.0;
+		}
+
+		SynthesisStats& operator+=(const SynthesisStats& other){
+			distanceEvaluations += other.distanceEvaluations;
+			tapsAccumulated += other.tapsAccumulated;
+			rejectedByBorder += other.rejectedByBorder;
+			rejectedBySimilarity += other.rejectedBySimilarity;
+			rejectedByEarlyExit += other.rejectedByEarlyExit;
+			goodEnoughHits += other.goodEnoughHits;
+			similarListsScanned += other.similarListsScanned;
+			similarListEntries += other.similarListEntries;
+			coherenceClusters += other.coherenceClusters;
+			patchesPlaced += other.patchesPlaced;
+			candidatesWithinTolerance += other.candidatesWithinTolerance;
+			seamGraphNodes += other.seamGraphNodes;
+			return *this;
+		}
+	};
+	// A stopped call leaves a usable output: the pixel based modes keep the noise in the rows they did not
+	// get to, the patch based ones show the exemplar tiled where no patch was placed.
+	struct GenerationResult {
+		GenerationStatus	status;
+		SynthesisStats		stats;
+		int					passesCompleted = 0;	// GenerateWithinBudget(): 1 quilted, 1 + n after n refinement rounds
+	};
 private:
 	using PixelImage = Image<Pixel>;
 	using ReferenceImage = Image<int>;
 	static constexpr int COLOR_COMPONENTS  = 3;
+	static constexpr int DECODED_PIXEL_SIZE = 4;
 	static constexpr int UNSET_PIXEL_VALUE = -1;
+	static constexpr int PATCH_SIZE = 40;
+	static constexpr int PATCH_OVERLAP = 10;
+	// any block whose overlap error is within this ratio of the best one may be chosen
+	static constexpr float PATCH_ERROR_TOLERANCE = 0.1f;
+	// FFT round-off in the overlap errors, relative to the overlap energy (measured below 1e-6)
+	static constexpr float PATCH_ERROR_ROUNDOFF = 1e-5f;
+	// PATCH_GRAPH_CUT: terminal weight that pins a pixel to one side of the seam
+	static constexpr float SEAM_CONSTRAINT = 1e9f;
+	// PATCH_GRAPH_CUT: rounds of refinement patches re-cutting the seams around the patch corners
+	static constexpr int SEAM_REFINEMENT_PASSES = 1;
+	// GenerateWithinBudget(): refinement rounds at most, later ones hardly change the output
+	static constexpr int ANYTIME_REFINEMENT_ROUNDS = 8;
+
+	// scratch buffers of a patch placement, reused from patch to patch
+	struct QuiltWorkspace {
+		std::vector<Pixel>	overlapPixels;		// output under the overlap, patch sized
+		std::vector<float>	candidateErrors;	// overlap error of every input block
+		std::vector<float>	overlapErrors;		// per pixel error of the chosen block, patch sized
+		std::vector<float>	cutCosts;
+		std::vector<int>	verticalCut;		// per patch row, first column taken from the new block
+		std::vector<int>	horizontalCut;		// per patch column, first row taken from the new block
+		std::vector<Complex>	overlapSpectrum;	// overlap, packed like inputSpectra, FFT sized
+		std::vector<Complex>	correlation;		// overlap against every input block, FFT sized
+		MaxFlowGraph		seamGraph;			// one node per patch pixel plus one per old seam
+		SynthesisStats		stats;				// of the worker owning the workspace
+	};
+
+	struct PatchPlacement {
+		Coordinate	outputCoord;
+		Dimension	patchDimension;
+		int			leftOverlap;	// the patch is matched against the output under these
+		int			topOverlap;
+		int			newInset;		// PATCH_GRAPH_CUT refinement, see PlacePatchGraphCut()
+		bool		graphCut;		// seam cut by PlacePatchGraphCut(), or PlacePatch()
+	};
+
+	// K_COHERENCE clusters, see BuildCoherenceMap()
+	struct CoherenceMap {
+		int					neighbourSize;		// the parameters it was built with
+		float				similarityThreshold;
+		float				coherenceThreshold;
+		std::vector<int>	inputImageIDs;
+		std::vector<std::vector<int>>
+							inputSimilarIDs;
+	};
+
+	// PATCH_BASED overlap matching, see PrepareOverlapMatching()
+	struct OverlapMatching {
+		FFT2D				overlapFFT;
+		std::vector<Complex>
+							inputSpectra[2];	// red + i*green, blue
+		std::vector<double>	inputEnergyTable;	// summed area table of squared pixel norms
+		int					tableWidth;
+
+		double GetInputEnergy(int x, int y, int width, int height) const {
+			return
+				inputEnergyTable[(y + height) * tableWidth + x + width] -
+				inputEnergyTable[y * tableWidth + x + width] -
+				inputEnergyTable[(y + height) * tableWidth + x] +
+				inputEnergyTable[y * tableWidth + x];
+		}
+	};
+
+public:
+	// What synthesisers of one exemplar can share: its pixels and the analysis built on them so far, never an
+	// output. Taken from a synthesiser with GetExemplarAnalysis(), handed to the next one's constructor.
+	struct ExemplarAnalysis {
+		Dimension							inputDimension;
+		std::shared_ptr<const PixelImage>	inputImage;
+		std::string							inputImagePath;
+		uint64_t							inputContentHash = 0;
+		int									inputScaleShift = 0;
+		std::shared_ptr<const CoherenceMap>	coherenceMap;
+		std::shared_ptr<const OverlapMatching>
+											overlapMatching;
+	};
 
 private:
 	Dimension			inputDimension;
-	PixelImage			inputImage;
+	// the exemplar pixels, never changed once loaded, so synthesisers of the same exemplar share them
+	std::shared_ptr<const PixelImage>
+						inputImage;
 	std::string			inputImagePath;
+	uint64_t			inputContentHash;
+	int					inputScaleShift;
 
-	std::vector<int>	inputImageIDs;
-	std::vector<std::vector<int>>
-						inputSimilarIDs;
+	// The exemplar analysis, built when a mode first needs it and never changed after, so synthesisers of
+	// the same exemplar can share it; swapped in with std::atomic_store for them to pick up.
+	std::shared_ptr<const CoherenceMap>
+						coherenceMap;
+	std::shared_ptr<const OverlapMatching>
+						overlapMatching;
 
 	Dimension			outputDimension;
 	ReferenceImage		outputRefImage;
@@ -49,6 +194,15 @@ private:
 	float				similarityThreshold;
 	GenerationMode		generationMode;
 	float				coherenceThreshold;
+	unsigned int		randomSeed;
+	int					workerCount;
+
+	// of the Generate() call under way; the status is latched by StopRequested()
+	const CancellationToken*
+						cancellation;
+	const CancellationToken*
+						budget;				// GenerateWithinBudget() only
+	std::atomic<int>	generationStatus;
 
 public:
 	TextureSynthesiser(
@@ -57,40 +211,331 @@ public:
 		int neighbourSize,
 		float similarityThreshold,
 		GenerationMode generationMode,
-		float coherenceThreshold
+		float coherenceThreshold,
+		int inputScaleShift = 0 // exemplar is decoded at 1/2^x of its size, 0..3
 	):
 		inputImagePath(inputImagePath),
+		inputScaleShift(inputScaleShift),
 		outputDimension(outputDimension),
 		outputRefImage(outputDimension.width, outputDimension.height),
 		outputImage(outputDimension.width, outputDimension.height),
 		neighbourSize(neighbourSize),
 		similarityThreshold(similarityThreshold),
 		generationMode(generationMode),
-		coherenceThreshold(coherenceThreshold)
+		coherenceThreshold(coherenceThreshold),
+		randomSeed(RandomGenerator::DefaultSeed()),
+		workerCount(mymax(int(std::thread::hardware_concurrency()), 1)),
+		cancellation(&CancellationToken::None()),
+		budget(&CancellationToken::None()),
+		generationStatus(COMPLETED)
 	{
+		// allocated once, so a preview can keep reading it while generations come and go
+		outputRefImage.Data().assign(outputDimension.size(), UNSET_PIXEL_VALUE);
 		LoadInputImage();
 	}
 
-	void LoadInputImage(){
+	// Another output of an analysed exemplar, without decoding or analysing it again: the pixels and the
+	// overlap matching setup are shared, and so is the coherence map if it was built with these parameters.
+	TextureSynthesiser(
+		const ExemplarAnalysis& exemplar,
+		Dimension outputDimension,
+		int neighbourSize,
+		float similarityThreshold,
+		GenerationMode generationMode,
+		float coherenceThreshold
+	):
+		inputDimension(exemplar.inputDimension),
+		inputImage(exemplar.inputImage),
+		inputImagePath(exemplar.inputImagePath),
+		inputContentHash(exemplar.inputContentHash),
+		inputScaleShift(exemplar.inputScaleShift),
+		overlapMatching(exemplar.overlapMatching),
+		outputDimension(outputDimension),
+		outputRefImage(outputDimension.width, outputDimension.height),
+		outputImage(outputDimension.width, outputDimension.height),
+		neighbourSize(neighbourSize),
+		similarityThreshold(similarityThreshold),
+		generationMode(generationMode),
+		coherenceThreshold(coherenceThreshold),
+		randomSeed(RandomGenerator::DefaultSeed()),
+		workerCount(mymax(int(std::thread::hardware_concurrency()), 1)),
+		cancellation(&CancellationToken::None()),
+		budget(&CancellationToken::None()),
+		generationStatus(COMPLETED)
+	{
+		outputRefImage.Data().assign(outputDimension.size(), UNSET_PIXEL_VALUE);
+		const std::shared_ptr<const CoherenceMap>& sourceMap = exemplar.coherenceMap;
+		if (sourceMap &&
+			sourceMap->neighbourSize == neighbourSize &&
+			sourceMap->similarityThreshold == similarityThreshold &&
+			sourceMap->coherenceThreshold == coherenceThreshold
+		){
+			coherenceMap = sourceMap;
+		}
+	}
+
+	// the exemplar and as much of its analysis as is built, from any thread
+	ExemplarAnalysis GetExemplarAnalysis() const {
+		ExemplarAnalysis analysis;
+		analysis.inputDimension = inputDimension;
+		analysis.inputImage = inputImage;
+		analysis.inputImagePath = inputImagePath;
+		analysis.inputContentHash = inputContentHash;
+		analysis.inputScaleShift = inputScaleShift;
+		analysis.coherenceMap = std::atomic_load(&coherenceMap);
+		analysis.overlapMatching = std::atomic_load(&overlapMatching);
+		return analysis;
+	}
+
+	const Dimension& GetInputDimension() const {
+		return inputDimension;
+	}
+
+	// false if the exemplar could not be read or decoded; nothing can be generated from it then
+	bool IsInputLoaded() const {
+		return inputImage && inputImage->Data().empty() == false;
+	}
+
+	const Dimension& GetOutputDimension() const {
+		return outputDimension;
+	}
+
+	// The output as offsets into GetInputPixels(), UNSET_PIXEL_VALUE where nothing is placed yet, row by row.
+	// Generate() writes it in place with relaxed atomic stores: a preview reading it meanwhile has to load
+	// with LoadRelaxed(), and may see a pixel of the previous state.
+	const int* GetOutputReferences(){
+		return outputRefImage.Data().data();
+	}
+
+	const std::vector<Pixel>& GetInputPixels(){
+		return inputImage->Data();
+	}
+
+	// the same seed gives the same output, whatever the worker count
+	void SetRandomSeed(unsigned int seed){
+		randomSeed = seed;
+	}
+
+	// threads used by the patch based modes, the calling thread included
+	void SetWorkerCount(int count){
+		workerCount = mymax(count, 1);
+	}
+
+	// checked per pixel by the pixel modes and the coherence map build, per patch by the patch modes; once it
+	// stops the call it keeps saying so, on every thread
+	bool StopRequested(){
+		if (generationStatus.load(std::memory_order_relaxed) != COMPLETED){
+			return true;
+		}
+		const GenerationStatus status =
+			cancellation->IsCancelled() ? CANCELLED :
+			cancellation->IsPastDeadline() ? DEADLINE_EXCEEDED :
+			budget->IsPastDeadline() ? BUDGET_SPENT :
+			COMPLETED;
+		if (status == COMPLETED){
+			return false;
+		}
+		int running = COMPLETED;
+		generationStatus.compare_exchange_strong(running, status);
+		return true;
+	}
+
+	// false if the exemplar cannot be read or decoded, it is left empty then
+	bool LoadInputImage(){
+		PROFILE_SCOPE("load input");
+		MappedFile inputFile;
+		if (inputFile.Open(inputImagePath) == false){
+			return false;
+		}
+		inputContentHash = HashBytes(inputFile.Data(), inputFile.Size());
+		if (LoadExemplarBundle(ExemplarBundle::PathFor(inputImagePath))){
+			return true;
+		}
+
+		// jpgd unpacks to 32bpp internally, so asking for RGBA is a plain copy;
+		// exemplars with restart markers are decoded one restart interval slice per core,
+		// downscaled ones straight from the DCT coefficients without a full size decode
 		int actualPixelSize;
-		unsigned char *imageData = jpgd::decompress_jpeg_image_from_file(
-			inputImagePath.c_str(),
-			&inputDimension.width,
-			&inputDimension.height,
-			&actualPixelSize,
-			COLOR_COMPONENTS
-		);
+		unsigned char *imageData = nullptr;
+		{
+			PROFILE_SCOPE("decode");
+			if (inputScaleShift > 0){
+				imageData = jpgd::decompress_jpeg_image_from_memory_scaled(
+					inputFile.Data(),
+					int(inputFile.Size()),
+					&inputDimension.width,
+					&inputDimension.height,
+					&actualPixelSize,
+					DECODED_PIXEL_SIZE,
+					inputScaleShift
+				);
+			} else {
+				imageData = jpgd::decompress_jpeg_image_from_memory_parallel(
+					inputFile.Data(),
+					int(inputFile.Size()),
+					&inputDimension.width,
+					&inputDimension.height,
+					&actualPixelSize,
+					DECODED_PIXEL_SIZE,
+					int(std::thread::hardware_concurrency())
+				);
+			}
+		}
+		if (imageData == nullptr){
+			inputDimension = Dimension{0, 0};
+			return false;
+		}
 		AssertRT(actualPixelSize == COLOR_COMPONENTS);
 
-		inputImage.SetDimension(inputDimension);
-		int inputImageRawSize = inputDimension.size() * 3;
-		for (int i = 0; i < inputImageRawSize; i += 3){
-			float r = float(imageData[i + 0]) / 255.f;
-			float g = float(imageData[i + 1]) / 255.f;
-			float b = float(imageData[i + 2]) / 255.f;
-			inputImage.Data().emplace_back(r, g, b);
+		const std::shared_ptr<PixelImage> pixels = std::make_shared<PixelImage>();
+		pixels->SetDimension(inputDimension);
+		pixels->Data().resize(inputDimension.size());
+		{
+			PROFILE_SCOPE("float conversion");
+			RgbaToPixels(imageData, pixels->Data().data(), inputDimension.size());
 		}
 		free(imageData);
+		inputImage = pixels;
+		return true;
+	}
+
+	std::shared_ptr<CoherenceMap> NewCoherenceMap() const {
+		const std::shared_ptr<CoherenceMap> map = std::make_shared<CoherenceMap>();
+		map->neighbourSize = neighbourSize;
+		map->similarityThreshold = similarityThreshold;
+		map->coherenceThreshold = coherenceThreshold;
+		return map;
+	}
+
+	ExemplarBundle::Header MakeBundleHeader() const {
+		ExemplarBundle::Header header{};
+		header.contentHash = inputContentHash;
+		header.scaleShift = inputScaleShift;
+		header.width = inputDimension.width;
+		header.height = inputDimension.height;
+		header.neighbourSize = neighbourSize;
+		header.similarityThreshold = similarityThreshold;
+		header.coherenceThreshold = coherenceThreshold;
+		return header;
+	}
+
+	bool LoadExemplarBundle(const std::string& bundlePath){
+		// a bundle built from other bytes or other analysis parameters is stale
+		MappedFile bundleFile;
+		if (bundleFile.Open(bundlePath) == false){
+			return false;
+		}
+		const ExemplarBundle::Header* header = ExemplarBundle::ReadHeader(bundleFile);
+		const ExemplarBundle::Header expected = MakeBundleHeader();
+		if (header == nullptr ||
+			header->contentHash != expected.contentHash ||
+			header->scaleShift != expected.scaleShift ||
+			header->neighbourSize != expected.neighbourSize ||
+			header->similarityThreshold != expected.similarityThreshold ||
+			header->coherenceThreshold != expected.coherenceThreshold ||
+			header->width <= 0 || header->height <= 0
+		){
+			return false;
+		}
+
+		const Dimension bundleDimension{header->width, header->height};
+		// pixels are addressed by int offsets
+		const uint64_t pixelCount = uint64_t(header->width) * uint64_t(header->height);
+		if (pixelCount >= uint64_t(std::numeric_limits<int>::max())){
+			return false;
+		}
+		const unsigned char* pixels = ExemplarBundle::FindSection(
+			bundleFile, ExemplarBundle::PIXELS, pixelCount * sizeof(Pixel));
+		const unsigned char* pixelIDs = ExemplarBundle::FindSection(
+			bundleFile, ExemplarBundle::PIXEL_IDS, pixelCount * sizeof(int));
+		const unsigned char* similarOffsets = ExemplarBundle::FindSection(
+			bundleFile, ExemplarBundle::SIMILAR_OFFSETS, (pixelCount + 1) * sizeof(int));
+		if (pixels == nullptr || pixelIDs == nullptr || similarOffsets == nullptr){
+			return false;
+		}
+		// the hash only says the exemplar is the same, the bundle itself may still be damaged or edited:
+		// the ranges must tile the ids section and every id must be a pixel of the exemplar
+		const int* offsets = reinterpret_cast<const int*>(similarOffsets);
+		if (offsets[0] != 0){
+			return false;
+		}
+		for (size_t pixelID = 0; pixelID < pixelCount; ++pixelID){
+			if (offsets[pixelID + 1] < offsets[pixelID]){
+				return false;
+			}
+		}
+		const unsigned char* similarIDs = ExemplarBundle::FindSection(
+			bundleFile, ExemplarBundle::SIMILAR_IDS, uint64_t(offsets[pixelCount]) * sizeof(int));
+		if (similarIDs == nullptr){
+			return false;
+		}
+		const int* ids = reinterpret_cast<const int*>(pixelIDs);
+		const int* members = reinterpret_cast<const int*>(similarIDs);
+		for (size_t pixelID = 0; pixelID < pixelCount; ++pixelID){
+			if (ids[pixelID] != UNSET_PIXEL_VALUE && (ids[pixelID] < 0 || uint64_t(ids[pixelID]) >= pixelCount)){
+				return false;
+			}
+		}
+		for (int member = 0; member < offsets[pixelCount]; ++member){
+			if (members[member] < 0 || uint64_t(members[member]) >= pixelCount){
+				return false;
+			}
+		}
+
+		// copied out of the mapping: the synthesis works on the same vectors a freshly built analysis has
+		inputDimension = bundleDimension;
+		const std::shared_ptr<PixelImage> image = std::make_shared<PixelImage>();
+		image->SetDimension(inputDimension);
+		image->Data().resize(size_t(pixelCount));
+		std::memcpy(image->Data().data(), pixels, size_t(pixelCount) * sizeof(Pixel));
+		inputImage = image;
+
+		const std::shared_ptr<CoherenceMap> map = NewCoherenceMap();
+		map->inputImageIDs.assign(ids, ids + pixelCount);
+		// only cluster roots own members, every other list stays unallocated
+		map->inputSimilarIDs.resize(size_t(pixelCount));
+		for (size_t pixelID = 0; pixelID < pixelCount; ++pixelID){
+			if (offsets[pixelID] != offsets[pixelID + 1]){
+				map->inputSimilarIDs[pixelID].assign(members + offsets[pixelID], members + offsets[pixelID + 1]);
+			}
+		}
+		std::atomic_store(&coherenceMap, std::shared_ptr<const CoherenceMap>{map});
+		return true;
+	}
+
+	bool SaveExemplarBundle(ProgressCallbackType callback){
+		ProgressReporter progress{callback};
+		if (coherenceMap == nullptr){
+			SynthesisStats stats;
+			BuildCoherenceMap(progress, stats);
+		}
+		if (coherenceMap == nullptr){
+			return false;
+		}
+		const CoherenceMap& map = *coherenceMap;
+
+		std::vector<int> similarOffsets;
+		std::vector<int> similarIDs;
+		similarOffsets.reserve(map.inputSimilarIDs.size() + 1);
+		for (const std::vector<int>& similars : map.inputSimilarIDs){
+			similarOffsets.push_back(int(similarIDs.size()));
+			similarIDs.insert(similarIDs.end(), similars.cbegin(), similars.cend());
+		}
+		similarOffsets.push_back(int(similarIDs.size()));
+
+		progress.BeginPhase(ProgressEvent::BUNDLE_WRITE, 1);
+		const bool written = ExemplarBundle::Write(
+			ExemplarBundle::PathFor(inputImagePath),
+			MakeBundleHeader(),
+			{
+				{ExemplarBundle::PIXELS, inputImage->Data().data(), inputImage->Data().size() * sizeof(Pixel)},
+				{ExemplarBundle::PIXEL_IDS, map.inputImageIDs.data(), map.inputImageIDs.size() * sizeof(int)},
+				{ExemplarBundle::SIMILAR_OFFSETS, similarOffsets.data(), similarOffsets.size() * sizeof(int)},
+				{ExemplarBundle::SIMILAR_IDS, similarIDs.data(), similarIDs.size() * sizeof(int)}
+			}
+		);
+		progress.EndPhase();
+		return written;
 	}
 
 	float GetColorDistanceSquared(const Pixel& a, const Pixel& b){
@@ -118,18 +563,18 @@ public:
 	};
 
 	void FillReferenceOutputWithNoise(){
-		RandomGenerator randomGenerator{0, double(inputDimension.size())};
+		PROFILE_SCOPE("noise fill");
+		RandomGenerator randomGenerator{0, double(inputDimension.size()), randomSeed};
 		for (int hOut = 0; hOut < outputDimension.height; hOut++){
 			for (int wOut = 0; wOut < outputDimension.width; wOut++){
-				const int randomInputPosition = int(randomGenerator());
-				outputRefImage.Data().push_back(randomInputPosition);
+				const int randomInputPosition = mymin(int(randomGenerator()), inputDimension.size() - 1);
+				StoreRelaxed(outputRefImage.At(wOut, hOut), randomInputPosition);
 			}
 		}
-		AssertRT(outputRefImage.Data().size() == outputDimension.size());
 	}
 
 	template <ValueDistanceMode DistanceMode>
-	float GetBlockDistance(const Coordinate& similarCoord, const Coordinate& originalCoord){
+	float GetBlockDistance(const Coordinate& similarCoord, const Coordinate& originalCoord, SynthesisStats& stats){
 		// calculate the accumulated distance of two blocks in input image
 		// TODO: if we are not interested in a cropped block, 
 		// we should return from the for cycle instead of 
@@ -158,13 +603,13 @@ public:
 							)
 						)
 					){
-						const Pixel& similarPixel = inputImage.At(offsetedSimCrd);
+						const Pixel& similarPixel = inputImage->At(offsetedSimCrd);
 						if (DistanceMode == ValueDistanceMode::INPUT_INPUT){
-							const Pixel& originalPixel = inputImage.At(offsetedOrigCrd);
+							const Pixel& originalPixel = inputImage->At(offsetedOrigCrd);
 							sumOfDistances += GetColorDistanceSquared(similarPixel, originalPixel);
 						} else {
 							int inputPixelOffset = outputRefImage.At(TileizeCoordinate(offsetedOrigCrd, outputDimension));
-							const Pixel& originalPixel = inputImage.At(inputPixelOffset);
+							const Pixel& originalPixel = inputImage->At(inputPixelOffset);
 							sumOfDistances += GetColorDistanceSquared(similarPixel, originalPixel);
 						}
 						foundPixelInBlock += 1.0f;
@@ -173,21 +618,31 @@ public:
 			}
 		}
 		const float validPixelCount = float((neighbourSize*2 + 1)*(neighbourSize + 1) - (neighbourSize + 1));
+		stats.distanceEvaluations++;
+		stats.tapsAccumulated += uint64_t(foundPixelInBlock);
 		if (foundPixelInBlock == validPixelCount){
 			const float normalizedDistance = sumOfDistances / foundPixelInBlock;
 			if (normalizedDistance <= similarityThreshold){
 				// too big similarity makes the result noisy
+				stats.rejectedBySimilarity++;
 				return FLT_MAX;
 			} else {
 				return normalizedDistance;
 			}
 		} else {
+			stats.rejectedByBorder++;
 			return FLT_MAX;
 		}
 	}
 
-	void BuildCoherenceMap(ProgressCallbackType callback){
-		callback(0, "initializing id arrays");
+	void BuildCoherenceMap(ProgressReporter& progress, SynthesisStats& stats){
+		PROFILE_SCOPE("coherence build");
+		const int firstRow = neighbourSize;
+		const int endRow = mymax(inputDimension.height - neighbourSize, firstRow);
+		progress.BeginPhase(ProgressEvent::COHERENCE_BUILD, uint64_t(endRow - firstRow));
+		const std::shared_ptr<CoherenceMap> map = NewCoherenceMap();
+		std::vector<int>& inputImageIDs = map->inputImageIDs;
+		std::vector<std::vector<int>>& inputSimilarIDs = map->inputSimilarIDs;
 		for (int hIn = 0; hIn < inputDimension.height; ++hIn){
 			for (int wIn = 0; wIn < inputDimension.width; ++wIn){
 				inputImageIDs.push_back(UNSET_PIXEL_VALUE);
@@ -197,9 +652,13 @@ public:
 		AssertRT(inputImageIDs.size() == inputDimension.size());
 		AssertRT(inputSimilarIDs.size() == inputDimension.size());
 
-		callback(0, "loading similars");
-		for (int hIn = neighbourSize; hIn < inputDimension.height - neighbourSize; ++hIn){
+		for (int hIn = firstRow; hIn < endRow; ++hIn){
 			for (int wIn = neighbourSize; wIn < inputDimension.width - neighbourSize; ++wIn){
+				// a pixel scans the rest of the exemplar, a row of them can take seconds
+				if (StopRequested()){
+					// half a map would pass for a whole one later on, it is not kept
+					return;
+				}
 				const int pixelOffset = hIn*inputDimension.width + wIn;
 				// inputSimilarIDs[inputImageID] = [inputImageID1, inputImageID2, ...]
 				AssertRT(inputImageIDs.size() > pixelOffset);
@@ -216,7 +675,7 @@ public:
 							if (inputImageIDs[similarPixelOffset] == UNSET_PIXEL_VALUE){
 								const Coordinate similarCoordinate{wInSim, hInSim};
 								const Coordinate currentCoordinate{wIn, hIn};
-								const float distance = GetBlockDistance<ValueDistanceMode::INPUT_INPUT>(similarCoordinate, currentCoordinate);
+								const float distance = GetBlockDistance<ValueDistanceMode::INPUT_INPUT>(similarCoordinate, currentCoordinate, stats);
 								if (distance < coherenceThreshold){
 									inputImageIDs[similarPixelOffset] = pixelID;
 									inputSimilarIDs[pixelID].push_back(similarPixelOffset);
@@ -228,15 +687,24 @@ public:
 					//AssertRT(inputSimilarIDs[pixelID].size() < 10);
 				}
 			}
-			callback(float(hIn) / inputDimension.height, "building coherence");
+			progress.Advance(ProgressEvent::COHERENCE_BUILD, uint64_t(hIn - firstRow + 1));
 		}
+		std::atomic_store(&coherenceMap, std::shared_ptr<const CoherenceMap>{map});
+		progress.EndPhase();
 	}
 
-	void SynthesiseTexture(ProgressCallbackType callback) {
+	void SynthesiseTexture(ProgressReporter& progress, SynthesisStats& stats) {
 		// walk over every pixel on the output image
 		const float goodEnoughDistance = similarityThreshold * 1.4f;
+		const CoherenceMap* const map = coherenceMap.get();	// K_COHERENCE only
+		progress.BeginPhase(ProgressEvent::PIXEL_SYNTHESIS, uint64_t(outputDimension.height));
 		for (int hOut = 0; hOut < outputDimension.height; hOut++) {
+			PROFILE_SCOPE("synthesis row");
 			for (int wOut = 0; wOut < outputDimension.width; wOut++) {
+				// both modes search much of the exemplar for a pixel, a row of them can take seconds
+				if (StopRequested()) {
+					return;
+				}
 				Coordinate outputPixelCoord{wOut, hOut};
 				if (generationMode == GenerationMode::BRUTE_FORCE) {
 					Coordinate candidateInputPixel;
@@ -244,19 +712,21 @@ public:
 					for (int hIn = 0; hIn < inputDimension.height; ++hIn) {
 						for (int wIn = 0; wIn < inputDimension.width; ++wIn) {
 							Coordinate inputPixelCoord{wIn, hIn};
-							float inputNeighbourhoodDistance = GetBlockDistance<ValueDistanceMode::INPUT_OUTPUT>(inputPixelCoord, outputPixelCoord);
+							float inputNeighbourhoodDistance = GetBlockDistance<ValueDistanceMode::INPUT_OUTPUT>(inputPixelCoord, outputPixelCoord, stats);
 							if (inputNeighbourhoodDistance < neighbourhoodMinimalDistance) {
 								neighbourhoodMinimalDistance = inputNeighbourhoodDistance;
 								candidateInputPixel.y = hIn;
 								candidateInputPixel.x = wIn;
 								if (neighbourhoodMinimalDistance <= goodEnoughDistance) {
+									stats.goodEnoughHits++;
+									stats.rejectedByEarlyExit += inputDimension.size() - (hIn * inputDimension.width + wIn + 1);
 									hIn = inputDimension.height;
 									break;
 								}
 							}
 						}
 					}
-					outputRefImage.At(wOut, hOut) = candidateInputPixel.y * inputDimension.width + candidateInputPixel.x;
+					StoreRelaxed(outputRefImage.At(wOut, hOut), candidateInputPixel.y * inputDimension.width + candidateInputPixel.x);
 				} else if (generationMode == GenerationMode::K_COHERENCE) {
 					float minDistance = FLT_MAX;
 					Coordinate bestInputMatch;
@@ -267,17 +737,20 @@ public:
 								break;
 							}
 							int inputNeighbourOffset = outputRefImage.At(
-								TileizeValue(hOut + hOutBlock, outputDimension.height),
-								TileizeValue(wOut + wOutBlock, outputDimension.width)
+								TileizeValue(wOut + wOutBlock, outputDimension.width),
+								TileizeValue(hOut + hOutBlock, outputDimension.height)
 							);
 							// get the pixelID of the current output reference
-							if (inputImageIDs[inputNeighbourOffset] != UNSET_PIXEL_VALUE) {
-								int pixelID = inputImageIDs[inputNeighbourOffset];
-								for (const int similarOffset : inputSimilarIDs[pixelID]) {
+							if (map->inputImageIDs[inputNeighbourOffset] != UNSET_PIXEL_VALUE) {
+								int pixelID = map->inputImageIDs[inputNeighbourOffset];
+								stats.similarListsScanned++;
+								stats.similarListEntries += map->inputSimilarIDs[pixelID].size();
+								for (const int similarOffset : map->inputSimilarIDs[pixelID]) {
 									const Coordinate inputOffsetCoord = OffsetToCoordinate(similarOffset, inputDimension);
 									float neighbourhoodDistance = GetBlockDistance<ValueDistanceMode::INPUT_OUTPUT>(
 										inputOffsetCoord,
-										outputPixelCoord
+										outputPixelCoord,
+										stats
 									);
 									if (neighbourhoodDistance < minDistance) {
 										minDistance = neighbourhoodDistance;
@@ -288,149 +761,786 @@ public:
 							}
 						}
 					}
-					outputRefImage.At(wOut, hOut) = bestInputMatch.y * inputDimension.width + bestInputMatch.x;
+					StoreRelaxed(outputRefImage.At(wOut, hOut), bestInputMatch.y * inputDimension.width + bestInputMatch.x);
 				}
 			}
-			callback(float(hOut) / float(outputDimension.height), "filling output image");
+			progress.Advance(ProgressEvent::PIXEL_SYNTHESIS, uint64_t(hOut + 1));
 		}
+		progress.EndPhase();
 	}
 
-	void Generate(ProgressCallbackType callback) {
+	GenerationResult Generate(
+		ProgressCallbackType progressCallback,
+		const CancellationToken& cancellationToken = CancellationToken::None()
+	) {
+		PROFILE_SCOPE("generate");
+		ProgressReporter progress{TRACE_PROGRESS(progressCallback)};
+		cancellation = &cancellationToken;
+		generationStatus = COMPLETED;
 
-		if (generationMode == PATCH_BASED) {
-			GeneratePatchBased(callback);
+		SynthesisStats stats;
+		if (generationMode == PATCH_BASED || generationMode == PATCH_GRAPH_CUT) {
+			stats = GeneratePatchBased(progress);
 		} else {
 
 			// fill up the output image with noise from input image
-			callback(0, "fill reference output with noise");
+			progress.BeginPhase(ProgressEvent::NOISE_FILL, 1);
 			FillReferenceOutputWithNoise();
+			progress.EndPhase();
+
+			// create coherence map out of the input pixels (unless a bundle provided it)
+			if (generationMode == GenerationMode::K_COHERENCE && coherenceMap == nullptr) {
+				BuildCoherenceMap(progress, stats);
+			}
+			if (coherenceMap) {
+				for (const std::vector<int>& similarIDs : coherenceMap->inputSimilarIDs) {
+					stats.coherenceClusters += similarIDs.empty() ? 0 : 1;
+				}
+			}
 
-			// create coherence map out of the input pixels
-			if (generationMode == GenerationMode::K_COHERENCE) {
-				callback(0, "loading coherence map");
-				BuildCoherenceMap(callback);
+			if (StopRequested() == false) {
+				SynthesiseTexture(progress, stats);
 			}
+		}
+		cancellation = &CancellationToken::None();
+		return GenerationResult{GenerationStatus(generationStatus.load()), stats};
+	}
+
+	// Builds the exemplar analysis Generate() needs in this generation mode, unless it is there already;
+	// for synthesisers sharing it (see ExemplarAnalysis), so that it is built once, ahead of them.
+	// A stopped call keeps nothing of what it was building.
+	GenerationStatus Analyse(
+		ProgressCallbackType progressCallback,
+		const CancellationToken& cancellationToken = CancellationToken::None()
+	) {
+		PROFILE_SCOPE("analyse");
+		ProgressReporter progress{TRACE_PROGRESS(progressCallback)};
+		cancellation = &cancellationToken;
+		generationStatus = COMPLETED;
 
-			SynthesiseTexture(callback);
+		if (generationMode == K_COHERENCE && coherenceMap == nullptr) {
+			SynthesisStats stats;
+			BuildCoherenceMap(progress, stats);
 		}
+		if ((generationMode == PATCH_BASED || generationMode == PATCH_GRAPH_CUT) &&
+			overlapMatching == nullptr &&
+			StopRequested() == false
+		) {
+			PROFILE_SCOPE("overlap matching setup");
+			progress.BeginPhase(ProgressEvent::OVERLAP_MATCHING_SETUP, 1);
+			PrepareOverlapMatching();
+			progress.EndPhase();
+		}
+		cancellation = &CancellationToken::None();
+		return GenerationStatus(generationStatus.load());
 	}
 
-	void GeneratePatchBased(ProgressCallbackType callback) {
+	SynthesisStats GeneratePatchBased(ProgressReporter& progress) {
 		/*
-		Megolds menete:
-			Vltozk: patch mrete, tkzzna mrete
-			Lerakunk egy random patch-et
-			Amg van res rsz az outputon
-				Lerakunk egy random patch-et
-				Amg van a patch-nek feldolgozatlan tkzznja
-					Minden sorra/oszlopra megnzzk, hogy honnantl kne belevgni
-					Azaz az adott pixel s 1D krnyezete mennyire tr el az output-tl az adott helyen
-
+			Image quilting (Efros & Freeman):
+				the output is covered with a grid of patches overlapping their left and top neighbours,
+				placed in scanline order
+				every patch is one of the input blocks whose overlap error is within tolerance of the best one
+				the seam through the overlap is the minimum error path found with dynamic programming
+				(top to bottom through the left overlap, left to right through the top overlap)
+			PATCH_GRAPH_CUT (Kwatra et al., Graphcut Textures) cuts the seams with max-flow / min-cut instead:
+				the seam may take any shape through whatever the patch overlaps, and the old seams it crosses
+				are accounted for, so refinement patches placed over the patch corners can re-cut them
+			The patches are placed in parallel by PlacePatches(), the result is the same as in scanline order.
 		*/
-		// fill output (to see unfilled pixels)
-		for (int hOut = 0; hOut < outputDimension.height; hOut++) {
-			for (int wOut = 0; wOut < outputDimension.width; wOut++) {
-				outputRefImage.Data().push_back(0);
+		ClearOutputReferences();
+
+		// init
+		const int patchSize = mymin(PATCH_SIZE, mymin(inputDimension.width, inputDimension.height));
+		const int overlapSize = patchSize * PATCH_OVERLAP / PATCH_SIZE;
+		AssertRT(patchSize - overlapSize > 0);
+		if (overlapMatching == nullptr) {
+			PROFILE_SCOPE("overlap matching setup");
+			progress.BeginPhase(ProgressEvent::OVERLAP_MATCHING_SETUP, 1);
+			PrepareOverlapMatching();
+			progress.EndPhase();
+		}
+
+		std::vector<PatchPlacement> placements;
+		AddGridPlacements(patchSize, overlapSize, generationMode == PATCH_GRAPH_CUT, placements);
+		const int gridPatchCount = int(placements.size());
+		if (generationMode == PATCH_GRAPH_CUT) {
+			AddSeamRefinements(patchSize, overlapSize, placements);
+		}
+
+		// the patches finish out of order, the counts only split the two phases roughly
+		const int refinementCount = int(placements.size()) - gridPatchCount;
+		progress.BeginPhase(ProgressEvent::PATCH_QUILTING, uint64_t(gridPatchCount));
+		const SynthesisStats stats = PlacePatches(placements, randomSeed, [&](int placedCount){
+			if (placedCount <= gridPatchCount) {
+				progress.Advance(ProgressEvent::PATCH_QUILTING, uint64_t(placedCount));
+				if (placedCount == gridPatchCount && refinementCount > 0) {
+					progress.EndPhase();
+					progress.BeginPhase(ProgressEvent::SEAM_REFINEMENT, uint64_t(refinementCount));
+				}
+			} else {
+				progress.Advance(ProgressEvent::SEAM_REFINEMENT, uint64_t(placedCount - gridPatchCount));
 			}
+		});
+		if (generationStatus.load() != COMPLETED) {
+			FillUnplacedWithTiledInput();
+		} else {
+			progress.EndPhase();
 		}
-		AssertRT(outputRefImage.Data().size() == outputDimension.size());
+		return stats;
+	}
 
-		// init
-		const int patchSize = 40;
-		AssertRT(patchSize < inputDimension.width);
-		AssertRT(patchSize < inputDimension.height);
-		const int borderSize = 10;
-		AssertRT(borderSize < patchSize);
-		RandomGenerator randomWidth{0.0, double(inputDimension.width - patchSize)};
-		RandomGenerator randomHeight{0.0, double(inputDimension.height - patchSize)};
-		// place first patch
-		{
-			const int randomOffsetWidth = int(randomWidth());
-			const int randomOffsetHeight = int(randomHeight());
-			for (int h = 0; h < patchSize; ++h) {
-				for (int w = 0; w < patchSize; ++w) {
-					const int rWidth = randomOffsetWidth + w;
-					const int rHeight = randomOffsetHeight + h;
-					outputRefImage.At(h * outputDimension.width + w) = rHeight * inputDimension.width + rWidth;
+	/*
+		Anytime synthesis, for when the latency matters more than the last bit of quality: the output is whole
+		from the start and gets better for as long as the budget lasts, so whenever it stops it can be shown.
+			random patches: the quilting grid covered with random exemplar blocks, nothing matched
+			quilting: the PATCH_BASED pass over them, each patch replacing a random one
+			refinement: rounds of PATCH_GRAPH_CUT refinement patches over the patch corners, each round
+				drawing new candidates, until the budget or ANYTIME_REFINEMENT_ROUNDS runs out
+		The generation mode does not matter. The budget running out is reported as BUDGET_SPENT; the token
+		still stops the call like it stops Generate().
+	*/
+	GenerationResult GenerateWithinBudget(
+		ProgressCallbackType progressCallback,
+		double budgetSeconds,
+		const CancellationToken& cancellationToken = CancellationToken::None()
+	) {
+		PROFILE_SCOPE("generate within budget");
+		ProgressReporter progress{TRACE_PROGRESS(progressCallback)};
+		CancellationToken budgetToken;
+		budgetToken.SetTimeout(budgetSeconds);
+		cancellation = &cancellationToken;
+		budget = &budgetToken;
+		generationStatus = COMPLETED;
+
+		const int patchSize = mymin(PATCH_SIZE, mymin(inputDimension.width, inputDimension.height));
+		const int overlapSize = patchSize * PATCH_OVERLAP / PATCH_SIZE;
+		AssertRT(patchSize - overlapSize > 0);
+		std::vector<PatchPlacement> placements;
+		AddGridPlacements(patchSize, overlapSize, false, placements);
+		progress.BeginPhase(ProgressEvent::RANDOM_PATCHES, 1);
+		PlaceRandomPatches(placements);
+		progress.EndPhase();
+
+		if (overlapMatching == nullptr && StopRequested() == false) {
+			PROFILE_SCOPE("overlap matching setup");
+			progress.BeginPhase(ProgressEvent::OVERLAP_MATCHING_SETUP, 1);
+			PrepareOverlapMatching();
+			progress.EndPhase();
+		}
+
+		GenerationResult result{COMPLETED, SynthesisStats{}};
+		auto placePass = [&](ProgressEvent::Phase phase, unsigned int seed){
+			progress.BeginPhase(phase, uint64_t(placements.size()));
+			result.stats += PlacePatches(placements, seed, [&](int placedCount){
+				progress.Advance(phase, uint64_t(placedCount));
+			});
+			if (generationStatus.load() == COMPLETED) {
+				progress.EndPhase();
+				result.passesCompleted++;
+			}
+		};
+		if (StopRequested() == false) {
+			placePass(ProgressEvent::PATCH_QUILTING, randomSeed);
+		}
+		placements.clear();
+		AddSeamRefinements(patchSize, overlapSize, placements);
+		for (int round = 1; round <= ANYTIME_REFINEMENT_ROUNDS && placements.empty() == false; ++round) {
+			if (StopRequested()) {
+				break;
+			}
+			placePass(ProgressEvent::SEAM_REFINEMENT, randomSeed + unsigned(round) * 0x85EBCA6Bu);
+		}
+
+		cancellation = &CancellationToken::None();
+		budget = &CancellationToken::None();
+		result.status = GenerationStatus(generationStatus.load());
+		return result;
+	}
+
+	// the cheapest whole output: every grid patch a random exemplar block, later ones over earlier ones
+	void PlaceRandomPatches(const std::vector<PatchPlacement>& placements){
+		RandomGenerator randomUnit{0.0, 1.0, randomSeed};
+		for (const PatchPlacement& placement : placements) {
+			const int candidateWidth = inputDimension.width - placement.patchDimension.width + 1;
+			const int candidateHeight = inputDimension.height - placement.patchDimension.height + 1;
+			const int inputX = mymin(int(randomUnit() * candidateWidth), candidateWidth - 1);
+			const int inputY = mymin(int(randomUnit() * candidateHeight), candidateHeight - 1);
+			for (int h = 0; h < placement.patchDimension.height; ++h) {
+				int* outputRow = &outputRefImage.Data()[(placement.outputCoord.y + h) * outputDimension.width + placement.outputCoord.x];
+				const int inputOffset = (inputY + h) * inputDimension.width + inputX;
+				for (int w = 0; w < placement.patchDimension.width; ++w) {
+					StoreRelaxed(outputRow[w], inputOffset + w);
+				}
+			}
+		}
+	}
+
+	// in place, a preview may be reading the references meanwhile
+	void ClearOutputReferences(){
+		for (int& reference : outputRefImage.Data()) {
+			StoreRelaxed(reference, UNSET_PIXEL_VALUE);
+		}
+	}
+
+	void FillUnplacedWithTiledInput(){
+		for (int hOut = 0; hOut < outputDimension.height; ++hOut) {
+			for (int wOut = 0; wOut < outputDimension.width; ++wOut) {
+				int& inputOffset = outputRefImage.At(wOut, hOut);
+				if (inputOffset == UNSET_PIXEL_VALUE) {
+					StoreRelaxed(inputOffset, (hOut % inputDimension.height) * inputDimension.width + wOut % inputDimension.width);
+				}
+			}
+		}
+	}
+
+	// the quilting grid: patches overlapping their left and top neighbours, in scanline order
+	void AddGridPlacements(int patchSize, int overlapSize, bool graphCut, std::vector<PatchPlacement>& placements){
+		const int patchStep = patchSize - overlapSize;
+		for (int hOut = 0; hOut < outputDimension.height; hOut += patchStep) {
+			for (int wOut = 0; wOut < outputDimension.width; wOut += patchStep) {
+				placements.push_back(PatchPlacement{
+					Coordinate{wOut, hOut},
+					Dimension{
+						mymin(patchSize, outputDimension.width - wOut),
+						mymin(patchSize, outputDimension.height - hOut)
+					},
+					(wOut > 0) ? overlapSize : 0,
+					(hOut > 0) ? overlapSize : 0,
+					0,
+					graphCut
+				});
+				if (wOut + patchSize >= outputDimension.width) {
+					break;
+				}
+			}
+			if (hOut + patchSize >= outputDimension.height) {
+				break;
+			}
+		}
+	}
+
+	// Refinement patches are centred on the corners where four grid patches meet, the seams are the
+	// most visible there. They are matched against everything they cover and only their rim may keep
+	// the old pixels, so the cut runs through the old seams near the corner.
+	void AddSeamRefinements(int patchSize, int overlapSize, std::vector<PatchPlacement>& placements){
+		const int patchStep = patchSize - overlapSize;
+		const Dimension patchDimension{
+			mymin(patchSize, outputDimension.width),
+			mymin(patchSize, outputDimension.height)
+		};
+		const int cornerColumns = mymax((outputDimension.width - overlapSize / 2 - 1) / patchStep, 0);
+		const int cornerRows = mymax((outputDimension.height - overlapSize / 2 - 1) / patchStep, 0);
+		for (int pass = 0; pass < SEAM_REFINEMENT_PASSES; ++pass) {
+			for (int row = 1; row <= cornerRows; ++row) {
+				for (int column = 1; column <= cornerColumns; ++column) {
+					placements.push_back(PatchPlacement{
+						Coordinate{
+							Clamp(column * patchStep + overlapSize / 2 - patchDimension.width / 2,
+								0, outputDimension.width - patchDimension.width),
+							Clamp(row * patchStep + overlapSize / 2 - patchDimension.height / 2,
+								0, outputDimension.height - patchDimension.height)
+						},
+						patchDimension,
+						patchDimension.width,
+						patchDimension.height,
+						overlapSize,
+						true
+					});
 				}
 			}
 		}
-		// place second patch
+	}
+
+	/*
+		Places the patches as if one by one in the given order, on workerCount threads.
+		A patch reads and writes its own rectangle and the pixels right around it, so it only has to wait
+		for the earlier patches whose rectangles (grown by a pixel) touch its own; the last patch that touched
+		a pixel is tracked per pixel, and waiting for it covers the ones before it. On the quilting grid
+		patch (r, c) waits for (r, c-1), (r-1, c) and (r-1, c+1): the patches on every anti-diagonal
+		2r + c = const are placed together.
+		Workers take the patches in order and every patch draws from its own generator seeded from
+		seed and its index, so the output does not depend on the number of workers or the timing.
+	*/
+	template <typename OnPlaced>
+	SynthesisStats PlacePatches(const std::vector<PatchPlacement>& placements, unsigned int seed, const OnPlaced& onPlaced){
+		const int patchCount = int(placements.size());
+
+		std::vector<int> dependencyStart(patchCount + 1, 0);
+		std::vector<int> dependencies;
 		{
-			for (int i = 1; i < outputDimension.width / (patchSize - borderSize); ++i) {
-				const int randomOffsetWidth = int(randomWidth());
-				const int randomOffsetHeight = int(randomHeight());
-				const int widthFrom = i * (patchSize - borderSize);
-				std::vector<int> outputRefs;
-				std::vector<int> inputRefs;
-				for (int h = 0; h < patchSize; ++h) {
-					for (int w = widthFrom; w < widthFrom + patchSize; ++w) {
-						const int rWidth = randomOffsetWidth + w - widthFrom;
-						const int rHeight = randomOffsetHeight + h;
-						AssertRT(rWidth < inputDimension.width);
-						AssertRT(rHeight < inputDimension.height);
-						const int outputOffset = h * outputDimension.width + w;
-						const int inputOffset = rHeight * inputDimension.width + rWidth;
-						if ((w-widthFrom) < borderSize) {
-							outputRefs.push_back(outputOffset);
-							inputRefs.push_back(inputOffset);
-						} else {
-							outputRefImage.At(outputOffset) = inputOffset;
+			std::vector<int> lastPatch(outputDimension.size(), -1);
+			for (int patch = 0; patch < patchCount; ++patch) {
+				const PatchPlacement& placement = placements[patch];
+				const int left = mymax(placement.outputCoord.x - 1, 0);
+				const int top = mymax(placement.outputCoord.y - 1, 0);
+				const int right = mymin(placement.outputCoord.x + placement.patchDimension.width + 1, outputDimension.width);
+				const int bottom = mymin(placement.outputCoord.y + placement.patchDimension.height + 1, outputDimension.height);
+				const int first = int(dependencies.size());
+				for (int h = top; h < bottom; ++h) {
+					int* lastRow = &lastPatch[h * outputDimension.width];
+					for (int w = left; w < right; ++w) {
+						if (lastRow[w] != -1 && (w == left || lastRow[w] != lastRow[w - 1])) {
+							dependencies.push_back(lastRow[w]);
 						}
+						lastRow[w] = patch;
 					}
 				}
-				AssertRT(outputRefs.size() == inputRefs.size());
-				AssertRT(outputRefs.size() == patchSize*borderSize);
-				for (int h = 0; h < patchSize; ++h) {
-					int minOffset;
-					float minValue = FLT_MAX;
-					for (int w = 0; w < borderSize; ++w) {
-						const int outputRef = outputRefs[h*borderSize + w];
-						const int inputRef = inputRefs[h*borderSize + w];
-						const Pixel& inputColor = inputImage.At(inputRef);
-						const Pixel& outputColor = inputImage.At(outputRefImage.At(outputRef));
-						float dist = GetColorDistanceSquared(inputColor, outputColor);
-						if (dist < minValue) {
-							minValue = dist;
-							minOffset = w;
-						}
+				std::sort(dependencies.begin() + first, dependencies.end());
+				dependencies.erase(std::unique(dependencies.begin() + first, dependencies.end()), dependencies.end());
+				dependencyStart[patch + 1] = int(dependencies.size());
+			}
+		}
+
+		std::vector<std::atomic<bool>> placed(patchCount);
+		std::atomic<int> nextPatch(0);
+		std::atomic<int> placedCount(0);
+		const int threadCount = mymax(mymin(workerCount, patchCount), 1);
+		std::vector<SynthesisStats> workerStats(threadCount);
+		auto worker = [&](int workerIndex){
+			QuiltWorkspace workspace;
+			for (int patch = nextPatch++; patch < patchCount; patch = nextPatch++) {
+				// every dependency was taken by a worker before this patch, so this cannot deadlock;
+				// unless the call is stopped, then the worker that took it may give up on it, and so does this one
+				bool ready = StopRequested() == false;
+				for (int dependency = dependencyStart[patch]; ready && dependency < dependencyStart[patch + 1]; ++dependency) {
+					while (ready && placed[dependencies[dependency]].load(std::memory_order_acquire) == false) {
+						std::this_thread::yield();
+						ready = StopRequested() == false;
 					}
-					for (int w = minOffset; w < borderSize; ++w) {
-						const int outputRef = outputRefs[h*borderSize + w];
-						const int inputRef = inputRefs[h*borderSize + w];
-						/*if (w == minOffset) {
-							outputRefImage.At(outputRef) = -1;
-						} else */{
-							outputRefImage.At(outputRef) = inputRef;
-						}
+				}
+				if (ready == false) {
+					break;
+				}
+				PROFILE_SCOPE("patch placement");
+				const PatchPlacement& placement = placements[patch];
+				RandomGenerator randomUnit{0.0, 1.0, seed + unsigned(patch) * 2654435761u};
+				Coordinate inputCoord;
+				{
+					PROFILE_SCOPE("candidate search");
+					inputCoord = FindPatchCandidate(
+						placement.outputCoord, placement.patchDimension,
+						placement.leftOverlap, placement.topOverlap, randomUnit, workspace
+					);
+				}
+				PROFILE_SCOPE("seam cut");
+				if (placement.graphCut) {
+					PlacePatchGraphCut(inputCoord, placement.outputCoord, placement.patchDimension, placement.newInset, workspace);
+				} else {
+					PlacePatch(
+						inputCoord, placement.outputCoord, placement.patchDimension,
+						placement.leftOverlap, placement.topOverlap, workspace
+					);
+				}
+				workspace.stats.patchesPlaced++;
+				placed[patch].store(true, std::memory_order_release);
+				// called on every worker, every count exactly once
+				onPlaced(++placedCount);
+			}
+			workerStats[workerIndex] = workspace.stats;
+		};
+
+		std::vector<std::thread> threads;
+		for (int i = 1; i < threadCount; ++i) {
+			threads.push_back(std::thread(worker, i));
+		}
+		worker(0);
+		for (std::thread& thread : threads) {
+			thread.join();
+		}
+		SynthesisStats stats;
+		for (const SynthesisStats& oneWorkerStats : workerStats) {
+			stats += oneWorkerStats;
+		}
+		return stats;
+	}
+
+	// The overlap error of the block at c is
+	//	SSD(c) = sum |I(c+p)|^2 - 2 sum I(c+p).O(p) + sum |O(p)|^2
+	// over the overlap pixels p. The first sum is two rectangles of the summed area table, the middle one
+	// is the cross-correlation of the input with the overlap, done for every c at once in the frequency domain.
+	// Red and green share one complex transform: the real part of the correlation of r + i*g with
+	// r' + i*g' is exactly the red plus the green correlation.
+	void PrepareOverlapMatching(){
+		const std::shared_ptr<OverlapMatching> matching = std::make_shared<OverlapMatching>();
+		FFT2D& overlapFFT = matching->overlapFFT;
+		std::vector<Complex>* inputSpectra = matching->inputSpectra;
+		std::vector<double>& inputEnergyTable = matching->inputEnergyTable;
+		const Dimension fftDimension{NextPowerOf2(inputDimension.width), NextPowerOf2(inputDimension.height)};
+		overlapFFT = FFT2D{fftDimension};
+		inputSpectra[0].assign(fftDimension.size(), Complex{});
+		inputSpectra[1].assign(fftDimension.size(), Complex{});
+		for (int h = 0; h < inputDimension.height; ++h) {
+			for (int w = 0; w < inputDimension.width; ++w) {
+				const Pixel& pixel = inputImage->Data()[h * inputDimension.width + w];
+				inputSpectra[0][h * fftDimension.width + w] = Complex(pixel.r, pixel.g);
+				inputSpectra[1][h * fftDimension.width + w] = Complex(pixel.b, 0.f);
+			}
+		}
+		overlapFFT.Forward(inputSpectra[0]);
+		overlapFFT.Forward(inputSpectra[1]);
+
+		const int tableWidth = inputDimension.width + 1;
+		matching->tableWidth = tableWidth;
+		inputEnergyTable.assign(tableWidth * (inputDimension.height + 1), 0.0);
+		for (int h = 0; h < inputDimension.height; ++h) {
+			double rowEnergy = 0.0;
+			for (int w = 0; w < inputDimension.width; ++w) {
+				const Pixel& pixel = inputImage->Data()[h * inputDimension.width + w];
+				rowEnergy += pixel.r * pixel.r + pixel.g * pixel.g + pixel.b * pixel.b;
+				inputEnergyTable[(h + 1) * tableWidth + w + 1] = inputEnergyTable[h * tableWidth + w + 1] + rowEnergy;
+			}
+		}
+		std::atomic_store(&overlapMatching, std::shared_ptr<const OverlapMatching>{matching});
+	}
+
+	Coordinate FindPatchCandidate(
+		const Coordinate& outputCoord,
+		const Dimension& patchDimension,
+		int leftOverlap,
+		int topOverlap,
+		RandomGenerator& randomUnit,
+		QuiltWorkspace& workspace
+	){
+		const Dimension candidateDimension{
+			inputDimension.width - patchDimension.width + 1,
+			inputDimension.height - patchDimension.height + 1
+		};
+		const int candidateCount = candidateDimension.size();
+
+		// the very first patch has nothing to match
+		if (leftOverlap == 0 && topOverlap == 0) {
+			const int candidate = mymin(int(randomUnit() * candidateCount), candidateCount - 1);
+			return OffsetToCoordinate(candidate, candidateDimension);
+		}
+
+		// the output under the overlap, also kept for cutting the seams once a block is chosen
+		workspace.overlapPixels.resize(patchDimension.size());
+		double overlapEnergy = 0.0;
+		for (int h = 0; h < patchDimension.height; ++h) {
+			const int overlapWidth = (h < topOverlap) ? patchDimension.width : leftOverlap;
+			const int* outputRow = &outputRefImage.Data()[(outputCoord.y + h) * outputDimension.width + outputCoord.x];
+			for (int w = 0; w < overlapWidth; ++w) {
+				const Pixel& pixel = inputImage->At(outputRow[w]);
+				workspace.overlapPixels[h * patchDimension.width + w] = pixel;
+				overlapEnergy += pixel.r * pixel.r + pixel.g * pixel.g + pixel.b * pixel.b;
+			}
+		}
+
+		// cross-correlation, summed over the colour components in the frequency domain
+		const OverlapMatching& matching = *overlapMatching;
+		const Dimension& fftDimension = matching.overlapFFT.GetDimension();
+		workspace.correlation.assign(fftDimension.size(), Complex{});
+		for (int spectrum = 0; spectrum < 2; ++spectrum) {
+			workspace.overlapSpectrum.assign(fftDimension.size(), Complex{});
+			for (int h = 0; h < patchDimension.height; ++h) {
+				const int overlapWidth = (h < topOverlap) ? patchDimension.width : leftOverlap;
+				for (int w = 0; w < overlapWidth; ++w) {
+					const Pixel& pixel = workspace.overlapPixels[h * patchDimension.width + w];
+					workspace.overlapSpectrum[h * fftDimension.width + w] =
+						(spectrum == 0) ? Complex(pixel.r, pixel.g) : Complex(pixel.b, 0.f);
+				}
+			}
+			matching.overlapFFT.Forward(workspace.overlapSpectrum, patchDimension.height);
+			const std::vector<Complex>& inputSpectrum = matching.inputSpectra[spectrum];
+			for (int i = 0; i < fftDimension.size(); ++i) {
+				workspace.correlation[i] += MultiplyConjugate(inputSpectrum[i], workspace.overlapSpectrum[i]);
+			}
+		}
+		matching.overlapFFT.Inverse(workspace.correlation, candidateDimension.height);
+
+		// the overlap is the top rows across the whole patch plus the left columns below them
+		workspace.candidateErrors.resize(candidateCount);
+		float minError = FLT_MAX;
+		for (int hIn = 0; hIn < candidateDimension.height; ++hIn) {
+			for (int wIn = 0; wIn < candidateDimension.width; ++wIn) {
+				const double inputEnergy =
+					matching.GetInputEnergy(wIn, hIn, patchDimension.width, topOverlap) +
+					matching.GetInputEnergy(wIn, hIn + topOverlap, leftOverlap, patchDimension.height - topOverlap);
+				const double crossTerm = workspace.correlation[hIn * fftDimension.width + wIn].real();
+				const float error = float(mymax(inputEnergy - 2.0 * crossTerm + overlapEnergy, 0.0));
+				workspace.candidateErrors[hIn * candidateDimension.width + wIn] = error;
+				minError = mymin(minError, error);
+			}
+		}
+
+		const float acceptedError =
+			minError * (1.f + PATCH_ERROR_TOLERANCE) + float(overlapEnergy) * PATCH_ERROR_ROUNDOFF;
+		int acceptedCount = 0;
+		for (const float error : workspace.candidateErrors) {
+			acceptedCount += (error <= acceptedError) ? 1 : 0;
+		}
+		workspace.stats.distanceEvaluations += candidateCount;
+		workspace.stats.candidatesWithinTolerance += acceptedCount;
+		int chosen = mymin(int(randomUnit() * acceptedCount), acceptedCount - 1);
+		for (int candidate = 0; candidate < candidateCount; ++candidate) {
+			if (workspace.candidateErrors[candidate] <= acceptedError && chosen-- == 0) {
+				return OffsetToCoordinate(candidate, candidateDimension);
+			}
+		}
+		AssertRT(false);
+		return Coordinate{};
+	}
+
+	// Minimum error path across an overlap strip by dynamic programming. The path takes one step along
+	// the strip per entry of cut and moves at most one pixel sideways per step; cut[i] is its position
+	// across the strip at step i. errors are addressed as errors[i * alongStride + j * acrossStride].
+	static void FindMinimumErrorCut(
+		const float* errors,
+		int alongStride,
+		int acrossStride,
+		int length,
+		int breadth,
+		std::vector<float>& costs,
+		std::vector<int>& cut
+	){
+		cut.assign(length, 0);
+		if (breadth == 0) {
+			return;
+		}
+		costs.resize(length * breadth);
+		for (int i = 0; i < length; ++i) {
+			float* costRow = &costs[i * breadth];
+			const float* previousRow = costRow - breadth;
+			for (int j = 0; j < breadth; ++j) {
+				float cost = errors[i * alongStride + j * acrossStride];
+				if (i > 0) {
+					float previousCost = previousRow[j];
+					if (j > 0) {
+						previousCost = mymin(previousCost, previousRow[j - 1]);
 					}
-					std::cout << std::endl;
+					if (j + 1 < breadth) {
+						previousCost = mymin(previousCost, previousRow[j + 1]);
+					}
+					cost += previousCost;
 				}
+				costRow[j] = cost;
+			}
+		}
+		const float* lastRow = &costs[(length - 1) * breadth];
+		int j = int(std::min_element(lastRow, lastRow + breadth) - lastRow);
+		for (int i = length - 1; i >= 0; --i) {
+			cut[i] = j;
+			if (i > 0) {
+				const float* previousRow = &costs[(i - 1) * breadth];
+				const int from = mymax(j - 1, 0);
+				const int to = mymin(j + 2, breadth);
+				j = int(std::min_element(previousRow + from, previousRow + to) - previousRow);
 			}
 		}
 	}
 
-	void SaveToFile(std::string outputImagePath){
-		std::vector<unsigned char> outputImageBuffer;
+	void PlacePatch(
+		const Coordinate& inputCoord,
+		const Coordinate& outputCoord,
+		const Dimension& patchDimension,
+		int leftOverlap,
+		int topOverlap,
+		QuiltWorkspace& workspace
+	){
+		// per pixel error of the chosen block over the overlap, the seams are cut through it
+		workspace.overlapErrors.resize(patchDimension.size());
+		for (int h = 0; h < patchDimension.height; ++h) {
+			const int overlapWidth = (h < topOverlap) ? patchDimension.width : leftOverlap;
+			const Pixel* inputRow = &inputImage->Data()[(inputCoord.y + h) * inputDimension.width + inputCoord.x];
+			for (int w = 0; w < overlapWidth; ++w) {
+				const int patchOffset = h * patchDimension.width + w;
+				workspace.overlapErrors[patchOffset] = GetColorDistanceSquared(
+					inputRow[w], workspace.overlapPixels[patchOffset]
+				);
+			}
+		}
+		FindMinimumErrorCut(
+			workspace.overlapErrors.data(), patchDimension.width, 1,
+			patchDimension.height, mymin(leftOverlap, patchDimension.width),
+			workspace.cutCosts, workspace.verticalCut
+		);
+		FindMinimumErrorCut(
+			workspace.overlapErrors.data(), 1, patchDimension.width,
+			patchDimension.width, mymin(topOverlap, patchDimension.height),
+			workspace.cutCosts, workspace.horizontalCut
+		);
+
+		// a pixel comes from the new block if it is past both seams
+		for (int h = 0; h < patchDimension.height; ++h) {
+			int* outputRow = &outputRefImage.Data()[(outputCoord.y + h) * outputDimension.width + outputCoord.x];
+			const int inputOffset = (inputCoord.y + h) * inputDimension.width + inputCoord.x;
+			for (int w = 0; w < patchDimension.width; ++w) {
+				if (w >= workspace.verticalCut[h] && h >= workspace.horizontalCut[w]) {
+					StoreRelaxed(outputRow[w], inputOffset + w);
+				}
+			}
+		}
+	}
+
+	// the input offset dx, dy away from inputOffset, as if the block it came from went on past the pixel
+	int ContinueInputOffset(int inputOffset, int dx, int dy) const {
+		const Coordinate inputCoord = OffsetToCoordinate(inputOffset, inputDimension);
+		return
+			Clamp(inputCoord.y + dy, 0, inputDimension.height - 1) * inputDimension.width +
+			Clamp(inputCoord.x + dx, 0, inputDimension.width - 1);
+	}
+
+	// seam cost between neighbours s and t, s taken from the input at a and t at b
+	// (the matching cost of Graphcut Textures: ||A(s) - B(s)|| + ||A(t) - B(t)||)
+	float GetSeamCost(int aAtS, int aAtT, int bAtS, int bAtT){
+		const std::vector<Pixel>& input = inputImage->Data();
+		return
+			std::sqrt(GetColorDistanceSquared(input[aAtS], input[bAtS])) +
+			std::sqrt(GetColorDistanceSquared(input[aAtT], input[bAtT]));
+	}
+
+	// Edges between neighbouring patch pixels s and t (t is dx, dy from s). The source side of the cut keeps
+	// the old pixels, the sink side takes the new block. If s and t came from different blocks there is an
+	// old seam between them: it gets a node of its own, whose edge to the sink is the old seam cost, paid
+	// only while the old seam survives.
+	void AddSeamEdges(
+		MaxFlowGraph& graph,
+		int nodeS,
+		int nodeT,
+		int outputS,
+		int outputT,
+		int newS,
+		int newT,
+		int dx,
+		int dy
+	){
+		const int oldS = outputRefImage.Data()[outputS];
+		const int oldT = outputRefImage.Data()[outputT];
+		if (oldS == UNSET_PIXEL_VALUE && oldT == UNSET_PIXEL_VALUE) {
+			return;
+		}
+		// an unset pixel always takes the new block, the seam would run between it and the old neighbour
+		if (oldS == UNSET_PIXEL_VALUE || oldT == UNSET_PIXEL_VALUE) {
+			const int oldAtS = (oldS == UNSET_PIXEL_VALUE) ? ContinueInputOffset(oldT, -dx, -dy) : oldS;
+			const int oldAtT = (oldT == UNSET_PIXEL_VALUE) ? ContinueInputOffset(oldS, dx, dy) : oldT;
+			const float cost = GetSeamCost(oldAtS, oldAtT, newS, newT);
+			graph.AddEdge(nodeS, nodeT, cost, cost);
+			return;
+		}
+		const int oldSAtT = ContinueInputOffset(oldS, dx, dy);
+		const float costS = GetSeamCost(oldS, oldSAtT, newS, newT);
+		if (oldSAtT == oldT) {
+			graph.AddEdge(nodeS, nodeT, costS, costS);
+			return;
+		}
+		const int oldTAtS = ContinueInputOffset(oldT, -dx, -dy);
+		const float costT = GetSeamCost(oldTAtS, oldT, newS, newT);
+		const float oldSeamCost = GetSeamCost(oldS, oldSAtT, oldTAtS, oldT);
+		const int seamNode = graph.AddNode();
+		graph.AddEdge(nodeS, seamNode, costS, costS);
+		graph.AddEdge(seamNode, nodeT, costT, costT);
+		graph.AddTerminalWeights(seamNode, 0, oldSeamCost);
+	}
+
+	// newInset > 0 marks a refinement patch: pixels that far inside its border must come from the new block
+	void PlacePatchGraphCut(
+		const Coordinate& inputCoord,
+		const Coordinate& outputCoord,
+		const Dimension& patchDimension,
+		int newInset,
+		QuiltWorkspace& workspace
+	){
+		MaxFlowGraph& graph = workspace.seamGraph;
+		graph.Reset();
+		const std::vector<int>& outputRefs = outputRefImage.Data();
+		const int outputWidth = outputDimension.width;
+		const int outputHeight = outputDimension.height;
+
+		// the pixel nodes, numbered like the patch pixels
+		for (int h = 0; h < patchDimension.height; ++h) {
+			for (int w = 0; w < patchDimension.width; ++w) {
+				const int node = graph.AddNode();
+				const int x = outputCoord.x + w;
+				const int y = outputCoord.y + h;
+				const int outputOffset = y * outputWidth + x;
+				const bool inside =
+					newInset > 0 &&
+					w >= newInset && w < patchDimension.width - newInset &&
+					h >= newInset && h < patchDimension.height - newInset;
+				// on the patch border next to old pixels the old pixels have to stay, or the seam would leak out
+				const bool boundedByOld =
+					(w == 0 && x > 0 && outputRefs[outputOffset - 1] != UNSET_PIXEL_VALUE) ||
+					(w == patchDimension.width - 1 && x + 1 < outputWidth && outputRefs[outputOffset + 1] != UNSET_PIXEL_VALUE) ||
+					(h == 0 && y > 0 && outputRefs[outputOffset - outputWidth] != UNSET_PIXEL_VALUE) ||
+					(h == patchDimension.height - 1 && y + 1 < outputHeight && outputRefs[outputOffset + outputWidth] != UNSET_PIXEL_VALUE);
+				if (outputRefs[outputOffset] == UNSET_PIXEL_VALUE || inside) {
+					graph.AddTerminalWeights(node, 0, SEAM_CONSTRAINT);
+				} else if (boundedByOld) {
+					graph.AddTerminalWeights(node, SEAM_CONSTRAINT, 0);
+				}
+			}
+		}
+
+		for (int h = 0; h < patchDimension.height; ++h) {
+			const int outputOffset = (outputCoord.y + h) * outputWidth + outputCoord.x;
+			const int inputOffset = (inputCoord.y + h) * inputDimension.width + inputCoord.x;
+			for (int w = 0; w < patchDimension.width; ++w) {
+				const int node = h * patchDimension.width + w;
+				if (w + 1 < patchDimension.width) {
+					AddSeamEdges(
+						graph, node, node + 1,
+						outputOffset + w, outputOffset + w + 1,
+						inputOffset + w, inputOffset + w + 1, 1, 0
+					);
+				}
+				if (h + 1 < patchDimension.height) {
+					AddSeamEdges(
+						graph, node, node + patchDimension.width,
+						outputOffset + w, outputOffset + w + outputWidth,
+						inputOffset + w, inputOffset + w + inputDimension.width, 0, 1
+					);
+				}
+			}
+		}
+
+		graph.MaxFlow();
+		workspace.stats.seamGraphNodes += graph.NodeCount();
+		for (int h = 0; h < patchDimension.height; ++h) {
+			int* outputRow = &outputRefImage.Data()[(outputCoord.y + h) * outputWidth + outputCoord.x];
+			const int inputOffset = (inputCoord.y + h) * inputDimension.width + inputCoord.x;
+			for (int w = 0; w < patchDimension.width; ++w) {
+				if (graph.IsSourceSide(h * patchDimension.width + w) == false) {
+					StoreRelaxed(outputRow[w], inputOffset + w);
+				}
+			}
+		}
+	}
+
+	// RGB bytes of the output, for the encoder
+	void PackOutputPixels(std::vector<unsigned char>& outputImageBuffer){
+		outputImageBuffer.clear();
+		outputImageBuffer.reserve(outputRefImage.Data().size() * COLOR_COMPONENTS);
 		std::for_each(
 			outputRefImage.Data().cbegin(),
 			outputRefImage.Data().cend(),
 			[&](const int inputOffset){
 				Pixel pixel{1, 0, 0};
 				/*if (inputOffset != -1) */{
-					pixel = inputImage.At(inputOffset);
+					pixel = inputImage->At(inputOffset);
 				}
 				outputImageBuffer.push_back(unsigned char(pixel.r*255.f));
 				outputImageBuffer.push_back(unsigned char(pixel.g*255.f));
 				outputImageBuffer.push_back(unsigned char(pixel.b*255.f));
 			}
 		);
-		bool resultOfCompression = jpge::compress_image_to_jpeg_file(
+	}
+
+	void SaveToFile(std::string outputImagePath){
+		PROFILE_SCOPE("save");
+		std::vector<unsigned char> outputImageBuffer;
+		{
+			PROFILE_SCOPE("pack");
+			PackOutputPixels(outputImageBuffer);
+		}
+		PROFILE_SCOPE("encode");
+		bool resultOfCompression = jpge::compress_image_to_jpeg_file_parallel(
 			outputImagePath.c_str(),
 			outputDimension.width,
 			outputDimension.height,
 			COLOR_COMPONENTS,
-			outputImageBuffer.data()
+			outputImageBuffer.data(),
+			int(std::thread::hardware_concurrency())
 		);
 	}
 
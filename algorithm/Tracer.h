@@ -0,0 +1,177 @@
+#pragma once
+
+//#define ENABLE_TRACER
+
+/*
+	Timeline tracer, written as trace event JSON for Perfetto (ui.perfetto.dev) or chrome://tracing.
+	TRACE_SCOPE("name") records a begin and an end event around the rest of the enclosing block; every
+	PROFILE_SCOPE zone is traced too, so phases, synthesis rows and patches all show up. TRACE_INSTANT(message,
+	progress) marks a point in time, TRACE_PROGRESS(callback) wraps a progress callback so its events are
+	marked that way, named after their phase. Each thread appends to a buffer of its own without locking, TRACE_WRITE(path) merges them
+	when the work is done. Needs jpeg-compressor/timer.cpp in the build, like the profiler.
+	Without ENABLE_TRACER the macros expand to nothing (TRACE_PROGRESS to the callback itself).
+*/
+
+#ifdef ENABLE_TRACER
+
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "jpeg-compressor/timer.h"
+#include "Progress.h"
+
+class Tracer {
+
+private:
+	struct Event {
+		timer_ticks	ticks;
+		const char*	name;			// literal, or nullptr for a message
+		int			messageIndex;	// into ThreadBuffer::messages
+		float		progress;
+		char		phase;			// 'B'egin, 'E'nd, 'i'nstant
+	};
+
+	struct ThreadBuffer {
+		int							threadIndex;
+		std::vector<Event>			events;
+		std::vector<std::string>	messages;
+	};
+
+	std::mutex							buffersMutex;
+	std::vector<std::unique_ptr<ThreadBuffer>>
+										buffers;	// owned here, they outlive their threads
+
+	Tracer(){
+		timer::init();
+	}
+
+	static Tracer& Instance(){
+		static Tracer tracer;
+		return tracer;
+	}
+
+	static ThreadBuffer& CurrentBuffer(){
+		thread_local ThreadBuffer* buffer = nullptr;
+		if (buffer == nullptr) {
+			Tracer& tracer = Instance();
+			std::lock_guard<std::mutex> lock{tracer.buffersMutex};
+			tracer.buffers.push_back(std::make_unique<ThreadBuffer>());
+			buffer = tracer.buffers.back().get();
+			buffer->threadIndex = int(tracer.buffers.size());
+			buffer->events.reserve(1 << 16);
+		}
+		return *buffer;
+	}
+
+	static void WriteJsonString(std::ostream& stream, const char* text){
+		stream << '"';
+		for (; *text; ++text) {
+			if (*text == '"' || *text == '\\') {
+				stream << '\\' << *text;
+			} else if ((unsigned char)(*text) >= 0x20) {
+				stream << *text;
+			}
+		}
+		stream << '"';
+	}
+
+public:
+	static void Record(const char* name, char phase){
+		CurrentBuffer().events.push_back(Event{timer::get_ticks(), name, -1, 0.f, phase});
+	}
+
+	static void RecordMessage(const std::string& message, float progress){
+		ThreadBuffer& buffer = CurrentBuffer();
+		// progress messages repeat, consecutive ones share the copy
+		if (buffer.messages.empty() || buffer.messages.back() != message) {
+			buffer.messages.push_back(message);
+		}
+		buffer.events.push_back(Event{timer::get_ticks(), nullptr, int(buffer.messages.size()) - 1, progress, 'i'});
+	}
+
+	static bool Write(const std::string& path){
+		Tracer& tracer = Instance();
+		std::ofstream stream{path};
+		stream << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+		bool firstEvent = true;
+		std::lock_guard<std::mutex> lock{tracer.buffersMutex};
+		for (const std::unique_ptr<ThreadBuffer>& buffer : tracer.buffers) {
+			stream << (firstEvent ? "" : ",\n");
+			firstEvent = false;
+			stream << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << buffer->threadIndex
+				<< ", \"args\": {\"name\": \"thread " << buffer->threadIndex << "\"}}";
+			for (const Event& event : buffer->events) {
+				stream << ",\n{\"name\": ";
+				WriteJsonString(stream, event.name ? event.name : buffer->messages[event.messageIndex].c_str());
+				stream << ", \"ph\": \"" << event.phase << "\", \"pid\": 1, \"tid\": " << buffer->threadIndex;
+				stream << ", \"ts\": " << std::fixed << timer::ticks_to_secs(event.ticks) * 1e6;
+				if (event.phase == 'i') {
+					stream << ", \"s\": \"t\", \"args\": {\"progress\": " << event.progress << "}";
+				}
+				stream << "}";
+			}
+		}
+		stream << "\n]}\n";
+		return stream.good();
+	}
+
+	static void Clear(){
+		Tracer& tracer = Instance();
+		std::lock_guard<std::mutex> lock{tracer.buffersMutex};
+		for (const std::unique_ptr<ThreadBuffer>& buffer : tracer.buffers) {
+			buffer->events.clear();
+			buffer->messages.clear();
+		}
+	}
+
+	static ProgressCallback WrapProgress(const ProgressCallback& callback){
+		return [&callback](const ProgressEvent& event){
+			RecordMessage(ProgressEvent::PhaseName(event.phase), event.Fraction());
+			callback(event);
+		};
+	}
+
+};
+
+class ScopedTraceEvent {
+
+private:
+	const char*	name;
+
+public:
+	explicit ScopedTraceEvent(const char* name):
+		name(name)
+	{
+		Tracer::Record(name, 'B');
+	}
+
+	ScopedTraceEvent(const ScopedTraceEvent&) = delete;
+	ScopedTraceEvent& operator=(const ScopedTraceEvent&) = delete;
+
+	~ScopedTraceEvent(){
+		Tracer::Record(name, 'E');
+	}
+
+};
+
+#define TRACE_CONCATENATE_DELAY(a, b) a##b
+#define TRACE_CONCATENATE(a, b) TRACE_CONCATENATE_DELAY(a, b)
+#define TRACE_SCOPE(name) ScopedTraceEvent TRACE_CONCATENATE(traceEvent, __LINE__){name}
+#define TRACE_INSTANT(message, progress) Tracer::RecordMessage(message, progress)
+#define TRACE_PROGRESS(callback) Tracer::WrapProgress(callback)
+#define TRACE_WRITE(path) Tracer::Write(path)
+#define TRACE_CLEAR() Tracer::Clear()
+
+#else // ENABLE_TRACER
+
+#define TRACE_SCOPE(name)
+#define TRACE_INSTANT(message, progress)
+#define TRACE_PROGRESS(callback) (callback)
+#define TRACE_WRITE(path)
+#define TRACE_CLEAR()
+
+#endif // ENABLE_TRACER
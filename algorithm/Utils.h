@@ -1,9 +1,14 @@
 #pragma once
 
+#include <atomic>
 #include <cassert>
 #include <cstdlib>
 #include <cstdio>
 
+#if defined(_MSC_VER) && !defined(__cpp_lib_atomic_ref)
+#include <intrin.h>
+#endif
+
 #pragma warning(push)
 #pragma warning(disable:4996) // for sprintf
 
@@ -97,8 +102,36 @@ T mymin(T first, T second) {
 	return first < second ? first : second;
 }
 
+template <typename T>
+T Clamp(T value, T low, T high) {
+	return mymin(mymax(value, low), high);
+}
+
 inline bool IsPowerOf2(int num) {
 	// SSE instruction for bit count
 	AssertRT(num > 0);
 	return __popcnt(num) == 1;
-}
\ No newline at end of file
+}
+
+// Relaxed atomic access to a plain int that another thread reads or writes meanwhile, where a stale value
+// is fine but a data race is not. std::atomic_ref where the library has it, the same intrinsics before
+// C++20; either way a plain load or store on x86.
+inline int LoadRelaxed(const int& source) {
+#if defined(__cpp_lib_atomic_ref)
+	return std::atomic_ref<int>(const_cast<int&>(source)).load(std::memory_order_relaxed);
+#elif defined(_MSC_VER)
+	return __iso_volatile_load32(reinterpret_cast<const volatile __int32*>(&source));
+#else
+	return __atomic_load_n(&source, __ATOMIC_RELAXED);
+#endif
+}
+
+inline void StoreRelaxed(int& target, int value) {
+#if defined(__cpp_lib_atomic_ref)
+	std::atomic_ref<int>(target).store(value, std::memory_order_relaxed);
+#elif defined(_MSC_VER)
+	__iso_volatile_store32(reinterpret_cast<volatile __int32*>(&target), value);
+#else
+	__atomic_store_n(&target, value, __ATOMIC_RELAXED);
+#endif
+}
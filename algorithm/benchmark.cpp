@@ -0,0 +1,524 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <memory>
+
+#include "TextureSynthesiser.h"
+#include "PerfCounters.h"
+
+#ifdef _WIN32
+#include <Psapi.h>
+#pragma comment(lib, "psapi.lib")
+#endif
+
+/*
+	Sweeps generation mode x output size x neighbour size x exemplar and prints one JSON report,
+	so runs of two builds can be diffed.
+	usage: benchmark [--modes 0,1,2,3] [--sizes 64,128,256] [--radii 2,5] [--exemplars 1.jpg,2.jpg]
+		[--scales 0,1] [--synthetic 64,128] [--repetitions 5] [--seed 1] [--workers n]
+		[--max-work 1e10] [--out report.json]
+	Exemplars are the given files decoded at each --scales shift plus generated ones of each --synthetic size,
+	all copied to a temporary directory first so that no exemplar bundle lying next to them is picked up.
+	Every repetition uses the same seed, so it repeats the same work. Three phases are measured apart: load (the
+	constructor: decode and conversion), generate (Generate()) and save (SaveToFile()); the top level times are
+	the generate phase's. Generate() is split further at the phases of its progress events (coherence build,
+	pixel synthesis, overlap matching setup, quilting, ...) under generatePhases. Each phase also reports
+	hardware counters per output pixel (see PerfCounters.h), averaged over the repetitions, and instructions
+	per cycle; counters that cannot be opened are null.
+	Runs whose estimated work (see EstimateWork()) exceeds --max-work are reported as skipped instead of run,
+	the pixel based modes grow out of hand fast; runs on an exemplar that does not decode are reported as failed.
+*/
+
+namespace {
+
+const char* const MODE_NAMES[] = {"BRUTE_FORCE", "K_COHERENCE", "PATCH_BASED", "PATCH_GRAPH_CUT"};
+constexpr int MODE_COUNT = int(sizeof(MODE_NAMES) / sizeof(MODE_NAMES[0]));
+// in the order of ProgressEvent::Phase
+const char* const SYNTHESIS_PHASE_NAMES[] = {
+	"noiseFill", "coherenceBuild", "pixelSynthesis", "overlapMatchingSetup",
+	"randomPatches", "patchQuilting", "seamRefinement", "bundleWrite"
+};
+constexpr int SYNTHESIS_PHASE_COUNT = int(sizeof(SYNTHESIS_PHASE_NAMES) / sizeof(SYNTHESIS_PHASE_NAMES[0]));
+
+struct BenchmarkOptions {
+	std::vector<int>			modes{0, 1, 2, 3};
+	std::vector<int>			sizes{64, 128, 256};
+	std::vector<int>			radii{2, 5};
+	std::vector<std::string>	exemplars{"1.jpg", "2.jpg"};
+	std::vector<int>			scales{0, 1};
+	std::vector<int>			syntheticSizes{64, 128};
+	int							repetitions = 5;
+	unsigned int				seed = 1;
+	int							workers = mymax(int(std::thread::hardware_concurrency()), 1);
+	double						maxWork = 1e10;
+	std::string					outputPath;
+};
+
+struct Exemplar {
+	std::string	name;
+	std::string	path;
+	int			scaleShift;
+};
+
+std::vector<std::string> SplitList(const std::string& list){
+	std::vector<std::string> items;
+	std::stringstream stream{list};
+	std::string item;
+	while (std::getline(stream, item, ',')) {
+		if (item.empty() == false) {
+			items.push_back(item);
+		}
+	}
+	return items;
+}
+
+std::vector<int> SplitIntList(const std::string& list){
+	std::vector<int> values;
+	for (const std::string& item : SplitList(list)) {
+		values.push_back(std::stoi(item));
+	}
+	return values;
+}
+
+bool ParseOptions(int argc, char* argv[], BenchmarkOptions& options){
+	for (int i = 1; i < argc; ++i) {
+		const std::string arg = argv[i];
+		if (i + 1 >= argc) {
+			return false;
+		}
+		const std::string value = argv[++i];
+		if (arg == "--modes") {
+			options.modes = SplitIntList(value);
+		} else if (arg == "--sizes") {
+			options.sizes = SplitIntList(value);
+		} else if (arg == "--radii") {
+			options.radii = SplitIntList(value);
+		} else if (arg == "--exemplars") {
+			options.exemplars = SplitList(value);
+		} else if (arg == "--scales") {
+			options.scales = SplitIntList(value);
+		} else if (arg == "--synthetic") {
+			options.syntheticSizes = SplitIntList(value);
+		} else if (arg == "--repetitions") {
+			options.repetitions = mymax(std::stoi(value), 1);
+		} else if (arg == "--seed") {
+			options.seed = unsigned(std::stoul(value));
+		} else if (arg == "--workers") {
+			options.workers = mymax(std::stoi(value), 1);
+		} else if (arg == "--max-work") {
+			options.maxWork = std::stod(value);
+		} else if (arg == "--out") {
+			options.outputPath = value;
+		} else {
+			return false;
+		}
+	}
+	for (const int mode : options.modes) {
+		if (mode < 0 || mode >= MODE_COUNT) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// Smooth colour blobs with irregular dark mortar lines, roughly the structure of the bundled wall photos
+// but with a known, reproducible content.
+void WriteSyntheticExemplar(const std::string& path, int size, unsigned int seed){
+	RandomGenerator randomUnit{0.0, 1.0, seed};
+	const int gridSize = 8;
+	std::vector<float> lattice((gridSize + 1) * (gridSize + 1) * 3);
+	for (float& value : lattice) {
+		value = float(randomUnit());
+	}
+	std::vector<unsigned char> pixels(size * size * 3);
+	const int brickHeight = mymax(size / 8, 2);
+	for (int h = 0; h < size; ++h) {
+		const int brickWidth = brickHeight * 2;
+		const int rowShift = ((h / brickHeight) % 2) * brickHeight;
+		for (int w = 0; w < size; ++w) {
+			const float gx = float(w) * gridSize / size;
+			const float gy = float(h) * gridSize / size;
+			const int x0 = int(gx);
+			const int y0 = int(gy);
+			const float fx = gx - x0;
+			const float fy = gy - y0;
+			const bool mortar = (h % brickHeight) == 0 || ((w + rowShift) % brickWidth) == 0;
+			for (int c = 0; c < 3; ++c) {
+				auto latticeAt = [&](int x, int y){
+					return lattice[(y * (gridSize + 1) + x) * 3 + c];
+				};
+				const float value =
+					latticeAt(x0, y0) * (1.f - fx) * (1.f - fy) + latticeAt(x0 + 1, y0) * fx * (1.f - fy) +
+					latticeAt(x0, y0 + 1) * (1.f - fx) * fy + latticeAt(x0 + 1, y0 + 1) * fx * fy;
+				pixels[(h * size + w) * 3 + c] = (unsigned char)(mortar ? value * 60.f : 80.f + value * 175.f);
+			}
+		}
+	}
+	jpge::compress_image_to_jpeg_file(path.c_str(), size, size, 3, pixels.data());
+}
+
+// Neighbourhood comparisons a run needs: every output pixel against every exemplar pixel for BRUTE_FORCE,
+// every exemplar pixel against every other for the K_COHERENCE map. Roughly 1e9 of them take a second.
+double EstimateWork(TextureSynthesiser::GenerationMode mode, int outputPixels, int exemplarPixels, int neighbourSize){
+	const double window = double(2 * neighbourSize + 1) * (2 * neighbourSize + 1);
+	switch (mode) {
+	case TextureSynthesiser::BRUTE_FORCE:
+		return double(outputPixels) * exemplarPixels * window;
+	case TextureSynthesiser::K_COHERENCE:
+		return double(exemplarPixels) * exemplarPixels * window;
+	default:
+		return 0.0;
+	}
+}
+
+// Peak resident set size. On Linux ResetPeakRss() restarts the high-water mark, so it covers the last run;
+// Windows cannot reset it and reports the peak since the process started.
+void ResetPeakRss(){
+#ifndef _WIN32
+	std::ofstream clearRefs{"/proc/self/clear_refs"};
+	clearRefs << "5";
+#endif
+}
+
+long long GetPeakRssBytes(){
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+		return (long long)counters.PeakWorkingSetSize;
+	}
+	return -1;
+#else
+	std::ifstream status{"/proc/self/status"};
+	std::string line;
+	while (std::getline(status, line)) {
+		if (line.compare(0, 6, "VmHWM:") == 0) {
+			return std::stoll(line.substr(6)) * 1024;
+		}
+	}
+	return -1;
+#endif
+}
+
+std::string EscapeJson(const std::string& text){
+	std::string escaped;
+	for (const char c : text) {
+		if (c == '"' || c == '\\') {
+			escaped += '\\';
+		}
+		escaped += c;
+	}
+	return escaped;
+}
+
+// nearest rank percentile of sorted values
+double Percentile(const std::vector<double>& sortedValues, double percent){
+	const int rank = int(std::ceil(percent / 100.0 * sortedValues.size()));
+	return sortedValues[Clamp(rank - 1, 0, int(sortedValues.size()) - 1)];
+}
+
+double Median(const std::vector<double>& sortedValues){
+	const size_t count = sortedValues.size();
+	return (count % 2) ? sortedValues[count / 2] : 0.5 * (sortedValues[count / 2 - 1] + sortedValues[count / 2]);
+}
+
+struct PhaseMeasurement {
+	std::vector<double>	seconds;
+	double				counterTotals[PerfCounters::COUNTER_COUNT] = {};
+	int					counterSamples[PerfCounters::COUNTER_COUNT] = {};
+
+	void Add(double phaseSeconds, const PerfCounters::Reading& reading){
+		seconds.push_back(phaseSeconds);
+		for (int counter = 0; counter < PerfCounters::COUNTER_COUNT; ++counter) {
+			if (reading.valid[counter]) {
+				counterTotals[counter] += reading.values[counter];
+				counterSamples[counter]++;
+			}
+		}
+	}
+
+	// a counter missing from any repetition is left out rather than averaged over fewer runs
+	bool Valid(int counter) const {
+		return counterSamples[counter] > 0 && counterSamples[counter] == int(seconds.size());
+	}
+
+	double Average(int counter) const {
+		return counterTotals[counter] / counterSamples[counter];
+	}
+};
+
+template<typename Phase>
+void MeasurePhase(PerfCounters& counters, PhaseMeasurement& measurement, Phase phase){
+	const auto startTime = std::chrono::steady_clock::now();
+	counters.Start();
+	phase();
+	const PerfCounters::Reading reading = counters.Stop();
+	measurement.Add(std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count(), reading);
+}
+
+// a counter is only valid in the sum if it is in both parts
+void AddReading(PerfCounters::Reading& sum, const PerfCounters::Reading& part, bool first){
+	for (int counter = 0; counter < PerfCounters::COUNTER_COUNT; ++counter) {
+		sum.values[counter] = (first ? 0.0 : sum.values[counter]) + part.values[counter];
+		sum.valid[counter] = (first || sum.valid[counter]) && part.valid[counter];
+	}
+}
+
+// Generate() with its counters split at the phases of its progress events: a phase lasts from its first event
+// to the first event of the next one, the last one to the end of the call. The reporter delivers one event at
+// a time, so switching the counters from the callback is safe whichever thread calls it. The generate
+// measurement gets the whole call, the phases one sample per repetition each, however often they are entered.
+TextureSynthesiser::SynthesisStats MeasureGenerate(
+	PerfCounters& counters,
+	PhaseMeasurement& generate,
+	std::vector<PhaseMeasurement>& synthesisPhases,
+	TextureSynthesiser& textureGenerator
+){
+	using Clock = std::chrono::steady_clock;
+	double phaseSeconds[SYNTHESIS_PHASE_COUNT] = {};
+	PerfCounters::Reading phaseReadings[SYNTHESIS_PHASE_COUNT];
+	bool phaseEntered[SYNTHESIS_PHASE_COUNT] = {};
+	PerfCounters::Reading totalReading;
+	bool firstReading = true;
+	int currentPhase = -1;	// before the first event, counted in the total only
+
+	const Clock::time_point startTime = Clock::now();
+	Clock::time_point phaseStart = startTime;
+	const auto switchPhase = [&](int nextPhase){
+		const PerfCounters::Reading reading = counters.Stop();
+		const Clock::time_point now = Clock::now();
+		AddReading(totalReading, reading, firstReading);
+		firstReading = false;
+		if (currentPhase >= 0) {
+			phaseSeconds[currentPhase] += std::chrono::duration<double>(now - phaseStart).count();
+			AddReading(phaseReadings[currentPhase], reading, phaseEntered[currentPhase] == false);
+			phaseEntered[currentPhase] = true;
+		}
+		currentPhase = nextPhase;
+		phaseStart = now;
+		if (nextPhase >= 0) {
+			counters.Start();
+		}
+	};
+
+	counters.Start();
+	const TextureSynthesiser::SynthesisStats stats = textureGenerator.Generate([&](const ProgressEvent& event){
+		if (event.phase != currentPhase) {
+			switchPhase(event.phase);
+		}
+	}).stats;
+	switchPhase(-1);
+
+	generate.Add(std::chrono::duration<double>(Clock::now() - startTime).count(), totalReading);
+	for (int phase = 0; phase < SYNTHESIS_PHASE_COUNT; ++phase) {
+		if (phaseEntered[phase]) {
+			synthesisPhases[phase].Add(phaseSeconds[phase], phaseReadings[phase]);
+		}
+	}
+	return stats;
+}
+
+void WritePhase(std::ostream& report, const char* name, PhaseMeasurement& measurement, int outputPixels){
+	std::sort(measurement.seconds.begin(), measurement.seconds.end());
+	report << "\"" << name << "\": {\"medianSeconds\": " << Median(measurement.seconds);
+	for (int counter = 0; counter < PerfCounters::COUNTER_COUNT; ++counter) {
+		report << ", \"" << PerfCounters::Name(counter) << "PerPixel\": ";
+		if (measurement.Valid(counter)) {
+			report << measurement.Average(counter) / outputPixels;
+		} else {
+			report << "null";
+		}
+	}
+	report << ", \"ipc\": ";
+	const bool ipcValid = measurement.Valid(PerfCounters::CYCLES) && measurement.Valid(PerfCounters::INSTRUCTIONS)
+		&& measurement.Average(PerfCounters::CYCLES) > 0.0;
+	if (ipcValid) {
+		report << measurement.Average(PerfCounters::INSTRUCTIONS) / measurement.Average(PerfCounters::CYCLES);
+	} else {
+		report << "null";
+	}
+	report << "}";
+}
+
+} // namespace
+
+int main(int argc, char* argv[]){
+
+	BenchmarkOptions options;
+	if (ParseOptions(argc, argv, options) == false) {
+		std::cerr << "usage: " << argv[0]
+			<< " [--modes 0,1,2,3] [--sizes 64,128,256] [--radii 2,5] [--exemplars 1.jpg,2.jpg] [--scales 0,1]"
+			<< " [--synthetic 64,128] [--repetitions 5] [--seed 1] [--workers n] [--max-work 1e10] [--out report.json]"
+			<< std::endl;
+		return EXIT_FAILURE;
+	}
+
+	namespace fs = std::filesystem;
+	const fs::path workDirectory = fs::temp_directory_path() / "texturesynth-benchmark";
+	fs::create_directories(workDirectory);
+	std::vector<Exemplar> exemplars;
+	for (const std::string& exemplarPath : options.exemplars) {
+		if (fs::exists(exemplarPath) == false) {
+			std::cerr << "cannot open " << exemplarPath << std::endl;
+			return EXIT_FAILURE;
+		}
+		const fs::path stagedPath = workDirectory / fs::path(exemplarPath).filename();
+		fs::copy_file(exemplarPath, stagedPath, fs::copy_options::overwrite_existing);
+		fs::remove(ExemplarBundle::PathFor(stagedPath.string()));
+		for (const int scaleShift : options.scales) {
+			exemplars.push_back(Exemplar{fs::path(exemplarPath).filename().string(), stagedPath.string(), scaleShift});
+		}
+	}
+	for (const int syntheticSize : options.syntheticSizes) {
+		const std::string name = "synthetic-" + std::to_string(syntheticSize) + ".jpg";
+		const fs::path stagedPath = workDirectory / name;
+		WriteSyntheticExemplar(stagedPath.string(), syntheticSize, options.seed);
+		exemplars.push_back(Exemplar{name, stagedPath.string(), 0});
+	}
+
+	const std::string savePath = (workDirectory / "output.jpg").string();
+	PerfCounters counters;
+	if (counters.AnyAvailable() == false) {
+		std::cerr << "hardware counters unavailable, reporting wall time only" << std::endl;
+	}
+
+	std::ostringstream report;
+	report << "{\n";
+	report << "\t\"repetitions\": " << options.repetitions << ",\n";
+	report << "\t\"seed\": " << options.seed << ",\n";
+	report << "\t\"workers\": " << options.workers << ",\n";
+	report << "\t\"counters\": {";
+	for (int counter = 0; counter < PerfCounters::COUNTER_COUNT; ++counter) {
+		report << (counter ? ", " : "") << "\"" << PerfCounters::Name(counter) << "\": " << (counters.Available(counter) ? "true" : "false");
+	}
+	report << "},\n";
+	report << "\t\"results\": [";
+
+	bool firstResult = true;
+	for (const int mode : options.modes) {
+		const auto generationMode = TextureSynthesiser::GenerationMode(mode);
+		// the patch based modes do not look at the neighbourhood, one radius is enough for them
+		const bool usesRadius = generationMode == TextureSynthesiser::BRUTE_FORCE || generationMode == TextureSynthesiser::K_COHERENCE;
+		const int radiusCount = usesRadius ? int(options.radii.size()) : mymin(int(options.radii.size()), 1);
+		for (const Exemplar& exemplar : exemplars) {
+			for (const int size : options.sizes) {
+				for (int radiusIndex = 0; radiusIndex < radiusCount; ++radiusIndex) {
+					const int neighbourSize = options.radii[radiusIndex];
+					std::cerr << MODE_NAMES[mode] << " " << exemplar.name << "/" << (1 << exemplar.scaleShift)
+						<< " " << size << "x" << size << " n=" << neighbourSize << std::endl;
+
+					PhaseMeasurement load, generate, save;
+					std::vector<PhaseMeasurement> synthesisPhases(SYNTHESIS_PHASE_COUNT);
+					TextureSynthesiser::SynthesisStats stats;
+					Dimension exemplarDimension{0, 0};
+					bool skipped = false;
+					bool failed = false;
+					ResetPeakRss();
+					for (int repetition = 0; repetition < options.repetitions; ++repetition) {
+						std::unique_ptr<TextureSynthesiser> textureGenerator;
+						MeasurePhase(counters, load, [&](){
+							textureGenerator = std::make_unique<TextureSynthesiser>(
+								exemplar.path,
+								Dimension{size, size},
+								neighbourSize,
+								/* similarityThreshold */ 0.02f,
+								generationMode,
+								/* coherenceThreshold */ 0.2f,
+								exemplar.scaleShift
+							);
+						});
+						// an exemplar that does not decode fails its runs, the sweep goes on
+						if (textureGenerator->IsInputLoaded() == false) {
+							failed = true;
+							break;
+						}
+						exemplarDimension = textureGenerator->GetInputDimension();
+						if (EstimateWork(generationMode, size * size, exemplarDimension.size(), neighbourSize) > options.maxWork) {
+							skipped = true;
+							break;
+						}
+						textureGenerator->SetRandomSeed(options.seed);
+						textureGenerator->SetWorkerCount(options.workers);
+						stats = MeasureGenerate(counters, generate, synthesisPhases, *textureGenerator);
+						MeasurePhase(counters, save, [&](){
+							textureGenerator->SaveToFile(savePath);
+						});
+					}
+					std::vector<double>& seconds = generate.seconds;
+					std::sort(seconds.begin(), seconds.end());
+
+					report << (firstResult ? "\n" : ",\n") << "\t\t{";
+					firstResult = false;
+					report << "\"mode\": \"" << MODE_NAMES[mode] << "\"";
+					report << ", \"exemplar\": \"" << EscapeJson(exemplar.name) << "\"";
+					report << ", \"scaleShift\": " << exemplar.scaleShift;
+					report << ", \"exemplarWidth\": " << exemplarDimension.width;
+					report << ", \"exemplarHeight\": " << exemplarDimension.height;
+					report << ", \"outputWidth\": " << size;
+					report << ", \"outputHeight\": " << size;
+					report << ", \"neighbourSize\": " << neighbourSize;
+					if (failed) {
+						std::cerr << "cannot decode " << exemplar.name << std::endl;
+						report << ", \"failed\": true}";
+						continue;
+					}
+					if (skipped) {
+						report << ", \"skipped\": true}";
+						continue;
+					}
+					const double median = Median(seconds);
+					report << ", \"medianSeconds\": " << median;
+					report << ", \"p95Seconds\": " << Percentile(seconds, 95.0);
+					report << ", \"pixelsPerSecond\": " << (median > 0.0 ? double(size) * size / median : 0.0);
+					report << ", \"peakRssBytes\": " << GetPeakRssBytes();
+					// the same seed does the same work every repetition, the last one's counters stand for all
+					report << ", \"distanceEvaluations\": " << stats.distanceEvaluations;
+					report << ", \"tapsAccumulated\": " << stats.tapsAccumulated;
+					report << ", \"rejectedByBorder\": " << stats.rejectedByBorder;
+					report << ", \"rejectedBySimilarity\": " << stats.rejectedBySimilarity;
+					report << ", \"rejectedByEarlyExit\": " << stats.rejectedByEarlyExit;
+					report << ", \"goodEnoughHits\": " << stats.goodEnoughHits;
+					report << ", \"averageSimilarListLength\": " << stats.AverageSimilarListLength();
+					report << ", \"coherenceClusters\": " << stats.coherenceClusters;
+					report << ", \"patchesPlaced\": " << stats.patchesPlaced;
+					report << ", \"candidatesWithinTolerance\": " << stats.candidatesWithinTolerance;
+					report << ", \"seamGraphNodes\": " << stats.seamGraphNodes;
+					report << ", \"phases\": {";
+					WritePhase(report, "load", load, size * size);
+					report << ", ";
+					WritePhase(report, "generate", generate, size * size);
+					report << ", ";
+					WritePhase(report, "save", save, size * size);
+					report << "}, \"generatePhases\": {";
+					bool firstPhase = true;
+					for (int phase = 0; phase < SYNTHESIS_PHASE_COUNT; ++phase) {
+						if (synthesisPhases[phase].seconds.empty() == false) {
+							report << (firstPhase ? "" : ", ");
+							firstPhase = false;
+							WritePhase(report, SYNTHESIS_PHASE_NAMES[phase], synthesisPhases[phase], size * size);
+						}
+					}
+					report << "}}";
+				}
+			}
+		}
+	}
+	report << "\n\t]\n}\n";
+
+	if (options.outputPath.empty()) {
+		std::cout << report.str();
+	} else {
+		std::ofstream outputFile{options.outputPath};
+		outputFile << report.str();
+		if (outputFile.good() == false) {
+			std::cerr << "cannot write " << options.outputPath << std::endl;
+			return EXIT_FAILURE;
+		}
+	}
+
+	return 0;
+}
@@ -11,6 +11,9 @@
 
 #include "jpgd.h"
 #include <string.h>
+#include <atomic>
+#include <thread>
+#include <vector>
 
 #include <assert.h>
 #define JPGD_ASSERT(x) assert(x)
@@ -29,11 +32,84 @@
 #define JPGD_MAX(a,b) (((a)>(b)) ? (a) : (b))
 #define JPGD_MIN(a,b) (((a)<(b)) ? (a) : (b))
 
+// Set to 1 to use SSE2/AVX2 for the IDCT and YCbCr->RGB conversion on x86 (the instruction set is picked at runtime).
+// The SIMD paths produce exactly the same pixels as the scalar code.
+#ifndef JPGD_USE_SIMD
+  #if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__))
+    #define JPGD_USE_SIMD 1
+  #else
+    #define JPGD_USE_SIMD 0
+  #endif
+#endif
+
+#if JPGD_USE_SIMD
+  #include <emmintrin.h>
+  #include <immintrin.h>
+  #ifdef _MSC_VER
+    #include <intrin.h>
+    #define JPGD_AVX2_FUNC
+  #else
+    #include <cpuid.h>
+    #define JPGD_AVX2_FUNC __attribute__((target("avx2")))
+  #endif
+#endif
+
 namespace jpgd {
 
 static inline void *jpgd_malloc(size_t nSize) { return malloc(nSize); }
 static inline void jpgd_free(void *p) { free(p); }
 
+#if JPGD_USE_SIMD
+static jpgd_simd_level detect_simd_level()
+{
+  int regs[4] = { 0, 0, 0, 0 };
+#ifdef _MSC_VER
+  __cpuid(regs, 0);
+  const int max_leaf = regs[0];
+  __cpuid(regs, 1);
+#else
+  const int max_leaf = (int)__get_cpuid_max(0, NULL);
+  __cpuid(1, regs[0], regs[1], regs[2], regs[3]);
+#endif
+  if ((regs[3] & (1 << 26)) == 0)
+    return JPGD_SIMD_NONE;
+
+  // AVX2 also needs the OS to save the YMM registers (OSXSAVE + XCR0 bits 1 and 2).
+  const bool os_avx = ((regs[2] & (1 << 27)) != 0) && ((regs[2] & (1 << 28)) != 0);
+  if ((!os_avx) || (max_leaf < 7))
+    return JPGD_SIMD_SSE2;
+#ifdef _MSC_VER
+  const unsigned long long xcr0 = _xgetbv(0);
+  __cpuidex(regs, 7, 0);
+#else
+  uint xcr0_lo, xcr0_hi;
+  __asm__ volatile ("xgetbv" : "=a" (xcr0_lo), "=d" (xcr0_hi) : "c" (0));
+  const unsigned long long xcr0 = xcr0_lo;
+  __cpuid_count(7, 0, regs[0], regs[1], regs[2], regs[3]);
+#endif
+  if (((xcr0 & 6) == 6) && ((regs[1] & (1 << 5)) != 0))
+    return JPGD_SIMD_AVX2;
+  return JPGD_SIMD_SSE2;
+}
+
+static const jpgd_simd_level g_cpu_simd_level = detect_simd_level();
+#else
+static const jpgd_simd_level g_cpu_simd_level = JPGD_SIMD_NONE;
+#endif
+
+static jpgd_simd_level g_simd_level = g_cpu_simd_level;
+
+jpgd_simd_level set_simd_level(jpgd_simd_level level)
+{
+  g_simd_level = (jpgd_simd_level)JPGD_MIN((int)level, (int)g_cpu_simd_level);
+  return g_simd_level;
+}
+
+jpgd_simd_level get_simd_level()
+{
+  return g_simd_level;
+}
+
 // DCT coefficients are stored in this sequence.
 static int g_ZAG[64] = {  0,1,8,16,9,2,3,10,17,24,32,25,18,11,4,5,12,19,26,33,40,48,41,34,27,20,13,6,7,14,21,28,35,42,49,56,57,50,43,36,29,22,15,23,30,37,44,51,58,59,52,45,38,31,39,46,53,60,61,54,47,55,62,63 };
 
@@ -332,6 +408,258 @@ void idct_4x4(const jpgd_block_t* pSrc_ptr, uint8* pDst_ptr)
   }
 }
 
+#if JPGD_USE_SIMD
+// SIMD versions of the full 8x8 IDCT above. They evaluate exactly the same 32-bit integer butterfly as Row<8>/Col<8>
+// (lane-wise, all 8 rows/columns at once), so the output is bit-identical to the scalar path. Coefficients past
+// block_max_zag are always zero, so running the full transform on sparse blocks changes nothing but speed.
+#define JPGD_SIMD_IDCT_1D(T, ADD, SUB, MULC, SHL13, c, o) \
+  { \
+    const T z1 = MULC(ADD(c[2], c[6]), FIX_0_541196100); \
+    const T tmp2 = ADD(z1, MULC(c[6], -FIX_1_847759065)); \
+    const T tmp3 = ADD(z1, MULC(c[2], FIX_0_765366865)); \
+    const T tmp0 = SHL13(ADD(c[0], c[4])); \
+    const T tmp1 = SHL13(SUB(c[0], c[4])); \
+    const T tmp10 = ADD(tmp0, tmp3), tmp13 = SUB(tmp0, tmp3), tmp11 = ADD(tmp1, tmp2), tmp12 = SUB(tmp1, tmp2); \
+    const T bz1 = ADD(c[7], c[1]), bz2 = ADD(c[5], c[3]), bz3 = ADD(c[7], c[3]), bz4 = ADD(c[5], c[1]); \
+    const T bz5 = MULC(ADD(bz3, bz4), FIX_1_175875602); \
+    const T az1 = MULC(bz1, -FIX_0_899976223); \
+    const T az2 = MULC(bz2, -FIX_2_562915447); \
+    const T az3 = ADD(MULC(bz3, -FIX_1_961570560), bz5); \
+    const T az4 = ADD(MULC(bz4, -FIX_0_390180644), bz5); \
+    const T btmp0 = ADD(ADD(MULC(c[7], FIX_0_298631336), az1), az3); \
+    const T btmp1 = ADD(ADD(MULC(c[5], FIX_2_053119869), az2), az4); \
+    const T btmp2 = ADD(ADD(MULC(c[3], FIX_3_072711026), az2), az3); \
+    const T btmp3 = ADD(ADD(MULC(c[1], FIX_1_501321110), az1), az4); \
+    o[0] = ADD(tmp10, btmp3); o[7] = SUB(tmp10, btmp3); \
+    o[1] = ADD(tmp11, btmp2); o[6] = SUB(tmp11, btmp2); \
+    o[2] = ADD(tmp12, btmp1); o[5] = SUB(tmp12, btmp1); \
+    o[3] = ADD(tmp13, btmp0); o[4] = SUB(tmp13, btmp0); \
+  }
+
+// SSE2 has no 32-bit low multiply, so build it from two 32x32->64 multiplies.
+static inline __m128i mullo_epi32_sse2(__m128i a, __m128i b)
+{
+  const __m128i even = _mm_mul_epu32(a, b);
+  const __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+  return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)), _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+static inline void transpose4x4_sse2(__m128i& r0, __m128i& r1, __m128i& r2, __m128i& r3)
+{
+  const __m128i t0 = _mm_unpacklo_epi32(r0, r1), t1 = _mm_unpacklo_epi32(r2, r3);
+  const __m128i t2 = _mm_unpackhi_epi32(r0, r1), t3 = _mm_unpackhi_epi32(r2, r3);
+  r0 = _mm_unpacklo_epi64(t0, t1); r1 = _mm_unpackhi_epi64(t0, t1);
+  r2 = _mm_unpacklo_epi64(t2, t3); r3 = _mm_unpackhi_epi64(t2, t3);
+}
+
+#define JPGD_SSE2_MULC(x, k) mullo_epi32_sse2(x, _mm_set1_epi32(k))
+#define JPGD_SSE2_SHL13(x) _mm_slli_epi32(x, CONST_BITS)
+
+// 4 lanes: c[] holds the 8 inputs of 4 rows (or columns) being transformed.
+static inline void idct_1d_sse2(const __m128i* c, __m128i* o)
+{
+  JPGD_SIMD_IDCT_1D(__m128i, _mm_add_epi32, _mm_sub_epi32, JPGD_SSE2_MULC, JPGD_SSE2_SHL13, c, o)
+}
+
+static void idct_sse2(const jpgd_block_t* pSrc_ptr, uint8* pDst_ptr)
+{
+  const __m128i row_bias = _mm_set1_epi32(SCALEDONE << (CONST_BITS-PASS1_BITS-1));
+  const __m128i col_bias = _mm_set1_epi32((128 << (CONST_BITS+PASS1_BITS+3)) + (SCALEDONE << (CONST_BITS+PASS1_BITS+3-1)));
+
+  // rows[h][i]: columns 4h..4h+3 of row i, after the row pass.
+  __m128i rows[2][8];
+  for (int half = 0; half < 2; half++)
+  {
+    // Sign extend 4 rows of coefficients to 32 bits, then transpose so each vector holds one column.
+    __m128i c[8], o[8];
+    for (int i = 0; i < 4; i++)
+    {
+      const __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pSrc_ptr + (half * 4 + i) * 8));
+      c[i] = _mm_srai_epi32(_mm_unpacklo_epi16(s, s), 16);
+      c[i + 4] = _mm_srai_epi32(_mm_unpackhi_epi16(s, s), 16);
+    }
+    transpose4x4_sse2(c[0], c[1], c[2], c[3]);
+    transpose4x4_sse2(c[4], c[5], c[6], c[7]);
+
+    idct_1d_sse2(c, o);
+    for (int i = 0; i < 8; i++)
+      o[i] = _mm_srai_epi32(_mm_add_epi32(o[i], row_bias), CONST_BITS-PASS1_BITS);
+
+    // Back to one vector per row.
+    transpose4x4_sse2(o[0], o[1], o[2], o[3]);
+    transpose4x4_sse2(o[4], o[5], o[6], o[7]);
+    for (int i = 0; i < 4; i++)
+    {
+      rows[0][half * 4 + i] = o[i];
+      rows[1][half * 4 + i] = o[i + 4];
+    }
+  }
+
+  __m128i out[2][8];
+  for (int half = 0; half < 2; half++)
+  {
+    idct_1d_sse2(rows[half], out[half]);
+    for (int i = 0; i < 8; i++)
+      out[half][i] = _mm_srai_epi32(_mm_add_epi32(out[half][i], col_bias), CONST_BITS+PASS1_BITS+3);
+  }
+
+  for (int i = 0; i < 8; i++)
+  {
+    const __m128i w = _mm_packs_epi32(out[0][i], out[1][i]);
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(pDst_ptr + i * 8), _mm_packus_epi16(w, w));
+  }
+}
+
+static JPGD_AVX2_FUNC inline void transpose8x8_avx2(__m256i* r)
+{
+  const __m256i t0 = _mm256_unpacklo_epi32(r[0], r[1]), t1 = _mm256_unpackhi_epi32(r[0], r[1]);
+  const __m256i t2 = _mm256_unpacklo_epi32(r[2], r[3]), t3 = _mm256_unpackhi_epi32(r[2], r[3]);
+  const __m256i t4 = _mm256_unpacklo_epi32(r[4], r[5]), t5 = _mm256_unpackhi_epi32(r[4], r[5]);
+  const __m256i t6 = _mm256_unpacklo_epi32(r[6], r[7]), t7 = _mm256_unpackhi_epi32(r[6], r[7]);
+  const __m256i u0 = _mm256_unpacklo_epi64(t0, t2), u1 = _mm256_unpackhi_epi64(t0, t2);
+  const __m256i u2 = _mm256_unpacklo_epi64(t1, t3), u3 = _mm256_unpackhi_epi64(t1, t3);
+  const __m256i u4 = _mm256_unpacklo_epi64(t4, t6), u5 = _mm256_unpackhi_epi64(t4, t6);
+  const __m256i u6 = _mm256_unpacklo_epi64(t5, t7), u7 = _mm256_unpackhi_epi64(t5, t7);
+  r[0] = _mm256_permute2x128_si256(u0, u4, 0x20); r[4] = _mm256_permute2x128_si256(u0, u4, 0x31);
+  r[1] = _mm256_permute2x128_si256(u1, u5, 0x20); r[5] = _mm256_permute2x128_si256(u1, u5, 0x31);
+  r[2] = _mm256_permute2x128_si256(u2, u6, 0x20); r[6] = _mm256_permute2x128_si256(u2, u6, 0x31);
+  r[3] = _mm256_permute2x128_si256(u3, u7, 0x20); r[7] = _mm256_permute2x128_si256(u3, u7, 0x31);
+}
+
+#define JPGD_AVX2_MULC(x, k) _mm256_mullo_epi32(x, _mm256_set1_epi32(k))
+#define JPGD_AVX2_SHL13(x) _mm256_slli_epi32(x, CONST_BITS)
+
+static JPGD_AVX2_FUNC inline void idct_1d_avx2(const __m256i* c, __m256i* o)
+{
+  JPGD_SIMD_IDCT_1D(__m256i, _mm256_add_epi32, _mm256_sub_epi32, JPGD_AVX2_MULC, JPGD_AVX2_SHL13, c, o)
+}
+
+static JPGD_AVX2_FUNC void idct_avx2(const jpgd_block_t* pSrc_ptr, uint8* pDst_ptr)
+{
+  const __m256i row_bias = _mm256_set1_epi32(SCALEDONE << (CONST_BITS-PASS1_BITS-1));
+  const __m256i col_bias = _mm256_set1_epi32((128 << (CONST_BITS+PASS1_BITS+3)) + (SCALEDONE << (CONST_BITS+PASS1_BITS+3-1)));
+
+  __m256i c[8], o[8];
+  for (int i = 0; i < 8; i++)
+    c[i] = _mm256_cvtepi16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pSrc_ptr + i * 8)));
+
+  // Row pass: one vector per column, lanes are rows.
+  transpose8x8_avx2(c);
+  idct_1d_avx2(c, o);
+  for (int i = 0; i < 8; i++)
+    o[i] = _mm256_srai_epi32(_mm256_add_epi32(o[i], row_bias), CONST_BITS-PASS1_BITS);
+
+  // Column pass: one vector per row, lanes are columns.
+  transpose8x8_avx2(o);
+  idct_1d_avx2(o, c);
+
+  for (int i = 0; i < 8; i += 2)
+  {
+    const __m256i r0 = _mm256_srai_epi32(_mm256_add_epi32(c[i], col_bias), CONST_BITS+PASS1_BITS+3);
+    const __m256i r1 = _mm256_srai_epi32(_mm256_add_epi32(c[i + 1], col_bias), CONST_BITS+PASS1_BITS+3);
+    // packs works per 128-bit lane, so reorder to [row i, row i+1] before narrowing to bytes.
+    const __m256i w = _mm256_permute4x64_epi64(_mm256_packs_epi32(r0, r1), _MM_SHUFFLE(3, 1, 2, 0));
+    const __m128i b = _mm_packus_epi16(_mm256_castsi256_si128(w), _mm256_extracti128_si256(w, 1));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(pDst_ptr + i * 8), b);
+  }
+}
+#endif // JPGD_USE_SIMD
+
+#if JPGD_USE_SIMD
+static inline void idct_simd(int simd_level, const jpgd_block_t* pSrc_ptr, uint8* pDst_ptr)
+{
+  if (simd_level == JPGD_SIMD_AVX2)
+    idct_avx2(pSrc_ptr, pDst_ptr);
+  else
+    idct_sse2(pSrc_ptr, pDst_ptr);
+}
+#endif
+
+// idct() using the decoder's SIMD level. DC only blocks stay on the scalar fast path.
+static inline void idct_block(int simd_level, const jpgd_block_t* pSrc_ptr, uint8* pDst_ptr, int block_max_zag)
+{
+#if JPGD_USE_SIMD
+  if ((simd_level != JPGD_SIMD_NONE) && (block_max_zag > 1))
+  {
+    idct_simd(simd_level, pSrc_ptr, pDst_ptr);
+    return;
+  }
+#else
+  (void)simd_level;
+#endif
+  idct(pSrc_ptr, pDst_ptr, block_max_zag);
+}
+
+// idct_4x4() using the decoder's SIMD level. The coefficients outside the top-left 4x4 must be zero.
+static inline void idct_block_4x4(int simd_level, const jpgd_block_t* pSrc_ptr, uint8* pDst_ptr)
+{
+#if JPGD_USE_SIMD
+  if (simd_level != JPGD_SIMD_NONE)
+  {
+    idct_simd(simd_level, pSrc_ptr, pDst_ptr);
+    return;
+  }
+#else
+  (void)simd_level;
+#endif
+  idct_4x4(pSrc_ptr, pDst_ptr);
+}
+
+// Reduced IDCT kernels for scaled decoding, 8-point basis functions averaged over the 2 or 4 source pixels
+// each output pixel covers (so the result approximates a box-filtered full decode), scaled by 1 << CONST_BITS.
+static const int s_idct_scaled_4[4 * 4] =
+{
+  2896,  3711,  2676,  1303,
+  2896,  1537, -2676, -3146,
+  2896, -1537, -2676,  3146,
+  2896, -3711,  2676, -1303
+};
+
+static const int s_idct_scaled_2[2 * 2] =
+{
+  2896,  2624,
+  2896, -2624
+};
+
+// Transforms a block to (8 >> scale_shift)^2 samples using only the top-left (8 >> scale_shift)^2 coefficients,
+// written with a stride of (8 >> scale_shift). Scale shift 3 (1/8) is DC only.
+static void idct_scaled(const jpgd_block_t* pSrc_ptr, uint8* pDst_ptr, int scale_shift)
+{
+  if (scale_shift == 3)
+  {
+    int k = ((pSrc_ptr[0] + 4) >> 3) + 128;
+    *pDst_ptr = (uint8)CLAMP(k);
+    return;
+  }
+
+  const int n = 8 >> scale_shift;
+  const int* pK = (scale_shift == 1) ? s_idct_scaled_4 : s_idct_scaled_2;
+  int temp[4 * 4];
+
+  for (int v = 0; v < n; v++)
+  {
+    for (int x = 0; x < n; x++)
+    {
+      int sum = 0;
+      for (int u = 0; u < n; u++)
+        sum += pSrc_ptr[v * 8 + u] * pK[x * n + u];
+      temp[v * n + x] = DESCALE(sum, CONST_BITS - PASS1_BITS);
+    }
+  }
+
+  for (int y = 0; y < n; y++)
+  {
+    for (int x = 0; x < n; x++)
+    {
+      int sum = 0;
+      for (int v = 0; v < n; v++)
+        sum += pK[y * n + v] * temp[v * n + x];
+      int i = DESCALE_ZEROSHIFT(sum, CONST_BITS + PASS1_BITS);
+      pDst_ptr[y * n + x] = (uint8)CLAMP(i);
+    }
+  }
+}
+
 // Retrieve one character from the input stream.
 inline uint jpeg_decoder::get_char()
 {
@@ -1354,10 +1682,14 @@ int jpeg_decoder::locate_sos_marker()
 // Reset everything to default/uninitialized state.
 void jpeg_decoder::init(jpeg_decoder_stream *pStream)
 {
-  m_pMem_blocks = NULL;
+  // Memory blocks left over from a previous image are recycled, not freed.
+  for (mem_block *b = m_pMem_blocks; b; b = b->m_pNext)
+    b->m_used_count = 0;
   m_error_code = JPGD_SUCCESS;
+  m_simd_level = g_simd_level;
   m_ready_flag = false;
   m_image_x_size = m_image_y_size = 0;
+  m_scale_shift = 0;
   m_pStream = pStream;
   m_progressive_flag = JPGD_FALSE;
 
@@ -1461,6 +1793,9 @@ void jpeg_decoder::init(jpeg_decoder_stream *pStream)
 // Create a few tables that allow us to quickly convert YCbCr to RGB.
 void jpeg_decoder::create_look_ups()
 {
+  if (m_look_ups_created)
+    return;
+  m_look_ups_created = true;
   for (int i = 0; i <= 255; i++)
   {
     int k = i - 128;
@@ -1492,6 +1827,27 @@ void jpeg_decoder::fix_in_buffer()
   get_bits_no_markers(16);
 }
 
+// Same as transform_mcu(), but each block only gets its reduced IDCT, leaving its samples at the start of its 64 byte slot.
+// Luma is reduced by m_scale_shift. Subsampled chroma is reduced one step less, so it still covers the output pixels one to one.
+void jpeg_decoder::transform_mcu_scaled(int mcu_row)
+{
+  jpgd_block_t* pSrc_ptr = m_pMCU_coefficients;
+  uint8* pDst_ptr = m_pSample_buf + mcu_row * m_blocks_per_mcu * 64;
+  const int luma_blocks = m_comp_h_samp[0] * m_comp_v_samp[0];
+  const int chroma_shift = m_scale_shift - ((luma_blocks > 1) ? 1 : 0);
+
+  for (int mcu_block = 0; mcu_block < m_blocks_per_mcu; mcu_block++)
+  {
+    const int scale_shift = (mcu_block < luma_blocks) ? m_scale_shift : chroma_shift;
+    if (scale_shift)
+      idct_scaled(pSrc_ptr, pDst_ptr, scale_shift);
+    else
+      idct_block(m_simd_level, pSrc_ptr, pDst_ptr, m_mcu_block_max_zag[mcu_block]);
+    pSrc_ptr += 64;
+    pDst_ptr += 64;
+  }
+}
+
 void jpeg_decoder::transform_mcu(int mcu_row)
 {
   jpgd_block_t* pSrc_ptr = m_pMCU_coefficients;
@@ -1499,7 +1855,7 @@ void jpeg_decoder::transform_mcu(int mcu_row)
 
   for (int mcu_block = 0; mcu_block < m_blocks_per_mcu; mcu_block++)
   {
-    idct(pSrc_ptr, pDst_ptr, m_mcu_block_max_zag[mcu_block]);
+    idct_block(m_simd_level, pSrc_ptr, pDst_ptr, m_mcu_block_max_zag[mcu_block]);
     pSrc_ptr += 64;
     pDst_ptr += 64;
   }
@@ -1522,13 +1878,15 @@ void jpeg_decoder::transform_mcu_expand(int mcu_row)
 	int mcu_block;
   for (mcu_block = 0; mcu_block < m_expanded_blocks_per_component; mcu_block++)
   {
-    idct(pSrc_ptr, pDst_ptr, m_mcu_block_max_zag[mcu_block]);
+    idct_block(m_simd_level, pSrc_ptr, pDst_ptr, m_mcu_block_max_zag[mcu_block]);
     pSrc_ptr += 64;
     pDst_ptr += 64;
   }
 
   // Chroma IDCT, with upsampling
 	jpgd_block_t temp_block[64];
+  // Only the top-left 4x4 is written below, the rest must stay zero for the SIMD IDCT.
+  memset(temp_block, 0, sizeof(temp_block));
 
   for (int i = 0; i < 2; i++)
   {
@@ -1611,19 +1969,19 @@ void jpeg_decoder::transform_mcu_expand(int mcu_row)
     DCT_Upsample::Matrix44& d = R;
 
     DCT_Upsample::Matrix44::add_and_store(temp_block, a, c);
-    idct_4x4(temp_block, pDst_ptr);
+    idct_block_4x4(m_simd_level, temp_block, pDst_ptr);
     pDst_ptr += 64;
 
     DCT_Upsample::Matrix44::sub_and_store(temp_block, a, c);
-    idct_4x4(temp_block, pDst_ptr);
+    idct_block_4x4(m_simd_level, temp_block, pDst_ptr);
     pDst_ptr += 64;
 
     DCT_Upsample::Matrix44::add_and_store(temp_block, b, d);
-    idct_4x4(temp_block, pDst_ptr);
+    idct_block_4x4(m_simd_level, temp_block, pDst_ptr);
     pDst_ptr += 64;
 
     DCT_Upsample::Matrix44::sub_and_store(temp_block, b, d);
-    idct_4x4(temp_block, pDst_ptr);
+    idct_block_4x4(m_simd_level, temp_block, pDst_ptr);
     pDst_ptr += 64;
 
     pSrc_ptr += 64;
@@ -1689,7 +2047,9 @@ void jpeg_decoder::load_next_row()
       }
     }
 
-    if (m_freq_domain_chroma_upsample)
+    if (m_scale_shift)
+      transform_mcu_scaled(mcu_row);
+    else if (m_freq_domain_chroma_upsample)
       transform_mcu_expand(mcu_row);
     else
       transform_mcu(mcu_row);
@@ -1855,7 +2215,9 @@ void jpeg_decoder::decode_next_row()
       row_block++;
     }
 
-    if (m_freq_domain_chroma_upsample)
+    if (m_scale_shift)
+      transform_mcu_scaled(mcu_row);
+    else if (m_freq_domain_chroma_upsample)
       transform_mcu_expand(mcu_row);
     else
       transform_mcu(mcu_row);
@@ -1864,6 +2226,129 @@ void jpeg_decoder::decode_next_row()
   }
 }
 
+#if JPGD_USE_SIMD
+// Splits a conversion constant into the (lo, hi) 16-bit pair multiplied against (k, k << 8) by madd,
+// so the SIMD converters form exactly the same 32-bit products as create_look_ups().
+#define JPGD_MADD_PAIR(c) ((int)(((uint)((c) >> 8) << 16) | ((uint)(c) & 0xFF)))
+
+// YCbCr->RGBA for 8 pixels (the low 8 bytes of y/cb/cr), bit-identical to the m_crr/m_crg/m_cbg/m_cbb tables.
+static inline void ycc_to_rgba_sse2(__m128i y, __m128i cb, __m128i cr, uint8* pDst)
+{
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i k128 = _mm_set1_epi16(128);
+  const __m128i round = _mm_set1_epi32(ONE_HALF);
+  const __m128i crr = _mm_set1_epi32(JPGD_MADD_PAIR(FIX(1.40200f)));
+  const __m128i cbb = _mm_set1_epi32(JPGD_MADD_PAIR(FIX(1.77200f)));
+  const __m128i crg = _mm_set1_epi32(JPGD_MADD_PAIR(-FIX(0.71414f)));
+  const __m128i cbg = _mm_set1_epi32(JPGD_MADD_PAIR(-FIX(0.34414f)));
+
+  const __m128i y16 = _mm_unpacklo_epi8(y, zero);
+  const __m128i kcb = _mm_sub_epi16(_mm_unpacklo_epi8(cb, zero), k128);
+  const __m128i kcr = _mm_sub_epi16(_mm_unpacklo_epi8(cr, zero), k128);
+  const __m128i cb_lo = _mm_unpacklo_epi16(kcb, _mm_slli_epi16(kcb, 8)), cb_hi = _mm_unpackhi_epi16(kcb, _mm_slli_epi16(kcb, 8));
+  const __m128i cr_lo = _mm_unpacklo_epi16(kcr, _mm_slli_epi16(kcr, 8)), cr_hi = _mm_unpackhi_epi16(kcr, _mm_slli_epi16(kcr, 8));
+
+  const __m128i rc = _mm_packs_epi32(
+    _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(cr_lo, crr), round), SCALEBITS),
+    _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(cr_hi, crr), round), SCALEBITS));
+  const __m128i gc = _mm_packs_epi32(
+    _mm_srai_epi32(_mm_add_epi32(_mm_add_epi32(_mm_madd_epi16(cr_lo, crg), _mm_madd_epi16(cb_lo, cbg)), round), SCALEBITS),
+    _mm_srai_epi32(_mm_add_epi32(_mm_add_epi32(_mm_madd_epi16(cr_hi, crg), _mm_madd_epi16(cb_hi, cbg)), round), SCALEBITS));
+  const __m128i bc = _mm_packs_epi32(
+    _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(cb_lo, cbb), round), SCALEBITS),
+    _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(cb_hi, cbb), round), SCALEBITS));
+
+  const __m128i r = _mm_packus_epi16(_mm_add_epi16(y16, rc), zero);
+  const __m128i g = _mm_packus_epi16(_mm_add_epi16(y16, gc), zero);
+  const __m128i b = _mm_packus_epi16(_mm_add_epi16(y16, bc), zero);
+
+  const __m128i rg = _mm_unpacklo_epi8(r, g);
+  const __m128i ba = _mm_unpacklo_epi8(b, _mm_set1_epi8(-1));
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(pDst), _mm_unpacklo_epi16(rg, ba));
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(pDst + 16), _mm_unpackhi_epi16(rg, ba));
+}
+
+// Same as ycc_to_rgba_sse2(), for two independent groups of 8 pixels (low/high 8 bytes of y/cb/cr).
+static JPGD_AVX2_FUNC inline void ycc_to_rgba_avx2(__m128i y, __m128i cb, __m128i cr, uint8* pDst0, uint8* pDst1)
+{
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i k128 = _mm256_set1_epi16(128);
+  const __m256i round = _mm256_set1_epi32(ONE_HALF);
+  const __m256i crr = _mm256_set1_epi32(JPGD_MADD_PAIR(FIX(1.40200f)));
+  const __m256i cbb = _mm256_set1_epi32(JPGD_MADD_PAIR(FIX(1.77200f)));
+  const __m256i crg = _mm256_set1_epi32(JPGD_MADD_PAIR(-FIX(0.71414f)));
+  const __m256i cbg = _mm256_set1_epi32(JPGD_MADD_PAIR(-FIX(0.34414f)));
+
+  // Lane 0 holds the first group, lane 1 the second; every step below stays within its 128-bit lane.
+  const __m256i y16 = _mm256_cvtepu8_epi16(y);
+  const __m256i kcb = _mm256_sub_epi16(_mm256_cvtepu8_epi16(cb), k128);
+  const __m256i kcr = _mm256_sub_epi16(_mm256_cvtepu8_epi16(cr), k128);
+  const __m256i cb_lo = _mm256_unpacklo_epi16(kcb, _mm256_slli_epi16(kcb, 8)), cb_hi = _mm256_unpackhi_epi16(kcb, _mm256_slli_epi16(kcb, 8));
+  const __m256i cr_lo = _mm256_unpacklo_epi16(kcr, _mm256_slli_epi16(kcr, 8)), cr_hi = _mm256_unpackhi_epi16(kcr, _mm256_slli_epi16(kcr, 8));
+
+  const __m256i rc = _mm256_packs_epi32(
+    _mm256_srai_epi32(_mm256_add_epi32(_mm256_madd_epi16(cr_lo, crr), round), SCALEBITS),
+    _mm256_srai_epi32(_mm256_add_epi32(_mm256_madd_epi16(cr_hi, crr), round), SCALEBITS));
+  const __m256i gc = _mm256_packs_epi32(
+    _mm256_srai_epi32(_mm256_add_epi32(_mm256_add_epi32(_mm256_madd_epi16(cr_lo, crg), _mm256_madd_epi16(cb_lo, cbg)), round), SCALEBITS),
+    _mm256_srai_epi32(_mm256_add_epi32(_mm256_add_epi32(_mm256_madd_epi16(cr_hi, crg), _mm256_madd_epi16(cb_hi, cbg)), round), SCALEBITS));
+  const __m256i bc = _mm256_packs_epi32(
+    _mm256_srai_epi32(_mm256_add_epi32(_mm256_madd_epi16(cb_lo, cbb), round), SCALEBITS),
+    _mm256_srai_epi32(_mm256_add_epi32(_mm256_madd_epi16(cb_hi, cbb), round), SCALEBITS));
+
+  const __m256i r = _mm256_packus_epi16(_mm256_add_epi16(y16, rc), zero);
+  const __m256i g = _mm256_packus_epi16(_mm256_add_epi16(y16, gc), zero);
+  const __m256i b = _mm256_packus_epi16(_mm256_add_epi16(y16, bc), zero);
+
+  const __m256i rg = _mm256_unpacklo_epi8(r, g);
+  const __m256i ba = _mm256_unpacklo_epi8(b, _mm256_set1_epi8(-1));
+  const __m256i lo = _mm256_unpacklo_epi16(rg, ba), hi = _mm256_unpackhi_epi16(rg, ba);
+  _mm256_storeu_si256(reinterpret_cast<__m256i*>(pDst0), _mm256_permute2x128_si256(lo, hi, 0x20));
+  _mm256_storeu_si256(reinterpret_cast<__m256i*>(pDst1), _mm256_permute2x128_si256(lo, hi, 0x31));
+}
+
+static inline __m128i load8(const uint8* p) { return _mm_loadl_epi64(reinterpret_cast<const __m128i*>(p)); }
+
+// Loads 4 chroma samples and point samples them up to 8.
+static inline __m128i load4_dup(const uint8* p) { const __m128i c = _mm_cvtsi32_si128(*(const int *)p); return _mm_unpacklo_epi8(c, c); }
+
+// Group g of a row of 1:1 sampled YCbCr: 8 Y samples, with its chroma at +cb_ofs/+cr_ofs.
+static inline const uint8* ycc_group(const uint8* s, int g, int groups_per_mcu, int mcu_stride)
+{
+  return s + (g / groups_per_mcu) * mcu_stride + (g % groups_per_mcu) * 64;
+}
+
+// Converts pairs of groups, returns the number of groups done.
+static JPGD_AVX2_FUNC int convert_ycc_groups_avx2(const uint8* s, int group_count, int groups_per_mcu, int mcu_stride, int cb_ofs, int cr_ofs, uint8* d)
+{
+  int g = 0;
+  for ( ; g + 2 <= group_count; g += 2)
+  {
+    const uint8* s0 = ycc_group(s, g, groups_per_mcu, mcu_stride);
+    const uint8* s1 = ycc_group(s, g + 1, groups_per_mcu, mcu_stride);
+    ycc_to_rgba_avx2(
+      _mm_unpacklo_epi64(load8(s0), load8(s1)),
+      _mm_unpacklo_epi64(load8(s0 + cb_ofs), load8(s1 + cb_ofs)),
+      _mm_unpacklo_epi64(load8(s0 + cr_ofs), load8(s1 + cr_ofs)),
+      d + g * 32, d + g * 32 + 32);
+  }
+  return g;
+}
+
+// Converts a row of 1:1 sampled YCbCr (H1V1, or H2V2 after freq. domain upsampling) to RGBA.
+static void convert_ycc_groups(int simd_level, const uint8* s, int group_count, int groups_per_mcu, int mcu_stride, int cb_ofs, int cr_ofs, uint8* d)
+{
+  int g = 0;
+  if (simd_level == JPGD_SIMD_AVX2)
+    g = convert_ycc_groups_avx2(s, group_count, groups_per_mcu, mcu_stride, cb_ofs, cr_ofs, d);
+  for ( ; g < group_count; g++)
+  {
+    const uint8* s0 = ycc_group(s, g, groups_per_mcu, mcu_stride);
+    ycc_to_rgba_sse2(load8(s0), load8(s0 + cb_ofs), load8(s0 + cr_ofs), d + g * 32);
+  }
+}
+#endif // JPGD_USE_SIMD
+
 // YCbCr H1V1 (1x1:1:1, 3 m_blocks per MCU) to RGB
 void jpeg_decoder::H1V1Convert()
 {
@@ -1871,6 +2356,14 @@ void jpeg_decoder::H1V1Convert()
   uint8 *d = m_pScan_line_0;
   uint8 *s = m_pSample_buf + row * 8;
 
+#if JPGD_USE_SIMD
+  if (m_simd_level != JPGD_SIMD_NONE)
+  {
+    convert_ycc_groups(m_simd_level, s, m_max_mcus_per_row, 1, 64*3, 64, 128, d);
+    return;
+  }
+#endif
+
   for (int i = m_max_mcus_per_row; i > 0; i--)
   {
     for (int j = 0; j < 8; j++)
@@ -1899,6 +2392,21 @@ void jpeg_decoder::H2V1Convert()
   uint8 *y = m_pSample_buf + row * 8;
   uint8 *c = m_pSample_buf + 2*64 + row * 8;
 
+#if JPGD_USE_SIMD
+  if (m_simd_level != JPGD_SIMD_NONE)
+  {
+    for (int i = m_max_mcus_per_row; i > 0; i--)
+    {
+      ycc_to_rgba_sse2(load8(y), load4_dup(c), load4_dup(c + 64), d0);
+      ycc_to_rgba_sse2(load8(y + 64), load4_dup(c + 4), load4_dup(c + 64 + 4), d0 + 32);
+      d0 += 64;
+      y += 64*4;
+      c += 64*4;
+    }
+    return;
+  }
+#endif
+
   for (int i = m_max_mcus_per_row; i > 0; i--)
   {
     for (int l = 0; l < 2; l++)
@@ -1952,6 +2460,23 @@ void jpeg_decoder::H1V2Convert()
 
   c = m_pSample_buf + 64*2 + (row >> 1) * 8;
 
+#if JPGD_USE_SIMD
+  if (m_simd_level != JPGD_SIMD_NONE)
+  {
+    for (int i = m_max_mcus_per_row; i > 0; i--)
+    {
+      const __m128i cb = load8(c), cr = load8(c + 64);
+      ycc_to_rgba_sse2(load8(y), cb, cr, d0);
+      ycc_to_rgba_sse2(load8(y + 8), cb, cr, d1);
+      d0 += 32;
+      d1 += 32;
+      y += 64*4;
+      c += 64*4;
+    }
+    return;
+  }
+#endif
+
   for (int i = m_max_mcus_per_row; i > 0; i--)
   {
     for (int j = 0; j < 8; j++)
@@ -2000,6 +2525,26 @@ void jpeg_decoder::H2V2Convert()
 
 	c = m_pSample_buf + 64*4 + (row >> 1) * 8;
 
+#if JPGD_USE_SIMD
+	if (m_simd_level != JPGD_SIMD_NONE)
+	{
+		for (int i = m_max_mcus_per_row; i > 0; i--)
+		{
+			for (int l = 0; l < 2; l++)
+			{
+				const __m128i cb = load4_dup(c + l*4), cr = load4_dup(c + 64 + l*4);
+				ycc_to_rgba_sse2(load8(y + l*64), cb, cr, d0);
+				ycc_to_rgba_sse2(load8(y + l*64 + 8), cb, cr, d1);
+				d0 += 32;
+				d1 += 32;
+			}
+			y += 64*6;
+			c += 64*6;
+		}
+		return;
+	}
+#endif
+
 	for (int i = m_max_mcus_per_row; i > 0; i--)
 	{
 		for (int l = 0; l < 2; l++)
@@ -2067,6 +2612,57 @@ void jpeg_decoder::gray_convert()
   }
 }
 
+// Scaled Y or YCbCr (any supported sampling factors) to 8-bit grayscale or RGB.
+// See transform_mcu_scaled() for the chroma layout, H2V1 and H1V2 chroma is averaged in pairs along the unsubsampled axis.
+void jpeg_decoder::scaled_convert()
+{
+  const int n = 8 >> m_scale_shift;
+  const int row = (m_max_mcu_y_size >> m_scale_shift) - m_mcu_lines_left;
+  uint8 *d = m_pScan_line_0;
+
+  if (m_scan_type == JPGD_GRAYSCALE)
+  {
+    const uint8 *s = m_pSample_buf + row * n;
+
+    for (int i = m_max_mcus_per_row; i > 0; i--)
+    {
+      memcpy(d, s, n);
+      s += 64;
+      d += n;
+    }
+    return;
+  }
+
+  const int h = m_comp_h_samp[0], v = m_comp_v_samp[0];
+  const int cn = (h * v > 1) ? (n * 2) : n;
+  const int cx_step = (cn > h * n) ? 1 : 0;
+  const int cy_step = (cn > v * n) ? cn : 0;
+  const uint8 *y = m_pSample_buf + (row / n) * h * 64 + (row % n) * n;
+  const uint8 *c = m_pSample_buf + h * v * 64 + ((row * cn) / (v * n)) * cn;
+
+  for (int i = m_max_mcus_per_row; i > 0; i--)
+  {
+    for (int x = 0; x < h * n; x++)
+    {
+      const uint8 *cb_ptr = c + (x * cn) / (h * n);
+      const uint8 *cr_ptr = cb_ptr + 64;
+      int yy = y[(x / n) * 64 + (x % n)];
+      int cb = (cb_ptr[0] + cb_ptr[cx_step] + cb_ptr[cy_step] + cb_ptr[cx_step + cy_step] + 2) >> 2;
+      int cr = (cr_ptr[0] + cr_ptr[cx_step] + cr_ptr[cy_step] + cr_ptr[cx_step + cy_step] + 2) >> 2;
+
+      d[0] = clamp(yy + m_crr[cr]);
+      d[1] = clamp(yy + ((m_crg[cr] + m_cbg[cb]) >> 16));
+      d[2] = clamp(yy + m_cbb[cb]);
+      d[3] = 255;
+
+      d += 4;
+    }
+
+    y += m_blocks_per_mcu * 64;
+    c += m_blocks_per_mcu * 64;
+  }
+}
+
 void jpeg_decoder::expanded_convert()
 {
   int row = m_max_mcu_y_size - m_mcu_lines_left;
@@ -2075,6 +2671,15 @@ void jpeg_decoder::expanded_convert()
 
   uint8* d = m_pScan_line_0;
 
+#if JPGD_USE_SIMD
+  if (m_simd_level != JPGD_SIMD_NONE)
+  {
+    convert_ycc_groups(m_simd_level, Py, m_max_mcus_per_row * (m_max_mcu_x_size >> 3), m_max_mcu_x_size >> 3,
+      64 * m_expanded_blocks_per_mcu, 64 * m_expanded_blocks_per_component, 64 * m_expanded_blocks_per_component * 2, d);
+    return;
+  }
+#endif
+
   for (int i = m_max_mcus_per_row; i > 0; i--)
   {
     for (int k = 0; k < m_max_mcu_x_size; k += 8)
@@ -2140,13 +2745,18 @@ int jpeg_decoder::decode(const void** pScan_line, uint* pScan_line_len)
       decode_next_row();
 
     // Find the EOI marker if that was the last row.
-    if (m_total_lines_left <= m_max_mcu_y_size)
+    if (m_total_lines_left <= (m_max_mcu_y_size >> m_scale_shift))
       find_eoi();
 
-    m_mcu_lines_left = m_max_mcu_y_size;
+    m_mcu_lines_left = m_max_mcu_y_size >> m_scale_shift;
   }
 
-  if (m_freq_domain_chroma_upsample)
+  if (m_scale_shift)
+  {
+    scaled_convert();
+    *pScan_line = m_pScan_line_0;
+  }
+  else if (m_freq_domain_chroma_upsample)
   {
     expanded_convert();
     *pScan_line = m_pScan_line_0;
@@ -2531,7 +3141,7 @@ void jpeg_decoder::init_frame()
 
   m_dest_bytes_per_scan_line = ((m_image_x_size + 15) & 0xFFF0) * m_dest_bytes_per_pixel;
 
-  m_real_dest_bytes_per_scan_line = (m_image_x_size * m_dest_bytes_per_pixel);
+  m_real_dest_bytes_per_scan_line = (get_width() * m_dest_bytes_per_pixel);
 
   // Initialize two scan line buffers.
   m_pScan_line_0 = (uint8 *)alloc(m_dest_bytes_per_scan_line, true);
@@ -2556,7 +3166,7 @@ void jpeg_decoder::init_frame()
 	// Freq. domain chroma upsampling is only supported for H2V2 subsampling factor (the most common one I've seen).
   m_freq_domain_chroma_upsample = false;
 #if JPGD_SUPPORT_FREQ_DOMAIN_UPSAMPLING
-  m_freq_domain_chroma_upsample = (m_expanded_blocks_per_mcu == 4*3);
+  m_freq_domain_chroma_upsample = (m_expanded_blocks_per_mcu == 4*3) && (m_scale_shift == 0);
 #endif
 
   if (m_freq_domain_chroma_upsample)
@@ -2564,7 +3174,7 @@ void jpeg_decoder::init_frame()
   else
     m_pSample_buf = (uint8 *)alloc(m_max_blocks_per_row * 64);
 
-  m_total_lines_left = m_image_y_size;
+  m_total_lines_left = get_height();
 
   m_mcu_lines_left = 0;
 
@@ -2929,11 +3539,31 @@ void jpeg_decoder::decode_init(jpeg_decoder_stream *pStream)
 
 jpeg_decoder::jpeg_decoder(jpeg_decoder_stream *pStream)
 {
+  m_pMem_blocks = NULL;
+  m_look_ups_created = false;
   if (setjmp(m_jmp_state))
     return;
   decode_init(pStream);
 }
 
+jpeg_decoder::jpeg_decoder()
+{
+  m_pMem_blocks = NULL;
+  m_look_ups_created = false;
+  m_pStream = NULL;
+  m_ready_flag = false;
+  m_scale_shift = 0;
+  m_error_code = JPGD_FAILED;
+}
+
+jpgd_status jpeg_decoder::reset(jpeg_decoder_stream *pStream)
+{
+  if (setjmp(m_jmp_state))
+    return m_error_code;
+  decode_init(pStream);
+  return m_error_code;
+}
+
 int jpeg_decoder::begin_decoding()
 {
   if (m_ready_flag)
@@ -2952,6 +3582,16 @@ int jpeg_decoder::begin_decoding()
   return JPGD_SUCCESS;
 }
 
+bool jpeg_decoder::set_scale(int scale_shift)
+{
+  if ((m_ready_flag) || (scale_shift < 0) || (scale_shift > 3))
+    return false;
+
+  m_scale_shift = scale_shift;
+
+  return true;
+}
+
 jpeg_decoder::~jpeg_decoder()
 {
   free_all_blocks();
@@ -3056,7 +3696,72 @@ int jpeg_decoder_mem_stream::read(uint8 *pBuf, int max_bytes_to_read, bool *pEOF
   return max_bytes_to_read;
 }
 
+// Converts one decoded scan line (8bpp grayscale or 32bpp RGBA) to req_comps components per pixel.
+static void convert_scan_line(const uint8* pScan_line, uint8* pDst, int image_width, int num_components, int req_comps)
+{
+  const int dst_bpl = image_width * req_comps;
+
+  if (((req_comps == 1) && (num_components == 1)) || ((req_comps == 4) && (num_components == 3)))
+    memcpy(pDst, pScan_line, dst_bpl);
+  else if (num_components == 1)
+  {
+    if (req_comps == 3)
+    {
+      for (int x = 0; x < image_width; x++)
+      {
+        uint8 luma = pScan_line[x];
+        pDst[0] = luma;
+        pDst[1] = luma;
+        pDst[2] = luma;
+        pDst += 3;
+      }
+    }
+    else
+    {
+      for (int x = 0; x < image_width; x++)
+      {
+        uint8 luma = pScan_line[x];
+        pDst[0] = luma;
+        pDst[1] = luma;
+        pDst[2] = luma;
+        pDst[3] = 255;
+        pDst += 4;
+      }
+    }
+  }
+  else if (num_components == 3)
+  {
+    if (req_comps == 1)
+    {
+      const int YR = 19595, YG = 38470, YB = 7471;
+      for (int x = 0; x < image_width; x++)
+      {
+        int r = pScan_line[x*4+0];
+        int g = pScan_line[x*4+1];
+        int b = pScan_line[x*4+2];
+        *pDst++ = static_cast<uint8>((r * YR + g * YG + b * YB + 32768) >> 16);
+      }
+    }
+    else
+    {
+      for (int x = 0; x < image_width; x++)
+      {
+        pDst[0] = pScan_line[x*4+0];
+        pDst[1] = pScan_line[x*4+1];
+        pDst[2] = pScan_line[x*4+2];
+        pDst += 3;
+      }
+    }
+  }
+}
+
 unsigned char *decompress_jpeg_image_from_stream(jpeg_decoder_stream *pStream, int *width, int *height, int *actual_comps, int req_comps)
+{
+  jpeg_decoder decoder;
+  return decompress_jpeg_image_from_stream(decoder, pStream, width, height, actual_comps, req_comps);
+}
+
+unsigned char *decompress_jpeg_image_from_stream(jpeg_decoder &decoder, jpeg_decoder_stream *pStream, int *width, int *height, int *actual_comps, int req_comps, int scale_shift)
 {
   if (!actual_comps)
     return NULL;
@@ -3068,8 +3773,10 @@ unsigned char *decompress_jpeg_image_from_stream(jpeg_decoder_stream *pStream, i
   if ((req_comps != 1) && (req_comps != 3) && (req_comps != 4))
     return NULL;
 
-  jpeg_decoder decoder(pStream);
-  if (decoder.get_error_code() != JPGD_SUCCESS)
+  if (decoder.reset(pStream) != JPGD_SUCCESS)
+    return NULL;
+
+  if (!decoder.set_scale(scale_shift))
     return NULL;
 
   const int image_width = decoder.get_width(), image_height = decoder.get_height();
@@ -3096,69 +3803,242 @@ unsigned char *decompress_jpeg_image_from_stream(jpeg_decoder_stream *pStream, i
       return NULL;
     }
 
-    uint8 *pDst = pImage_data + y * dst_bpl;
+    convert_scan_line(pScan_line, pImage_data + y * dst_bpl, image_width, decoder.get_num_components(), req_comps);
+  }
+
+  return pImage_data;
+}
 
-    if (((req_comps == 1) && (decoder.get_num_components() == 1)) || ((req_comps == 4) && (decoder.get_num_components() == 3)))
-      memcpy(pDst, pScan_line, dst_bpl);
-    else if (decoder.get_num_components() == 1)
+unsigned char *decompress_jpeg_image_from_memory(const unsigned char *pSrc_data, int src_data_size, int *width, int *height, int *actual_comps, int req_comps)
+{
+  jpgd::jpeg_decoder_mem_stream mem_stream(pSrc_data, src_data_size);
+  return decompress_jpeg_image_from_stream(&mem_stream, width, height, actual_comps, req_comps);
+}
+
+unsigned char *decompress_jpeg_image_from_memory(jpeg_decoder &decoder, const unsigned char *pSrc_data, int src_data_size, int *width, int *height, int *actual_comps, int req_comps)
+{
+  jpgd::jpeg_decoder_mem_stream mem_stream(pSrc_data, src_data_size);
+  return decompress_jpeg_image_from_stream(decoder, &mem_stream, width, height, actual_comps, req_comps);
+}
+
+// Restart interval parallel decoding.
+// A baseline scan can be cut at any MCU row that starts a restart interval: the DC predictors are reset there, so nothing carries over.
+// Each slice is decoded by its own jpeg_decoder, from a copy of the headers (frame height patched to the slice height), the slice's
+// entropy coded data (restart markers renumbered from RST0), and an EOI marker.
+struct jpeg_scan_layout
+{
+  int sof_ofs;              // Offset of the SOF0/SOF1 marker.
+  int scan_ofs;             // Offset of the first entropy coded byte.
+  int scan_end;             // Offset of the EOI marker ending the scan.
+  std::vector<int> rst_ofs; // Offset of each RSTn marker, rst_ofs[i] precedes restart interval i+1.
+};
+
+// Walks the markers of a single scan baseline JPEG. Returns false for anything the parallel path doesn't handle.
+static bool locate_scan_layout(const uint8* pSrc_data, int src_data_size, jpeg_scan_layout& layout)
+{
+  if ((src_data_size < 4) || (pSrc_data[0] != 0xFF) || (pSrc_data[1] != M_SOI))
+    return false;
+
+  layout.sof_ofs = -1;
+  layout.scan_ofs = -1;
+  int ofs = 2;
+  while (layout.scan_ofs < 0)
+  {
+    if ((ofs + 4 > src_data_size) || (pSrc_data[ofs] != 0xFF))
+      return false;
+
+    const int marker = pSrc_data[ofs + 1];
+    if (marker == 0xFF)
     {
-      if (req_comps == 3)
-      {
-        for (int x = 0; x < image_width; x++)
-        {
-          uint8 luma = pScan_line[x];
-          pDst[0] = luma;
-          pDst[1] = luma;
-          pDst[2] = luma;
-          pDst += 3;
-        }
-      }
-      else
-      {
-        for (int x = 0; x < image_width; x++)
-        {
-          uint8 luma = pScan_line[x];
-          pDst[0] = luma;
-          pDst[1] = luma;
-          pDst[2] = luma;
-          pDst[3] = 255;
-          pDst += 4;
-        }
-      }
+      ofs++;
+      continue;
     }
-    else if (decoder.get_num_components() == 3)
+    if ((marker == M_SOI) || (marker == M_EOI) || ((marker >= M_RST0) && (marker <= M_RST7)))
+      return false;
+
+    const int seg_len = (pSrc_data[ofs + 2] << 8) | pSrc_data[ofs + 3];
+    if ((seg_len < 2) || (ofs + 2 + seg_len > src_data_size))
+      return false;
+
+    if ((marker == M_SOF0) || (marker == M_SOF1))
     {
-      if (req_comps == 1)
-      {
-        const int YR = 19595, YG = 38470, YB = 7471;
-        for (int x = 0; x < image_width; x++)
-        {
-          int r = pScan_line[x*4+0];
-          int g = pScan_line[x*4+1];
-          int b = pScan_line[x*4+2];
-          *pDst++ = static_cast<uint8>((r * YR + g * YG + b * YB + 32768) >> 16);
-        }
-      }
-      else
-      {
-        for (int x = 0; x < image_width; x++)
-        {
-          pDst[0] = pScan_line[x*4+0];
-          pDst[1] = pScan_line[x*4+1];
-          pDst[2] = pScan_line[x*4+2];
-          pDst += 3;
-        }
-      }
+      if ((layout.sof_ofs >= 0) || (seg_len < 6))
+        return false;
+      layout.sof_ofs = ofs;
     }
+    else if ((marker >= M_SOF2) && (marker <= M_SOF15) && (marker != M_DHT) && (marker != M_JPG) && (marker != M_DAC))
+      return false;
+    else if (marker == M_SOS)
+      layout.scan_ofs = ofs + 2 + seg_len;
+
+    ofs += 2 + seg_len;
+  }
+
+  if (layout.sof_ofs < 0)
+    return false;
+
+  layout.rst_ofs.clear();
+  layout.scan_end = -1;
+  for (ofs = layout.scan_ofs; ofs + 1 < src_data_size; ofs++)
+  {
+    if (pSrc_data[ofs] != 0xFF)
+      continue;
+
+    const int c = pSrc_data[ofs + 1];
+    if (c == 0xFF)
+      continue; // fill byte
+    if (c == 0)
+      ofs++; // stuffed zero
+    else if ((c >= M_RST0) && (c <= M_RST7))
+      layout.rst_ofs.push_back(ofs++);
+    else
+    {
+      layout.scan_end = ofs;
+      break;
+    }
+  }
+
+  // Anything but EOI after the scan (DNL, more scans) goes through the serial decoder.
+  return (layout.scan_end >= 0) && (pSrc_data[layout.scan_end + 1] == M_EOI);
+}
+
+// Decodes pixel rows [y0, y1), made of restart intervals [first_interval, end_interval), into pImage_data.
+// decoder and slice_data are per thread scratch, reused from one slice to the next.
+static bool decode_restart_slice(jpeg_decoder& decoder, std::vector<uint8>& slice_data, const uint8* pSrc_data, const jpeg_scan_layout& layout, int total_intervals,
+  int first_interval, int end_interval, int y0, int y1, int image_width, int req_comps, uint8* pImage_data)
+{
+  const int data_begin = (first_interval == 0) ? layout.scan_ofs : (layout.rst_ofs[first_interval - 1] + 2);
+  const int data_end = (end_interval == total_intervals) ? layout.scan_end : layout.rst_ofs[end_interval - 1];
+  const int header_size = layout.scan_ofs;
+
+  slice_data.resize(header_size + (data_end - data_begin) + 2);
+  memcpy(&slice_data[0], pSrc_data, header_size);
+  memcpy(&slice_data[header_size], pSrc_data + data_begin, data_end - data_begin);
+  slice_data[slice_data.size() - 2] = 0xFF;
+  slice_data[slice_data.size() - 1] = M_EOI;
+
+  // SOF: FF Cx, length (2), precision (1), height (2)
+  slice_data[layout.sof_ofs + 5] = static_cast<uint8>((y1 - y0) >> 8);
+  slice_data[layout.sof_ofs + 6] = static_cast<uint8>((y1 - y0) & 0xFF);
+
+  for (int i = first_interval; i < end_interval - 1; i++)
+    slice_data[header_size + layout.rst_ofs[i] - data_begin + 1] = static_cast<uint8>(M_RST0 + ((i - first_interval) & 7));
+
+  jpeg_decoder_mem_stream mem_stream(&slice_data[0], static_cast<uint>(slice_data.size()));
+  if ((decoder.reset(&mem_stream) != JPGD_SUCCESS) || (decoder.begin_decoding() != JPGD_SUCCESS))
+    return false;
+
+  const int dst_bpl = image_width * req_comps;
+  for (int y = y0; y < y1; y++)
+  {
+    const uint8* pScan_line;
+    uint scan_line_len;
+    if (decoder.decode((const void**)&pScan_line, &scan_line_len) != JPGD_SUCCESS)
+      return false;
+
+    convert_scan_line(pScan_line, pImage_data + y * dst_bpl, image_width, decoder.get_num_components(), req_comps);
   }
 
+  return true;
+}
+
+static int gcd(int a, int b)
+{
+  while (b)
+  {
+    const int t = a % b;
+    a = b;
+    b = t;
+  }
+  return a;
+}
+
+// Returns NULL if the image can't be split, the caller then decodes it serially.
+static uint8 *decompress_restart_slices(const uint8* pSrc_data, int src_data_size, int *width, int *height, int *actual_comps, int req_comps, int max_threads)
+{
+  jpeg_scan_layout layout;
+  if (!locate_scan_layout(pSrc_data, src_data_size, layout))
+    return NULL;
+
+  jpeg_decoder_mem_stream mem_stream(pSrc_data, src_data_size);
+  jpeg_decoder decoder(&mem_stream);
+  if ((decoder.get_error_code() != JPGD_SUCCESS) || (decoder.begin_decoding() != JPGD_SUCCESS))
+    return NULL;
+  if ((decoder.is_progressive()) || (decoder.get_restart_interval() <= 0))
+    return NULL;
+
+  const int image_width = decoder.get_width(), image_height = decoder.get_height();
+  const int mcus_per_row = decoder.get_mcus_per_row(), mcu_height = decoder.get_mcu_height();
+  const int restart_interval = decoder.get_restart_interval();
+  const int mcu_rows = (image_height + mcu_height - 1) / mcu_height;
+  const int total_intervals = (mcus_per_row * mcu_rows + restart_interval - 1) / restart_interval;
+  if ((int)layout.rst_ofs.size() != total_intervals - 1)
+    return NULL;
+
+  // Slices are made of whole units of row_step MCU rows, the smallest row count that ends on a restart interval boundary.
+  const int row_step = restart_interval / gcd(restart_interval, mcus_per_row);
+  const int unit_count = (mcu_rows + row_step - 1) / row_step;
+  if (unit_count < 2)
+    return NULL;
+  const int slice_count = JPGD_MIN(unit_count, max_threads * 4);
+
+  const int dst_bpl = image_width * req_comps;
+  uint8 *pImage_data = (uint8*)jpgd_malloc(dst_bpl * image_height);
+  if (!pImage_data)
+    return NULL;
+
+  std::atomic<int> next_slice(0);
+  std::atomic<bool> failed(false);
+  auto decode_slices = [&]()
+  {
+    jpeg_decoder slice_decoder;
+    std::vector<uint8> slice_data;
+    for ( ; ; )
+    {
+      const int slice = next_slice++;
+      if ((slice >= slice_count) || (failed))
+        break;
+
+      const int row0 = ((slice * unit_count) / slice_count) * row_step;
+      const int row1 = JPGD_MIN(mcu_rows, (((slice + 1) * unit_count) / slice_count) * row_step);
+      const int first_interval = (row0 * mcus_per_row) / restart_interval;
+      const int end_interval = (row1 == mcu_rows) ? total_intervals : ((row1 * mcus_per_row) / restart_interval);
+      const int y0 = row0 * mcu_height, y1 = JPGD_MIN(image_height, row1 * mcu_height);
+
+      if (!decode_restart_slice(slice_decoder, slice_data, pSrc_data, layout, total_intervals, first_interval, end_interval, y0, y1, image_width, req_comps, pImage_data))
+        failed = true;
+    }
+  };
+
+  const int thread_count = JPGD_MIN(max_threads, slice_count);
+  std::vector<std::thread> threads;
+  for (int i = 1; i < thread_count; i++)
+    threads.push_back(std::thread(decode_slices));
+  decode_slices();
+  for (size_t i = 0; i < threads.size(); i++)
+    threads[i].join();
+
+  if (failed)
+  {
+    jpgd_free(pImage_data);
+    return NULL;
+  }
+
+  *width = image_width;
+  *height = image_height;
+  *actual_comps = decoder.get_num_components();
   return pImage_data;
 }
 
-unsigned char *decompress_jpeg_image_from_memory(const unsigned char *pSrc_data, int src_data_size, int *width, int *height, int *actual_comps, int req_comps)
+unsigned char *decompress_jpeg_image_from_memory_parallel(const unsigned char *pSrc_data, int src_data_size, int *width, int *height, int *actual_comps, int req_comps, int max_threads)
 {
-  jpgd::jpeg_decoder_mem_stream mem_stream(pSrc_data, src_data_size);
-  return decompress_jpeg_image_from_stream(&mem_stream, width, height, actual_comps, req_comps);
+  if ((max_threads > 1) && (pSrc_data) && (width) && (height) && (actual_comps) && ((req_comps == 1) || (req_comps == 3) || (req_comps == 4)))
+  {
+    uint8 *pImage_data = decompress_restart_slices(pSrc_data, src_data_size, width, height, actual_comps, req_comps, max_threads);
+    if (pImage_data)
+      return pImage_data;
+  }
+  return decompress_jpeg_image_from_memory(pSrc_data, src_data_size, width, height, actual_comps, req_comps);
 }
 
 unsigned char *decompress_jpeg_image_from_file(const char *pSrc_filename, int *width, int *height, int *actual_comps, int req_comps)
@@ -3169,4 +4049,28 @@ unsigned char *decompress_jpeg_image_from_file(const char *pSrc_filename, int *w
   return decompress_jpeg_image_from_stream(&file_stream, width, height, actual_comps, req_comps);
 }
 
+unsigned char *decompress_jpeg_image_from_file(jpeg_decoder &decoder, const char *pSrc_filename, int *width, int *height, int *actual_comps, int req_comps)
+{
+  jpgd::jpeg_decoder_file_stream file_stream;
+  if (!file_stream.open(pSrc_filename))
+    return NULL;
+  return decompress_jpeg_image_from_stream(decoder, &file_stream, width, height, actual_comps, req_comps);
+}
+
+unsigned char *decompress_jpeg_image_from_memory_scaled(const unsigned char *pSrc_data, int src_data_size, int *width, int *height, int *actual_comps, int req_comps, int scale_shift)
+{
+  jpgd::jpeg_decoder_mem_stream mem_stream(pSrc_data, src_data_size);
+  jpeg_decoder decoder;
+  return decompress_jpeg_image_from_stream(decoder, &mem_stream, width, height, actual_comps, req_comps, scale_shift);
+}
+
+unsigned char *decompress_jpeg_image_from_file_scaled(const char *pSrc_filename, int *width, int *height, int *actual_comps, int req_comps, int scale_shift)
+{
+  jpgd::jpeg_decoder_file_stream file_stream;
+  if (!file_stream.open(pSrc_filename))
+    return NULL;
+  jpeg_decoder decoder;
+  return decompress_jpeg_image_from_stream(decoder, &file_stream, width, height, actual_comps, req_comps, scale_shift);
+}
+
 } // namespace jpgd
\ No newline at end of file
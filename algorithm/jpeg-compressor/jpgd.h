@@ -23,6 +23,8 @@ namespace jpgd
   typedef unsigned int   uint;
   typedef   signed int   int32;
 
+  class jpeg_decoder;
+
   // Loads a JPEG image from a memory buffer or a file.
   // req_comps can be 1 (grayscale), 3 (RGB), or 4 (RGBA).
   // On return, width/height will be set to the image's dimensions, and actual_comps will be set to the either 1 (grayscale) or 3 (RGB).
@@ -31,6 +33,20 @@ namespace jpgd
   unsigned char *decompress_jpeg_image_from_memory(const unsigned char *pSrc_data, int src_data_size, int *width, int *height, int *actual_comps, int req_comps);
   unsigned char *decompress_jpeg_image_from_file(const char *pSrc_filename, int *width, int *height, int *actual_comps, int req_comps);
 
+  // Same as above, but decodes with a caller-owned jpeg_decoder, which keeps its memory blocks and lookup tables from one image to the next.
+  // Use these when decoding many images in a row. The decoder must not be used by more than one thread at a time.
+  unsigned char *decompress_jpeg_image_from_memory(jpeg_decoder &decoder, const unsigned char *pSrc_data, int src_data_size, int *width, int *height, int *actual_comps, int req_comps);
+  unsigned char *decompress_jpeg_image_from_file(jpeg_decoder &decoder, const char *pSrc_filename, int *width, int *height, int *actual_comps, int req_comps);
+
+  // Same as decompress_jpeg_image_from_memory(), but decodes at 1/2, 1/4 or 1/8 of the full size (scale_shift 1, 2 or 3) straight from the DCT coefficients,
+  // which is much cheaper than decoding at full size and downsampling. width/height are set to the scaled dimensions, rounded up.
+  unsigned char *decompress_jpeg_image_from_memory_scaled(const unsigned char *pSrc_data, int src_data_size, int *width, int *height, int *actual_comps, int req_comps, int scale_shift);
+  unsigned char *decompress_jpeg_image_from_file_scaled(const char *pSrc_filename, int *width, int *height, int *actual_comps, int req_comps, int scale_shift);
+
+  // Same as decompress_jpeg_image_from_memory(), but baseline images with restart markers (DRI) are split at restart intervals and decoded on up to max_threads threads.
+  // Images without restart markers, progressive images, or max_threads <= 1 are decoded serially. The output is identical either way.
+  unsigned char *decompress_jpeg_image_from_memory_parallel(const unsigned char *pSrc_data, int src_data_size, int *width, int *height, int *actual_comps, int req_comps, int max_threads);
+
   // Success/failure error codes.
   enum jpgd_status
   {
@@ -44,6 +60,14 @@ namespace jpgd
     JPGD_UNSUPPORTED_SAMP_FACTORS, JPGD_DECODE_ERROR, JPGD_BAD_RESTART_MARKER, JPGD_ASSERTION_ERROR,
     JPGD_BAD_SOS_SPECTRAL, JPGD_BAD_SOS_SUCCESSIVE, JPGD_STREAM_READ, JPGD_NOTENOUGHMEM
   };
+
+  // Instruction set used for the IDCT and YCbCr->RGB conversion. The best one the CPU supports is selected at startup;
+  // every level produces bit-identical output.
+  enum jpgd_simd_level { JPGD_SIMD_NONE = 0, JPGD_SIMD_SSE2, JPGD_SIMD_AVX2 };
+
+  // Changes the level used by decoders constructed afterwards (clamped to what the CPU supports), and returns the level actually selected.
+  jpgd_simd_level set_simd_level(jpgd_simd_level level);
+  jpgd_simd_level get_simd_level();
     
   // Input stream interface.
   // Derive from this class to read input data from sources other than files or memory. Set m_eof_flag to true when no more data is available.
@@ -105,6 +129,7 @@ namespace jpgd
 
   // Loads JPEG file from a jpeg_decoder_stream.
   unsigned char *decompress_jpeg_image_from_stream(jpeg_decoder_stream *pStream, int *width, int *height, int *actual_comps, int req_comps);
+  unsigned char *decompress_jpeg_image_from_stream(jpeg_decoder &decoder, jpeg_decoder_stream *pStream, int *width, int *height, int *actual_comps, int req_comps, int scale_shift = 0);
 
   enum 
   { 
@@ -122,12 +147,24 @@ namespace jpgd
     // methods after the constructor is called. You may then either destruct the object, or begin decoding the image by calling begin_decoding(), then decode() on each scanline.
     jpeg_decoder(jpeg_decoder_stream *pStream);
 
+    // Constructs an idle decoder, call reset() to give it a stream.
+    jpeg_decoder();
+
     ~jpeg_decoder();
 
+    // Starts over on a new stream, like constructing a new decoder, but keeps the memory blocks allocated for previous images and reuses them.
+    // Returns the new error code (see get_error_code()).
+    jpgd_status reset(jpeg_decoder_stream *pStream);
+
     // Call this method after constructing the object to begin decompression.
     // If JPGD_SUCCESS is returned you may then call decode() on each scanline.
     int begin_decoding();
 
+    // Decodes at 1/2, 1/4 or 1/8 of the full size (scale_shift 1, 2 or 3) using reduced IDCTs, 0 decodes at full size.
+    // Must be called before begin_decoding(); get_width(), get_height() and decode() then all refer to the scaled image.
+    // Returns false if decoding has already begun or scale_shift is out of range.
+    bool set_scale(int scale_shift);
+
     // Returns the next scan line.
     // For grayscale images, pScan_line will point to a buffer containing 8-bit pixels (get_bytes_per_pixel() will return 1). 
     // Otherwise, it will always point to a buffer containing 32-bit RGBA pixels (A will always be 255, and get_bytes_per_pixel() will return 4).
@@ -138,16 +175,23 @@ namespace jpgd
     
     inline jpgd_status get_error_code() const { return m_error_code; }
 
-    inline int get_width() const { return m_image_x_size; }
-    inline int get_height() const { return m_image_y_size; }
+    inline int get_width() const { return (m_image_x_size + (1 << m_scale_shift) - 1) >> m_scale_shift; }
+    inline int get_height() const { return (m_image_y_size + (1 << m_scale_shift) - 1) >> m_scale_shift; }
+    inline int get_scale() const { return m_scale_shift; }
 
     inline int get_num_components() const { return m_comps_in_frame; }
 
     inline int get_bytes_per_pixel() const { return m_dest_bytes_per_pixel; }
-    inline int get_bytes_per_scan_line() const { return m_image_x_size * get_bytes_per_pixel(); }
+    inline int get_bytes_per_scan_line() const { return get_width() * get_bytes_per_pixel(); }
 
     // Returns the total number of bytes actually consumed by the decoder (which should equal the actual size of the JPEG file).
     inline int get_total_bytes_read() const { return m_total_bytes_read; }
+
+    // Scan layout, valid after begin_decoding(). The restart interval is in MCUs (0 if the image has no restart markers).
+    inline bool is_progressive() const { return m_progressive_flag != 0; }
+    inline int get_restart_interval() const { return m_restart_interval; }
+    inline int get_mcus_per_row() const { return m_max_mcus_per_row; }
+    inline int get_mcu_height() const { return m_max_mcu_y_size; }
     
   private:
     jpeg_decoder(const jpeg_decoder &);
@@ -240,15 +284,18 @@ namespace jpgd
     int m_expanded_blocks_per_row;
     int m_expanded_blocks_per_component;
     bool  m_freq_domain_chroma_upsample;
+    int m_scale_shift;                            // output is 1 / (1 << m_scale_shift) of the full size
     int m_max_mcus_per_col;
     uint m_last_dc_val[JPGD_MAX_COMPONENTS];
     jpgd_block_t* m_pMCU_coefficients;
     int m_mcu_block_max_zag[JPGD_MAX_BLOCKS_PER_MCU];
     uint8* m_pSample_buf;
+    bool m_look_ups_created;
     int m_crr[256];
     int m_cbb[256];
     int m_crg[256];
     int m_cbg[256];
+    jpgd_simd_level m_simd_level;
     uint8* m_pScan_line_0;
     uint8* m_pScan_line_1;
     jpgd_status m_error_code;
@@ -276,6 +323,7 @@ namespace jpgd
     void fix_in_buffer();
     void transform_mcu(int mcu_row);
     void transform_mcu_expand(int mcu_row);
+    void transform_mcu_scaled(int mcu_row);
     coeff_buf* coeff_buf_open(int block_num_x, int block_num_y, int block_len_x, int block_len_y);
     inline jpgd_block_t *coeff_buf_getp(coeff_buf *cb, int block_x, int block_y);
     void load_next_row();
@@ -298,6 +346,7 @@ namespace jpgd
     void H1V1Convert();
     void gray_convert();
     void expanded_convert();
+    void scaled_convert();
     void find_eoi();
     inline uint get_char();
     inline uint get_char(bool *pPadding_flag);
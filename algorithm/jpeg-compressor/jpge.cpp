@@ -14,16 +14,94 @@
 #include <string.h>
 #include <malloc.h>
 
+#include <atomic>
+#include <thread>
+#include <vector>
+
 #define JPGE_MAX(a,b) (((a)>(b))?(a):(b))
 #define JPGE_MIN(a,b) (((a)<(b))?(a):(b))
 
+// Set to 1 to use SSE2/AVX2 for RGB->YCbCr conversion, the forward DCT and quantization on x86 (the instruction set is picked at runtime).
+// The SIMD paths produce exactly the same compressed bytes as the scalar code.
+#ifndef JPGE_USE_SIMD
+  #if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__))
+    #define JPGE_USE_SIMD 1
+  #else
+    #define JPGE_USE_SIMD 0
+  #endif
+#endif
+
+#if JPGE_USE_SIMD
+  #include <emmintrin.h>
+  #include <immintrin.h>
+  #ifdef _MSC_VER
+    #include <intrin.h>
+    #define JPGE_AVX2_FUNC
+  #else
+    #include <cpuid.h>
+    #define JPGE_AVX2_FUNC __attribute__((target("avx2")))
+  #endif
+#endif
+
 namespace jpge {
 
 static inline void *jpge_malloc(size_t nSize) { return malloc(nSize); }
 static inline void jpge_free(void *p) { free(p); }
 
+
+#if JPGE_USE_SIMD
+static simd_level_t detect_simd_level()
+{
+  int regs[4] = { 0, 0, 0, 0 };
+#ifdef _MSC_VER
+  __cpuid(regs, 0);
+  const int max_leaf = regs[0];
+  __cpuid(regs, 1);
+#else
+  const int max_leaf = (int)__get_cpuid_max(0, NULL);
+  __cpuid(1, regs[0], regs[1], regs[2], regs[3]);
+#endif
+  if ((regs[3] & (1 << 26)) == 0)
+    return SIMD_NONE;
+
+  // AVX2 also needs the OS to save the YMM registers (OSXSAVE + XCR0 bits 1 and 2).
+  const bool os_avx = ((regs[2] & (1 << 27)) != 0) && ((regs[2] & (1 << 28)) != 0);
+  if ((!os_avx) || (max_leaf < 7))
+    return SIMD_SSE2;
+#ifdef _MSC_VER
+  const unsigned long long xcr0 = _xgetbv(0);
+  __cpuidex(regs, 7, 0);
+#else
+  uint xcr0_lo, xcr0_hi;
+  __asm__ volatile ("xgetbv" : "=a" (xcr0_lo), "=d" (xcr0_hi) : "c" (0));
+  const unsigned long long xcr0 = xcr0_lo;
+  __cpuid_count(7, 0, regs[0], regs[1], regs[2], regs[3]);
+#endif
+  if (((xcr0 & 6) == 6) && ((regs[1] & (1 << 5)) != 0))
+    return SIMD_AVX2;
+  return SIMD_SSE2;
+}
+
+static const simd_level_t g_cpu_simd_level = detect_simd_level();
+#else
+static const simd_level_t g_cpu_simd_level = SIMD_NONE;
+#endif
+
+static simd_level_t g_simd_level = g_cpu_simd_level;
+
+simd_level_t set_simd_level(simd_level_t level)
+{
+  g_simd_level = (simd_level_t)JPGE_MIN((int)level, (int)g_cpu_simd_level);
+  return g_simd_level;
+}
+
+simd_level_t get_simd_level()
+{
+  return g_simd_level;
+}
+
 // Various JPEG enums and tables.
-enum { M_SOF0 = 0xC0, M_DHT = 0xC4, M_SOI = 0xD8, M_EOI = 0xD9, M_SOS = 0xDA, M_DQT = 0xDB, M_APP0 = 0xE0 };
+enum { M_SOF0 = 0xC0, M_DHT = 0xC4, M_RST0 = 0xD0, M_SOI = 0xD8, M_EOI = 0xD9, M_SOS = 0xDA, M_DQT = 0xDB, M_DRI = 0xDD, M_APP0 = 0xE0 };
 enum { DC_LUM_CODES = 12, AC_LUM_CODES = 256, DC_CHROMA_CODES = 12, AC_CHROMA_CODES = 256, MAX_HUFF_SYMBOLS = 257, MAX_HUFF_CODESIZE = 32 };
 
 static uint8 s_zag[64] = { 0,1,8,16,9,2,3,10,17,24,32,25,18,11,4,5,12,19,26,33,40,48,41,34,27,20,13,6,7,14,21,28,35,42,49,56,57,50,43,36,29,22,15,23,30,37,44,51,58,59,52,45,38,31,39,46,53,60,61,54,47,55,62,63 };
@@ -138,6 +216,334 @@ static void DCT2D(int32 *p)
   }
 }
 
+#if JPGE_USE_SIMD
+// SIMD forward DCT. DCT_MUL() truncates its input to 16 bits, which is exactly what madd does against a (c, 0) pair,
+// so both passes evaluate the same integer expressions as DCT1D, lane-wise.
+#define JPGE_SIMD_DCT1D(T, ADD, SUB, MUL, s, o) \
+  { \
+    const T t0 = ADD(s[0], s[7]), t7 = SUB(s[0], s[7]), t1 = ADD(s[1], s[6]), t6 = SUB(s[1], s[6]); \
+    const T t2 = ADD(s[2], s[5]), t5 = SUB(s[2], s[5]), t3 = ADD(s[3], s[4]), t4 = SUB(s[3], s[4]); \
+    const T t10 = ADD(t0, t3), t13 = SUB(t0, t3), t11 = ADD(t1, t2), t12 = SUB(t1, t2); \
+    const T z1 = MUL(ADD(t12, t13), 4433); \
+    o[2] = ADD(z1, MUL(t13, 6270)); \
+    o[6] = ADD(z1, MUL(t12, -15137)); \
+    const T u1 = ADD(t4, t7), u2 = ADD(t5, t6), u3 = ADD(t4, t6), u4 = ADD(t5, t7); \
+    const T z5 = MUL(ADD(u3, u4), 9633); \
+    const T m4 = MUL(t4, 2446), m5 = MUL(t5, 16819), m6 = MUL(t6, 25172), m7 = MUL(t7, 12299); \
+    const T n1 = MUL(u1, -7373), n2 = MUL(u2, -20995), n3 = ADD(MUL(u3, -16069), z5), n4 = ADD(MUL(u4, -3196), z5); \
+    o[0] = ADD(t10, t11); o[4] = SUB(t10, t11); \
+    o[1] = ADD(ADD(m7, n1), n4); o[3] = ADD(ADD(m6, n2), n3); \
+    o[5] = ADD(ADD(m5, n2), n4); o[7] = ADD(ADD(m4, n1), n3); \
+  }
+
+#define JPGE_SSE2_DCT_MUL(x, c) _mm_madd_epi16(x, _mm_set1_epi32((c) & 0xFFFF))
+#define JPGE_AVX2_DCT_MUL(x, c) _mm256_madd_epi16(x, _mm256_set1_epi32((c) & 0xFFFF))
+
+static inline void transpose4x4_sse2(__m128i& r0, __m128i& r1, __m128i& r2, __m128i& r3)
+{
+  const __m128i t0 = _mm_unpacklo_epi32(r0, r1), t1 = _mm_unpacklo_epi32(r2, r3);
+  const __m128i t2 = _mm_unpackhi_epi32(r0, r1), t3 = _mm_unpackhi_epi32(r2, r3);
+  r0 = _mm_unpacklo_epi64(t0, t1); r1 = _mm_unpackhi_epi64(t0, t1);
+  r2 = _mm_unpacklo_epi64(t2, t3); r3 = _mm_unpackhi_epi64(t2, t3);
+}
+
+static inline void dct1d_sse2(const __m128i* s, __m128i* o)
+{
+  JPGE_SIMD_DCT1D(__m128i, _mm_add_epi32, _mm_sub_epi32, JPGE_SSE2_DCT_MUL, s, o)
+}
+
+static void DCT2D_sse2(int32 *p)
+{
+  const __m128i row_round = _mm_set1_epi32(1 << (CONST_BITS-ROW_BITS-1));
+  const __m128i col_round_even = _mm_set1_epi32(1 << (ROW_BITS+3-1)), col_round_odd = _mm_set1_epi32(1 << (CONST_BITS+ROW_BITS+3-1));
+
+  // rows[h][i]: columns 4h..4h+3 of row i, after the row pass.
+  __m128i rows[2][8];
+  for (int half = 0; half < 2; half++)
+  {
+    __m128i s[8], o[8];
+    for (int i = 0; i < 4; i++)
+    {
+      s[i] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + (half * 4 + i) * 8));
+      s[i + 4] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + (half * 4 + i) * 8 + 4));
+    }
+    transpose4x4_sse2(s[0], s[1], s[2], s[3]);
+    transpose4x4_sse2(s[4], s[5], s[6], s[7]);
+
+    dct1d_sse2(s, o);
+    for (int k = 0; k < 8; k++)
+      o[k] = ((k & 3) == 0) ? _mm_slli_epi32(o[k], ROW_BITS) : _mm_srai_epi32(_mm_add_epi32(o[k], row_round), CONST_BITS-ROW_BITS);
+
+    transpose4x4_sse2(o[0], o[1], o[2], o[3]);
+    transpose4x4_sse2(o[4], o[5], o[6], o[7]);
+    for (int i = 0; i < 4; i++)
+    {
+      rows[0][half * 4 + i] = o[i];
+      rows[1][half * 4 + i] = o[i + 4];
+    }
+  }
+
+  for (int half = 0; half < 2; half++)
+  {
+    __m128i o[8];
+    dct1d_sse2(rows[half], o);
+    for (int k = 0; k < 8; k++)
+    {
+      const __m128i c = ((k & 3) == 0) ? _mm_srai_epi32(_mm_add_epi32(o[k], col_round_even), ROW_BITS+3) : _mm_srai_epi32(_mm_add_epi32(o[k], col_round_odd), CONST_BITS+ROW_BITS+3);
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(p + k * 8 + half * 4), c);
+    }
+  }
+}
+
+static JPGE_AVX2_FUNC inline void transpose8x8_avx2(__m256i* r)
+{
+  const __m256i t0 = _mm256_unpacklo_epi32(r[0], r[1]), t1 = _mm256_unpackhi_epi32(r[0], r[1]);
+  const __m256i t2 = _mm256_unpacklo_epi32(r[2], r[3]), t3 = _mm256_unpackhi_epi32(r[2], r[3]);
+  const __m256i t4 = _mm256_unpacklo_epi32(r[4], r[5]), t5 = _mm256_unpackhi_epi32(r[4], r[5]);
+  const __m256i t6 = _mm256_unpacklo_epi32(r[6], r[7]), t7 = _mm256_unpackhi_epi32(r[6], r[7]);
+  const __m256i u0 = _mm256_unpacklo_epi64(t0, t2), u1 = _mm256_unpackhi_epi64(t0, t2);
+  const __m256i u2 = _mm256_unpacklo_epi64(t1, t3), u3 = _mm256_unpackhi_epi64(t1, t3);
+  const __m256i u4 = _mm256_unpacklo_epi64(t4, t6), u5 = _mm256_unpackhi_epi64(t4, t6);
+  const __m256i u6 = _mm256_unpacklo_epi64(t5, t7), u7 = _mm256_unpackhi_epi64(t5, t7);
+  r[0] = _mm256_permute2x128_si256(u0, u4, 0x20); r[4] = _mm256_permute2x128_si256(u0, u4, 0x31);
+  r[1] = _mm256_permute2x128_si256(u1, u5, 0x20); r[5] = _mm256_permute2x128_si256(u1, u5, 0x31);
+  r[2] = _mm256_permute2x128_si256(u2, u6, 0x20); r[6] = _mm256_permute2x128_si256(u2, u6, 0x31);
+  r[3] = _mm256_permute2x128_si256(u3, u7, 0x20); r[7] = _mm256_permute2x128_si256(u3, u7, 0x31);
+}
+
+static JPGE_AVX2_FUNC inline void dct1d_avx2(const __m256i* s, __m256i* o)
+{
+  JPGE_SIMD_DCT1D(__m256i, _mm256_add_epi32, _mm256_sub_epi32, JPGE_AVX2_DCT_MUL, s, o)
+}
+
+static JPGE_AVX2_FUNC void DCT2D_avx2(int32 *p)
+{
+  const __m256i row_round = _mm256_set1_epi32(1 << (CONST_BITS-ROW_BITS-1));
+  const __m256i col_round_even = _mm256_set1_epi32(1 << (ROW_BITS+3-1)), col_round_odd = _mm256_set1_epi32(1 << (CONST_BITS+ROW_BITS+3-1));
+
+  __m256i s[8], o[8];
+  for (int i = 0; i < 8; i++)
+    s[i] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i * 8));
+
+  // Row pass: one vector per column, lanes are rows.
+  transpose8x8_avx2(s);
+  dct1d_avx2(s, o);
+  for (int k = 0; k < 8; k++)
+    o[k] = ((k & 3) == 0) ? _mm256_slli_epi32(o[k], ROW_BITS) : _mm256_srai_epi32(_mm256_add_epi32(o[k], row_round), CONST_BITS-ROW_BITS);
+
+  // Column pass: one vector per row, lanes are columns.
+  transpose8x8_avx2(o);
+  dct1d_avx2(o, s);
+  for (int k = 0; k < 8; k++)
+  {
+    const __m256i c = ((k & 3) == 0) ? _mm256_srai_epi32(_mm256_add_epi32(s[k], col_round_even), ROW_BITS+3) : _mm256_srai_epi32(_mm256_add_epi32(s[k], col_round_odd), CONST_BITS+ROW_BITS+3);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(p + k * 8), c);
+  }
+}
+
+// Quantizes 4 coefficients the way load_quantized_coefficients() does: sign(j) * ((|j| + q/2) / q), with truncating division.
+// |j| + q/2 stays far below 2^24, so the single precision quotient truncates to the exact integer result.
+static inline __m128i quantize4_sse2(__m128i j, __m128i q)
+{
+  const __m128i sign = _mm_srai_epi32(j, 31);
+  const __m128i a = _mm_add_epi32(_mm_sub_epi32(_mm_xor_si128(j, sign), sign), _mm_srai_epi32(q, 1));
+  const __m128i quot = _mm_cvttps_epi32(_mm_div_ps(_mm_cvtepi32_ps(a), _mm_cvtepi32_ps(q)));
+  return _mm_sub_epi32(_mm_xor_si128(quot, sign), sign);
+}
+
+// pSrc and pQ are in natural order, pDst receives the coefficients in zigzag order.
+static void quantize_sse2(const int32 *pSrc, const int32 *pQ, int16 *pDst)
+{
+  int16 natural[64];
+  for (int i = 0; i < 64; i += 8)
+  {
+    const __m128i lo = quantize4_sse2(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pSrc + i)), _mm_loadu_si128(reinterpret_cast<const __m128i*>(pQ + i)));
+    const __m128i hi = quantize4_sse2(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pSrc + i + 4)), _mm_loadu_si128(reinterpret_cast<const __m128i*>(pQ + i + 4)));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(natural + i), _mm_packs_epi32(lo, hi));
+  }
+  for (int i = 0; i < 64; i++)
+    pDst[i] = natural[s_zag[i]];
+}
+
+static JPGE_AVX2_FUNC void quantize_avx2(const int32 *pSrc, const int32 *pQ, int16 *pDst)
+{
+  int16 natural[64];
+  for (int i = 0; i < 64; i += 16)
+  {
+    __m256i r[2];
+    for (int h = 0; h < 2; h++)
+    {
+      const __m256i j = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pSrc + i + h * 8));
+      const __m256i q = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pQ + i + h * 8));
+      const __m256i sign = _mm256_srai_epi32(j, 31);
+      const __m256i a = _mm256_add_epi32(_mm256_sub_epi32(_mm256_xor_si256(j, sign), sign), _mm256_srai_epi32(q, 1));
+      const __m256i quot = _mm256_cvttps_epi32(_mm256_div_ps(_mm256_cvtepi32_ps(a), _mm256_cvtepi32_ps(q)));
+      r[h] = _mm256_sub_epi32(_mm256_xor_si256(quot, sign), sign);
+    }
+    // packs works per 128-bit lane, restore the order of the 16 results.
+    const __m256i w = _mm256_permute4x64_epi64(_mm256_packs_epi32(r[0], r[1]), _MM_SHUFFLE(3, 1, 2, 0));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(natural + i), w);
+  }
+  for (int i = 0; i < 64; i++)
+    pDst[i] = natural[s_zag[i]];
+}
+
+// RGB->YCbCr on 16-bit lanes, bit-identical to RGB_to_YCC(). madd takes signed 16-bit factors, so YG, CB_B and CR_R (all >= 32768)
+// are applied as (factor - 65536) and the missing 65536 * channel is added back after the shift; the + 32768 rounding is b * 0 + 128 * 256.
+#define JPGE_MADD_PAIR(lo, hi) ((int)(((uint)(hi) << 16) | ((uint)(lo) & 0xFFFF)))
+
+static inline void rgb_to_ycc_sse2(__m128i r, __m128i g, __m128i b, __m128i &y, __m128i &cb, __m128i &cr)
+{
+  const __m128i k128 = _mm_set1_epi16(128);
+  const __m128i rg_lo = _mm_unpacklo_epi16(r, g), rg_hi = _mm_unpackhi_epi16(r, g);
+  const __m128i b1_lo = _mm_unpacklo_epi16(b, k128), b1_hi = _mm_unpackhi_epi16(b, k128);
+
+  #define JPGE_SSE2_YCC(rg_factors, b_factor, correction) \
+    _mm_add_epi16(_mm_packs_epi32( \
+      _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(rg_lo, _mm_set1_epi32(rg_factors)), _mm_madd_epi16(b1_lo, _mm_set1_epi32(JPGE_MADD_PAIR(b_factor, 256)))), 16), \
+      _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(rg_hi, _mm_set1_epi32(rg_factors)), _mm_madd_epi16(b1_hi, _mm_set1_epi32(JPGE_MADD_PAIR(b_factor, 256)))), 16)), correction)
+  y = JPGE_SSE2_YCC(JPGE_MADD_PAIR(YR, YG - 65536), YB, g);
+  cb = _mm_add_epi16(JPGE_SSE2_YCC(JPGE_MADD_PAIR(CB_R, CB_G), CB_B - 65536, b), k128);
+  cr = _mm_add_epi16(JPGE_SSE2_YCC(JPGE_MADD_PAIR(CR_R - 65536, CR_G), CR_B, r), k128);
+  #undef JPGE_SSE2_YCC
+}
+
+static JPGE_AVX2_FUNC inline void rgb_to_ycc_avx2(__m256i r, __m256i g, __m256i b, __m256i &y, __m256i &cb, __m256i &cr)
+{
+  const __m256i k128 = _mm256_set1_epi16(128);
+  const __m256i rg_lo = _mm256_unpacklo_epi16(r, g), rg_hi = _mm256_unpackhi_epi16(r, g);
+  const __m256i b1_lo = _mm256_unpacklo_epi16(b, k128), b1_hi = _mm256_unpackhi_epi16(b, k128);
+
+  // unpacklo/hi and packs both work per 128-bit lane, so the pixel order comes back unchanged.
+  #define JPGE_AVX2_YCC(rg_factors, b_factor, correction) \
+    _mm256_add_epi16(_mm256_packs_epi32( \
+      _mm256_srai_epi32(_mm256_add_epi32(_mm256_madd_epi16(rg_lo, _mm256_set1_epi32(rg_factors)), _mm256_madd_epi16(b1_lo, _mm256_set1_epi32(JPGE_MADD_PAIR(b_factor, 256)))), 16), \
+      _mm256_srai_epi32(_mm256_add_epi32(_mm256_madd_epi16(rg_hi, _mm256_set1_epi32(rg_factors)), _mm256_madd_epi16(b1_hi, _mm256_set1_epi32(JPGE_MADD_PAIR(b_factor, 256)))), 16)), correction)
+  y = JPGE_AVX2_YCC(JPGE_MADD_PAIR(YR, YG - 65536), YB, g);
+  cb = _mm256_add_epi16(JPGE_AVX2_YCC(JPGE_MADD_PAIR(CB_R, CB_G), CB_B - 65536, b), k128);
+  cr = _mm256_add_epi16(JPGE_AVX2_YCC(JPGE_MADD_PAIR(CR_R - 65536, CR_G), CR_B, r), k128);
+  #undef JPGE_AVX2_YCC
+}
+
+// Converts whole groups of 8 pixels of 24 or 32bpp RGB(A) to YCbCr (dst_comps 3) or Y (dst_comps 1), returns the number of pixels done.
+static int convert_to_ycc_sse2(uint8* pDst, const uint8 *pSrc, int num_pixels, int src_bpp, int dst_comps)
+{
+  const __m128i zero = _mm_setzero_si128(), byte_mask = _mm_set1_epi32(0xFF);
+  int i = 0;
+  for ( ; i + 8 <= num_pixels; i += 8, pSrc += 8 * src_bpp)
+  {
+    __m128i r, g, b;
+    if (src_bpp == 4)
+    {
+      const __m128i p0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pSrc)), p1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pSrc + 16));
+      r = _mm_packs_epi32(_mm_and_si128(p0, byte_mask), _mm_and_si128(p1, byte_mask));
+      g = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(p0, 8), byte_mask), _mm_and_si128(_mm_srli_epi32(p1, 8), byte_mask));
+      b = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(p0, 16), byte_mask), _mm_and_si128(_mm_srli_epi32(p1, 16), byte_mask));
+    }
+    else
+    {
+      // SSE2 has no byte shuffle, gather the 24bpp channels directly.
+      r = _mm_setr_epi16(pSrc[0], pSrc[3], pSrc[6], pSrc[9], pSrc[12], pSrc[15], pSrc[18], pSrc[21]);
+      g = _mm_setr_epi16(pSrc[1], pSrc[4], pSrc[7], pSrc[10], pSrc[13], pSrc[16], pSrc[19], pSrc[22]);
+      b = _mm_setr_epi16(pSrc[2], pSrc[5], pSrc[8], pSrc[11], pSrc[14], pSrc[17], pSrc[20], pSrc[23]);
+    }
+
+    __m128i y, cb, cr;
+    rgb_to_ycc_sse2(r, g, b, y, cb, cr);
+    if (dst_comps == 1)
+    {
+      _mm_storel_epi64(reinterpret_cast<__m128i*>(pDst), _mm_packus_epi16(y, zero));
+      pDst += 8;
+    }
+    else
+    {
+      uint8 planes[3][16];
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(planes[0]), _mm_packus_epi16(y, zero));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(planes[1]), _mm_packus_epi16(cb, zero));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(planes[2]), _mm_packus_epi16(cr, zero));
+      for (int j = 0; j < 8; j++, pDst += 3)
+      {
+        pDst[0] = planes[0][j]; pDst[1] = planes[1][j]; pDst[2] = planes[2][j];
+      }
+    }
+  }
+  return i;
+}
+
+// Same as convert_to_ycc_sse2(), 16 pixels at a time, using byte shuffles to (de)interleave 24bpp pixels.
+static JPGE_AVX2_FUNC int convert_to_ycc_avx2(uint8* pDst, const uint8 *pSrc, int num_pixels, int src_bpp, int dst_comps)
+{
+  // Byte k of plane c comes from byte 3k+c of the 48 source bytes, split over three 16 byte loads.
+  static const signed char s_rgb_deinterleave[3][3][16] =
+  {
+    { { 0,3,6,9,12,15,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1 }, { -1,-1,-1,-1,-1,-1,2,5,8,11,14,-1,-1,-1,-1,-1 }, { -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,1,4,7,10,13 } },
+    { { 1,4,7,10,13,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1 }, { -1,-1,-1,-1,-1,0,3,6,9,12,15,-1,-1,-1,-1,-1 }, { -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,2,5,8,11,14 } },
+    { { 2,5,8,11,14,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1 }, { -1,-1,-1,-1,-1,1,4,7,10,13,-1,-1,-1,-1,-1,-1 }, { -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,0,3,6,9,12,15 } }
+  };
+  // Output byte 16m+j is plane (16m+j)%3, pixel (16m+j)/3.
+  static const signed char s_ycc_interleave[3][3][16] =
+  {
+    { { 0,-1,-1,1,-1,-1,2,-1,-1,3,-1,-1,4,-1,-1,5 }, { -1,0,-1,-1,1,-1,-1,2,-1,-1,3,-1,-1,4,-1,-1 }, { -1,-1,0,-1,-1,1,-1,-1,2,-1,-1,3,-1,-1,4,-1 } },
+    { { -1,-1,6,-1,-1,7,-1,-1,8,-1,-1,9,-1,-1,10,-1 }, { 5,-1,-1,6,-1,-1,7,-1,-1,8,-1,-1,9,-1,-1,10 }, { -1,5,-1,-1,6,-1,-1,7,-1,-1,8,-1,-1,9,-1,-1 } },
+    { { -1,11,-1,-1,12,-1,-1,13,-1,-1,14,-1,-1,15,-1,-1 }, { -1,-1,11,-1,-1,12,-1,-1,13,-1,-1,14,-1,-1,15,-1 }, { 10,-1,-1,11,-1,-1,12,-1,-1,13,-1,-1,14,-1,-1,15 } }
+  };
+
+  const __m256i byte_mask = _mm256_set1_epi32(0xFF);
+  int i = 0;
+  for ( ; i + 16 <= num_pixels; i += 16, pSrc += 16 * src_bpp)
+  {
+    __m256i r, g, b;
+    if (src_bpp == 4)
+    {
+      const __m256i p0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pSrc)), p1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pSrc + 32));
+      r = _mm256_permute4x64_epi64(_mm256_packs_epi32(_mm256_and_si256(p0, byte_mask), _mm256_and_si256(p1, byte_mask)), _MM_SHUFFLE(3, 1, 2, 0));
+      g = _mm256_permute4x64_epi64(_mm256_packs_epi32(_mm256_and_si256(_mm256_srli_epi32(p0, 8), byte_mask), _mm256_and_si256(_mm256_srli_epi32(p1, 8), byte_mask)), _MM_SHUFFLE(3, 1, 2, 0));
+      b = _mm256_permute4x64_epi64(_mm256_packs_epi32(_mm256_and_si256(_mm256_srli_epi32(p0, 16), byte_mask), _mm256_and_si256(_mm256_srli_epi32(p1, 16), byte_mask)), _MM_SHUFFLE(3, 1, 2, 0));
+    }
+    else
+    {
+      const __m128i s0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pSrc));
+      const __m128i s1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pSrc + 16));
+      const __m128i s2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pSrc + 32));
+      __m256i planes[3];
+      for (int c = 0; c < 3; c++)
+      {
+        const __m128i plane = _mm_or_si128(_mm_or_si128(
+          _mm_shuffle_epi8(s0, _mm_loadu_si128(reinterpret_cast<const __m128i*>(s_rgb_deinterleave[c][0]))),
+          _mm_shuffle_epi8(s1, _mm_loadu_si128(reinterpret_cast<const __m128i*>(s_rgb_deinterleave[c][1])))),
+          _mm_shuffle_epi8(s2, _mm_loadu_si128(reinterpret_cast<const __m128i*>(s_rgb_deinterleave[c][2]))));
+        planes[c] = _mm256_cvtepu8_epi16(plane);
+      }
+      r = planes[0]; g = planes[1]; b = planes[2];
+    }
+
+    __m256i y, cb, cr;
+    rgb_to_ycc_avx2(r, g, b, y, cb, cr);
+    const __m128i y8 = _mm_packus_epi16(_mm256_castsi256_si128(y), _mm256_extracti128_si256(y, 1));
+    if (dst_comps == 1)
+    {
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(pDst), y8);
+      pDst += 16;
+    }
+    else
+    {
+      const __m128i cb8 = _mm_packus_epi16(_mm256_castsi256_si128(cb), _mm256_extracti128_si256(cb, 1));
+      const __m128i cr8 = _mm_packus_epi16(_mm256_castsi256_si128(cr), _mm256_extracti128_si256(cr, 1));
+      for (int m = 0; m < 3; m++)
+      {
+        const __m128i out = _mm_or_si128(_mm_or_si128(
+          _mm_shuffle_epi8(y8, _mm_loadu_si128(reinterpret_cast<const __m128i*>(s_ycc_interleave[m][0]))),
+          _mm_shuffle_epi8(cb8, _mm_loadu_si128(reinterpret_cast<const __m128i*>(s_ycc_interleave[m][1])))),
+          _mm_shuffle_epi8(cr8, _mm_loadu_si128(reinterpret_cast<const __m128i*>(s_ycc_interleave[m][2]))));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(pDst + m * 16), out);
+      }
+      pDst += 48;
+    }
+  }
+  return i;
+}
+#endif // JPGE_USE_SIMD
+
 struct sym_freq { uint m_key, m_sym_index; };
 
 // Radix sorts sym_freq[] array by 32-bit key m_key. Returns ptr to sorted values.
@@ -352,6 +758,13 @@ void jpeg_encoder::emit_sos()
   emit_byte(0);
 }
 
+void jpeg_encoder::emit_dri()
+{
+  emit_marker(M_DRI);
+  emit_word(4);
+  emit_word(m_restart_interval);
+}
+
 // Emit all markers at beginning of image file.
 void jpeg_encoder::emit_markers()
 {
@@ -360,6 +773,8 @@ void jpeg_encoder::emit_markers()
   emit_dqt();
   emit_sof();
   emit_dhts();
+  if (m_restart_interval)
+    emit_dri();
   emit_sos();
 }
 
@@ -418,17 +833,30 @@ void jpeg_encoder::first_pass_init()
   m_bit_buffer = 0; m_bits_in = 0;
   memset(m_last_dc_val, 0, 3 * sizeof(m_last_dc_val[0]));
   m_mcu_y_ofs = 0;
+  m_mcu_row_num = 0;
+  m_next_restart_num = 0;
   m_pass_num = 1;
 }
 
 bool jpeg_encoder::second_pass_init()
 {
-  compute_huffman_table(&m_huff_codes[0+0][0], &m_huff_code_sizes[0+0][0], m_huff_bits[0+0], m_huff_val[0+0]);
-  compute_huffman_table(&m_huff_codes[2+0][0], &m_huff_code_sizes[2+0][0], m_huff_bits[2+0], m_huff_val[2+0]);
-  if (m_num_components > 1)
+  if (m_params.m_two_pass_flag)
+  {
+    compute_huffman_table(&m_huff_codes[0+0][0], &m_huff_code_sizes[0+0][0], m_huff_bits[0+0], m_huff_val[0+0]);
+    compute_huffman_table(&m_huff_codes[2+0][0], &m_huff_code_sizes[2+0][0], m_huff_bits[2+0], m_huff_val[2+0]);
+    if (m_num_components > 1)
+    {
+      compute_huffman_table(&m_huff_codes[0+1][0], &m_huff_code_sizes[0+1][0], m_huff_bits[0+1], m_huff_val[0+1]);
+      compute_huffman_table(&m_huff_codes[2+1][0], &m_huff_code_sizes[2+1][0], m_huff_bits[2+1], m_huff_val[2+1]);
+    }
+    m_std_huff_codes = false;
+  }
+  else if (!m_std_huff_codes)
   {
-    compute_huffman_table(&m_huff_codes[0+1][0], &m_huff_code_sizes[0+1][0], m_huff_bits[0+1], m_huff_val[0+1]);
-    compute_huffman_table(&m_huff_codes[2+1][0], &m_huff_code_sizes[2+1][0], m_huff_bits[2+1], m_huff_val[2+1]);
+    // The standard tables are the same for every image, their codes are kept until an optimized table replaces them.
+    for (int i = 0; i < 4; i++)
+      compute_huffman_table(&m_huff_codes[i][0], &m_huff_code_sizes[i][0], m_huff_bits[i], m_huff_val[i]);
+    m_std_huff_codes = true;
   }
   first_pass_init();
   emit_markers();
@@ -482,12 +910,37 @@ bool jpeg_encoder::jpg_open(int p_x_res, int p_y_res, int src_channels)
   m_image_bpl_mcu  = m_image_x_mcu * m_num_components;
   m_mcus_per_row   = m_image_x_mcu / m_mcu_x;
 
-  if ((m_mcu_lines[0] = static_cast<uint8*>(jpge_malloc(m_image_bpl_mcu * m_mcu_y))) == NULL) return false;
+  m_restart_interval = 0;
+  if (m_params.m_restart_mcu_rows)
+  {
+    m_params.m_restart_mcu_rows = JPGE_MIN(m_params.m_restart_mcu_rows, 65535 / m_mcus_per_row);
+    m_restart_interval = m_params.m_restart_mcu_rows * m_mcus_per_row;
+  }
+
+  // The scanline buffer of a previous image is reused if it's large enough.
+  const uint mcu_lines_size = m_image_bpl_mcu * m_mcu_y;
+  if (mcu_lines_size > m_mcu_lines_size)
+  {
+    jpge_free(m_mcu_lines[0]);
+    m_mcu_lines_size = 0;
+    if ((m_mcu_lines[0] = static_cast<uint8*>(jpge_malloc(mcu_lines_size))) == NULL) return false;
+    m_mcu_lines_size = mcu_lines_size;
+  }
   for (int i = 1; i < m_mcu_y; i++)
     m_mcu_lines[i] = m_mcu_lines[i-1] + m_image_bpl_mcu;
 
-  compute_quant_table(m_quantization_tables[0], s_std_lum_quant);
-  compute_quant_table(m_quantization_tables[1], m_params.m_no_chroma_discrim_flag ? s_std_lum_quant : s_std_croma_quant);
+  if ((m_quantization_tables_quality != m_params.m_quality) || (m_quantization_tables_no_chroma_discrim != m_params.m_no_chroma_discrim_flag))
+  {
+    compute_quant_table(m_quantization_tables[0], s_std_lum_quant);
+    compute_quant_table(m_quantization_tables[1], m_params.m_no_chroma_discrim_flag ? s_std_lum_quant : s_std_croma_quant);
+    for (int i = 0; i < 64; i++)
+    {
+      m_natural_quantization_tables[0][s_zag[i]] = m_quantization_tables[0][i];
+      m_natural_quantization_tables[1][s_zag[i]] = m_quantization_tables[1][i];
+    }
+    m_quantization_tables_quality = m_params.m_quality;
+    m_quantization_tables_no_chroma_discrim = m_params.m_no_chroma_discrim_flag;
+  }
 
   m_out_buf_left = JPGE_OUT_BUF_SIZE;
   m_pOut_buf = m_out_buf;
@@ -615,6 +1068,19 @@ void jpeg_encoder::put_bits(uint bits, uint len)
   }
 }
 
+// Ends the current restart interval: pads the entropy coded data to a byte boundary, writes the next RSTn marker and resets the DC predictions.
+void jpeg_encoder::emit_restart()
+{
+  if (m_pass_num == 2)
+  {
+    put_bits(0x7F, 7);
+    m_bit_buffer = 0; m_bits_in = 0;
+    JPGE_PUT_BYTE(0xFF);
+    JPGE_PUT_BYTE(static_cast<uint8>(M_RST0 + (m_next_restart_num++ & 7)));
+  }
+  memset(m_last_dc_val, 0, 3 * sizeof(m_last_dc_val[0]));
+}
+
 void jpeg_encoder::code_coefficients_pass_one(int component_num)
 {
   if (component_num >= 3) return; // just to shut up static analysis
@@ -720,8 +1186,23 @@ void jpeg_encoder::code_coefficients_pass_two(int component_num)
 
 void jpeg_encoder::code_block(int component_num)
 {
-  DCT2D(m_sample_array);
-  load_quantized_coefficients(component_num);
+#if JPGE_USE_SIMD
+  if (m_simd_level == SIMD_AVX2)
+  {
+    DCT2D_avx2(m_sample_array);
+    quantize_avx2(m_sample_array, m_natural_quantization_tables[component_num > 0], m_coefficient_array);
+  }
+  else if (m_simd_level == SIMD_SSE2)
+  {
+    DCT2D_sse2(m_sample_array);
+    quantize_sse2(m_sample_array, m_natural_quantization_tables[component_num > 0], m_coefficient_array);
+  }
+  else
+#endif
+  {
+    DCT2D(m_sample_array);
+    load_quantized_coefficients(component_num);
+  }
   if (m_pass_num == 1)
     code_coefficients_pass_one(component_num);
   else
@@ -730,6 +1211,13 @@ void jpeg_encoder::code_block(int component_num)
 
 void jpeg_encoder::process_mcu_row()
 {
+  if (m_restart_interval)
+  {
+    if ((m_mcu_row_num) && ((m_mcu_row_num % m_params.m_restart_mcu_rows) == 0))
+      emit_restart();
+    m_mcu_row_num++;
+  }
+
   if (m_num_components == 1)
   {
     for (int i = 0; i < m_mcus_per_row; i++)
@@ -782,7 +1270,8 @@ bool jpeg_encoder::terminate_pass_two()
   return true;
 }
 
-bool jpeg_encoder::process_end_of_image()
+// Codes the last, partially filled MCU row (if any) by duplicating its last scanline.
+void jpeg_encoder::process_partial_mcu_row()
 {
   if (m_mcu_y_ofs)
   {
@@ -793,7 +1282,13 @@ bool jpeg_encoder::process_end_of_image()
     }
 
     process_mcu_row();
+    m_mcu_y_ofs = 0;
   }
+}
+
+bool jpeg_encoder::process_end_of_image()
+{
+  process_partial_mcu_row();
 
   if (m_pass_num == 1)
     return terminate_pass_one();
@@ -807,21 +1302,35 @@ void jpeg_encoder::load_mcu(const void *pSrc)
 
   uint8* pDst = m_mcu_lines[m_mcu_y_ofs]; // OK to write up to m_image_bpl_xlt bytes to pDst
 
+  // The SIMD converters handle whole groups of pixels, the scalar code below finishes the rest of the scanline.
+  int num_converted = 0;
+#if JPGE_USE_SIMD
+  if ((m_image_bpp >= 3) && (m_simd_level != SIMD_NONE))
+  {
+    if (m_simd_level == SIMD_AVX2)
+      num_converted = convert_to_ycc_avx2(pDst, Psrc, m_image_x, m_image_bpp, m_num_components);
+    num_converted += convert_to_ycc_sse2(pDst + num_converted * m_num_components, Psrc + num_converted * m_image_bpp, m_image_x - num_converted, m_image_bpp, m_num_components);
+  }
+#endif
+  uint8* pDst_rest = pDst + num_converted * m_num_components;
+  const uint8* pSrc_rest = Psrc + num_converted * m_image_bpp;
+  const int num_rest = m_image_x - num_converted;
+
   if (m_num_components == 1)
   {
     if (m_image_bpp == 4)
-      RGBA_to_Y(pDst, Psrc, m_image_x);
+      RGBA_to_Y(pDst_rest, pSrc_rest, num_rest);
     else if (m_image_bpp == 3)
-      RGB_to_Y(pDst, Psrc, m_image_x);
+      RGB_to_Y(pDst_rest, pSrc_rest, num_rest);
     else
       memcpy(pDst, Psrc, m_image_x);
   }
   else
   {
     if (m_image_bpp == 4)
-      RGBA_to_YCC(pDst, Psrc, m_image_x);
+      RGBA_to_YCC(pDst_rest, pSrc_rest, num_rest);
     else if (m_image_bpp == 3)
-      RGB_to_YCC(pDst, Psrc, m_image_x);
+      RGB_to_YCC(pDst_rest, pSrc_rest, num_rest);
     else
       Y_to_YCC(pDst, Psrc, m_image_x);
   }
@@ -849,7 +1358,12 @@ void jpeg_encoder::load_mcu(const void *pSrc)
 void jpeg_encoder::clear()
 {
   m_mcu_lines[0] = NULL;
+  m_mcu_lines_size = 0;
+  m_quantization_tables_quality = 0;
+  m_quantization_tables_no_chroma_discrim = false;
+  m_std_huff_codes = false;
   m_pass_num = 0;
+  m_restart_interval = 0;
   m_all_stream_writes_succeeded = true;
 }
 
@@ -865,10 +1379,16 @@ jpeg_encoder::~jpeg_encoder()
 
 bool jpeg_encoder::init(output_stream *pStream, int width, int height, int src_channels, const params &comp_params)
 {
-  deinit();
-  if (((!pStream) || (width < 1) || (height < 1)) || ((src_channels != 1) && (src_channels != 3) && (src_channels != 4)) || (!comp_params.check())) return false;
+  if (((!pStream) || (width < 1) || (height < 1)) || ((src_channels != 1) && (src_channels != 3) && (src_channels != 4)) || (!comp_params.check()))
+  {
+    deinit();
+    return false;
+  }
+  m_pass_num = 0;
+  m_all_stream_writes_succeeded = true;
   m_pStream = pStream;
   m_params = comp_params;
+  m_simd_level = g_simd_level;
   return jpg_open(width, height, src_channels);
 }
 
@@ -895,6 +1415,156 @@ bool jpeg_encoder::process_scanline(const void* pScanline)
   return m_all_stream_writes_succeeded;
 }
 
+// Opens this encoder with master's image layout, quantization tables and restart settings, to code slices of the image master is compressing.
+// Slice encoders never choose Huffman tables or write headers, that is left to the master.
+bool jpeg_encoder::open_slice_encoder(const jpeg_encoder &master)
+{
+  deinit();
+  m_pStream = NULL;
+  m_params = master.m_params;
+  m_params.m_two_pass_flag = true; // makes jpg_open() stop before the Huffman tables and headers
+  m_simd_level = master.m_simd_level;
+  return jpg_open(master.m_image_x, master.m_image_y, master.m_image_bpp);
+}
+
+// Codes MCU rows [first_mcu_row, first_mcu_row + num_mcu_rows) as one restart interval. Pass 1 only adds the symbol statistics to m_huff_count,
+// pass 2 writes the byte aligned entropy coded segment to pStream, without the RSTn marker which follows it in the final image.
+bool jpeg_encoder::code_slice(int pass_num, output_stream *pStream, const uint8 *pImage_data, int first_mcu_row, int num_mcu_rows)
+{
+  first_pass_init();
+  m_pass_num = static_cast<uint8>(pass_num);
+  m_pStream = pStream;
+  m_out_buf_left = JPGE_OUT_BUF_SIZE;
+  m_pOut_buf = m_out_buf;
+
+  const int first_line = first_mcu_row * m_mcu_y;
+  const int end_line = JPGE_MIN(first_line + num_mcu_rows * m_mcu_y, m_image_y);
+  for (int y = first_line; y < end_line; y++)
+    load_mcu(pImage_data + y * m_image_bpl);
+  process_partial_mcu_row();
+
+  if (m_pass_num == 2)
+  {
+    put_bits(0x7F, 7);
+    flush_output_buffer();
+  }
+  return m_all_stream_writes_succeeded;
+}
+
+// Collects a slice's entropy coded data until it can be written out in order.
+class slice_stream : public output_stream
+{
+   std::vector<uint8> &m_buf;
+   slice_stream &operator= (const slice_stream &);
+
+public:
+   slice_stream(std::vector<uint8> &buf) : m_buf(buf) { m_buf.clear(); }
+
+   virtual bool put_buf(const void* pBuf, int len)
+   {
+      m_buf.insert(m_buf.end(), static_cast<const uint8*>(pBuf), static_cast<const uint8*>(pBuf) + len);
+      return true;
+   }
+};
+
+bool jpeg_encoder::compress_image_parallel(output_stream *pStream, int width, int height, int src_channels, const uint8 *pImage_data, int max_threads, const params &comp_params)
+{
+  if (!pImage_data) return false;
+
+  // Each slice is one restart interval. Around 4 slices per thread keeps every thread busy even when parts of the image compress slower.
+  params slice_params(comp_params);
+  if ((!slice_params.m_restart_mcu_rows) && (max_threads > 1) && (height > 0))
+  {
+    const int mcu_y = (comp_params.m_subsampling == H2V2) ? 16 : 8;
+    const int num_mcu_rows = (height + mcu_y - 1) / mcu_y;
+    slice_params.m_restart_mcu_rows = (num_mcu_rows + max_threads * 4 - 1) / (max_threads * 4);
+  }
+
+  if (!init(pStream, width, height, src_channels, slice_params))
+    return false;
+
+  const int num_mcu_rows = m_image_y_mcu / m_mcu_y;
+  const int slice_mcu_rows = m_restart_interval ? m_params.m_restart_mcu_rows : num_mcu_rows;
+  const int num_slices = (num_mcu_rows + slice_mcu_rows - 1) / slice_mcu_rows;
+  const int num_threads = JPGE_MIN(max_threads, num_slices);
+  if (num_threads <= 1)
+  {
+    for (uint pass_index = 0; pass_index < get_total_passes(); pass_index++)
+    {
+      for (int i = 0; i < height; i++)
+      {
+        if (!process_scanline(pImage_data + i * m_image_bpl))
+          return false;
+      }
+      if (!process_scanline(NULL))
+        return false;
+    }
+    return true;
+  }
+
+  std::vector<jpeg_encoder> slice_encoders(num_threads);
+  for (int i = 0; i < num_threads; i++)
+  {
+    if (!slice_encoders[i].open_slice_encoder(*this))
+      return false;
+  }
+
+  std::vector< std::vector<uint8> > slice_data(num_slices);
+  std::atomic<bool> slices_ok(true);
+  auto code_slices = [&](int pass_num)
+  {
+    std::atomic<int> next_slice(0);
+    auto worker = [&](int thread_index)
+    {
+      jpeg_encoder &slice_encoder = slice_encoders[thread_index];
+      for (int slice = next_slice++; slice < num_slices; slice = next_slice++)
+      {
+        slice_stream stream(slice_data[slice]);
+        if (!slice_encoder.code_slice(pass_num, &stream, pImage_data, slice * slice_mcu_rows, slice_mcu_rows))
+          slices_ok = false;
+      }
+    };
+    std::vector<std::thread> threads;
+    for (int i = 1; i < num_threads; i++)
+      threads.push_back(std::thread(worker, i));
+    worker(0);
+    for (size_t i = 0; i < threads.size(); i++)
+      threads[i].join();
+  };
+
+  if (m_params.m_two_pass_flag)
+  {
+    code_slices(1);
+    for (int i = 0; i < num_threads; i++)
+    {
+      for (int t = 0; t < 4; t++)
+        for (int s = 0; s < 256; s++)
+          m_huff_count[t][s] += slice_encoders[i].m_huff_count[t][s];
+    }
+    if (!terminate_pass_one())
+      return false;
+  }
+
+  for (int i = 0; i < num_threads; i++)
+  {
+    memcpy(slice_encoders[i].m_huff_codes, m_huff_codes, sizeof(m_huff_codes));
+    memcpy(slice_encoders[i].m_huff_code_sizes, m_huff_code_sizes, sizeof(m_huff_code_sizes));
+  }
+  code_slices(2);
+  if (!slices_ok)
+    return false;
+
+  for (int i = 0; i < num_slices; i++)
+  {
+    if (i)
+      emit_marker(M_RST0 + ((i - 1) & 7));
+    m_all_stream_writes_succeeded = m_all_stream_writes_succeeded && m_pStream->put_buf(&slice_data[i][0], static_cast<int>(slice_data[i].size()));
+  }
+  emit_marker(M_EOI);
+  m_pass_num = 3;
+  return m_all_stream_writes_succeeded;
+}
+
 // Higher level wrappers/examples (optional).
 #include <stdio.h>
 
@@ -949,12 +1619,17 @@ public:
 
 // Writes JPEG image to file.
 bool compress_image_to_jpeg_file(const char *pFilename, int width, int height, int num_channels, const uint8 *pImage_data, const params &comp_params)
+{
+  jpge::jpeg_encoder dst_image;
+  return compress_image_to_jpeg_file(dst_image, pFilename, width, height, num_channels, pImage_data, comp_params);
+}
+
+bool compress_image_to_jpeg_file(jpeg_encoder &dst_image, const char *pFilename, int width, int height, int num_channels, const uint8 *pImage_data, const params &comp_params)
 {
   cfile_stream dst_stream;
   if (!dst_stream.open(pFilename))
     return false;
 
-  jpge::jpeg_encoder dst_image;
   if (!dst_image.init(&dst_stream, width, height, num_channels, comp_params))
     return false;
 
@@ -970,6 +1645,19 @@ bool compress_image_to_jpeg_file(const char *pFilename, int width, int height, i
        return false;
   }
 
+  return dst_stream.close();
+}
+
+bool compress_image_to_jpeg_file_parallel(const char *pFilename, int width, int height, int num_channels, const uint8 *pImage_data, int max_threads, const params &comp_params)
+{
+  cfile_stream dst_stream;
+  if (!dst_stream.open(pFilename))
+    return false;
+
+  jpge::jpeg_encoder dst_image;
+  if (!dst_image.compress_image_parallel(&dst_stream, width, height, num_channels, pImage_data, max_threads, comp_params))
+    return false;
+
   dst_image.deinit();
 
   return dst_stream.close();
@@ -1005,6 +1693,12 @@ public:
 };
 
 bool compress_image_to_jpeg_file_in_memory(void *pDstBuf, int &buf_size, int width, int height, int num_channels, const uint8 *pImage_data, const params &comp_params)
+{
+   jpge::jpeg_encoder dst_image;
+   return compress_image_to_jpeg_file_in_memory(dst_image, pDstBuf, buf_size, width, height, num_channels, pImage_data, comp_params);
+}
+
+bool compress_image_to_jpeg_file_in_memory(jpeg_encoder &dst_image, void *pDstBuf, int &buf_size, int width, int height, int num_channels, const uint8 *pImage_data, const params &comp_params)
 {
    if ((!pDstBuf) || (!buf_size))
       return false;
@@ -1013,7 +1707,6 @@ bool compress_image_to_jpeg_file_in_memory(void *pDstBuf, int &buf_size, int wid
 
    buf_size = 0;
 
-   jpge::jpeg_encoder dst_image;
    if (!dst_image.init(&dst_stream, width, height, num_channels, comp_params))
       return false;
 
@@ -1029,6 +1722,23 @@ bool compress_image_to_jpeg_file_in_memory(void *pDstBuf, int &buf_size, int wid
         return false;
    }
 
+   buf_size = dst_stream.get_size();
+   return true;
+}
+
+bool compress_image_to_jpeg_file_in_memory_parallel(void *pDstBuf, int &buf_size, int width, int height, int num_channels, const uint8 *pImage_data, int max_threads, const params &comp_params)
+{
+   if ((!pDstBuf) || (!buf_size))
+      return false;
+
+   memory_stream dst_stream(pDstBuf, buf_size);
+
+   buf_size = 0;
+
+   jpge::jpeg_encoder dst_image;
+   if (!dst_image.compress_image_parallel(&dst_stream, width, height, num_channels, pImage_data, max_threads, comp_params))
+      return false;
+
    dst_image.deinit();
 
    buf_size = dst_stream.get_size();
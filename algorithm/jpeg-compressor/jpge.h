@@ -12,6 +12,8 @@ namespace jpge
   typedef unsigned short uint16;
   typedef unsigned int   uint32;
   typedef unsigned int   uint;
+
+  class jpeg_encoder;
   
   // JPEG chroma subsampling factors. Y_ONLY (grayscale images) and H2V2 (color images) are the most common.
   enum subsampling_t { Y_ONLY = 0, H1V1 = 1, H2V1 = 2, H2V2 = 3 };
@@ -19,12 +21,13 @@ namespace jpge
   // JPEG compression parameters structure.
   struct params
   {
-    inline params() : m_quality(85), m_subsampling(H2V2), m_no_chroma_discrim_flag(false), m_two_pass_flag(false) { }
+    inline params() : m_quality(85), m_subsampling(H2V2), m_no_chroma_discrim_flag(false), m_two_pass_flag(false), m_restart_mcu_rows(0) { }
 
     inline bool check() const
     {
       if ((m_quality < 1) || (m_quality > 100)) return false;
       if ((uint)m_subsampling > (uint)H2V2) return false;
+      if (m_restart_mcu_rows < 0) return false;
       return true;
     }
 
@@ -43,6 +46,10 @@ namespace jpge
     bool m_no_chroma_discrim_flag;
 
     bool m_two_pass_flag;
+
+    // Emits a restart marker every m_restart_mcu_rows rows of MCUs, 0 disables restart markers. Capped so the interval stays within 65535 MCUs.
+    // Each restart costs a few bytes, but lets the rows between markers be coded (and decoded) independently.
+    int m_restart_mcu_rows;
   };
   
   // Writes JPEG image to a file. 
@@ -53,6 +60,25 @@ namespace jpge
   // On entry, buf_size is the size of the output buffer pointed at by pBuf, which should be at least ~1024 bytes. 
   // If return value is true, buf_size will be set to the size of the compressed data.
   bool compress_image_to_jpeg_file_in_memory(void *pBuf, int &buf_size, int width, int height, int num_channels, const uint8 *pImage_data, const params &comp_params = params());
+
+  // Same as the two functions above, but compress with a caller-owned jpeg_encoder, which keeps its scanline buffer, quantization and standard Huffman
+  // tables from one image to the next. Use these when compressing many images in a row. The encoder must not be used by more than one thread at a time.
+  bool compress_image_to_jpeg_file(jpeg_encoder &encoder, const char *pFilename, int width, int height, int num_channels, const uint8 *pImage_data, const params &comp_params = params());
+  bool compress_image_to_jpeg_file_in_memory(jpeg_encoder &encoder, void *pBuf, int &buf_size, int width, int height, int num_channels, const uint8 *pImage_data, const params &comp_params = params());
+
+  // Same as the two functions above, but the image is split into horizontal slices of whole MCU rows that are entropy coded on up to max_threads threads.
+  // Slices are separated by restart markers, so the output is an ordinary baseline JPEG. comp_params.m_restart_mcu_rows sets the slice height,
+  // 0 picks one from the image height and thread count. max_threads <= 1 or single slice images are encoded serially.
+  bool compress_image_to_jpeg_file_parallel(const char *pFilename, int width, int height, int num_channels, const uint8 *pImage_data, int max_threads, const params &comp_params = params());
+  bool compress_image_to_jpeg_file_in_memory_parallel(void *pBuf, int &buf_size, int width, int height, int num_channels, const uint8 *pImage_data, int max_threads, const params &comp_params = params());
+
+  // Instruction set used for RGB->YCbCr conversion, the forward DCT and quantization. The best one the CPU supports is selected at startup;
+  // every level produces exactly the same compressed bytes.
+  enum simd_level_t { SIMD_NONE = 0, SIMD_SSE2, SIMD_AVX2 };
+
+  // Changes the level used by encoders initialized afterwards (clamped to what the CPU supports), and returns the level actually selected.
+  simd_level_t set_simd_level(simd_level_t level);
+  simd_level_t get_simd_level();
     
   // Output stream abstract class - used by the jpeg_encoder class to write to the output stream. 
   // put_buf() is generally called with len==JPGE_OUT_BUF_SIZE bytes, but for headers it'll be called with smaller amounts.
@@ -77,6 +103,7 @@ namespace jpge
     // width, height  - Image dimensions.
     // channels - May be 1, or 3. 1 indicates grayscale, 3 indicates RGB source data.
     // Returns false on out of memory or if a stream write fails.
+    // May be called again to start a new image: buffers and tables which are still valid for the new image are kept, deinit() frees them.
     bool init(output_stream *pStream, int width, int height, int src_channels, const params &comp_params = params());
     
     const params &get_params() const { return m_params; }
@@ -92,6 +119,10 @@ namespace jpge
     // You must call with NULL after all scanlines are processed to finish compression.
     // Returns false on out of memory or if a stream write fails.
     bool process_scanline(const void* pScanline);
+
+    // Compresses a whole image (pitch width*src_channels) in one call instead of init()/process_scanline(), coding slices of MCU rows on up to max_threads
+    // threads, see compress_image_to_jpeg_file_parallel(). The output is identical to the serial encoder's with the same m_restart_mcu_rows.
+    bool compress_image_parallel(output_stream *pStream, int width, int height, int src_channels, const uint8 *pImage_data, int max_threads, const params &comp_params = params());
         
   private:
     jpeg_encoder(const jpeg_encoder &);
@@ -109,10 +140,16 @@ namespace jpge
     int m_mcus_per_row;
     int m_mcu_x, m_mcu_y;
     uint8 *m_mcu_lines[16];
+    uint m_mcu_lines_size;
     uint8 m_mcu_y_ofs;
     sample_array_t m_sample_array[64];
     int16 m_coefficient_array[64];
     int32 m_quantization_tables[2][64];
+    int32 m_natural_quantization_tables[2][64];
+    int m_quantization_tables_quality; // m_params the quantization tables were computed for, 0 if none
+    bool m_quantization_tables_no_chroma_discrim;
+    bool m_std_huff_codes; // m_huff_codes/m_huff_code_sizes hold the standard tables
+    simd_level_t m_simd_level;
     uint m_huff_codes[4][256];
     uint8 m_huff_code_sizes[4][256];
     uint8 m_huff_bits[4][17];
@@ -126,6 +163,9 @@ namespace jpge
     uint32 m_bit_buffer;
     uint m_bits_in;
     uint8 m_pass_num;
+    int m_restart_interval;
+    int m_mcu_row_num;
+    uint8 m_next_restart_num;
     bool m_all_stream_writes_succeeded;
         
     void optimize_huffman_table(int table_num, int table_len);
@@ -138,7 +178,9 @@ namespace jpge
     void emit_dht(uint8 *bits, uint8 *val, int index, bool ac_flag);
     void emit_dhts();
     void emit_sos();
+    void emit_dri();
     void emit_markers();
+    void emit_restart();
     void compute_huffman_table(uint *codes, uint8 *code_sizes, uint8 *bits, uint8 *val);
     void compute_quant_table(int32 *dst, int16 *src);
     void adjust_quant_table(int32 *dst, int32 *src);
@@ -156,11 +198,14 @@ namespace jpge
     void code_coefficients_pass_two(int component_num);
     void code_block(int component_num);
     void process_mcu_row();
+    void process_partial_mcu_row();
     bool terminate_pass_one();
     bool terminate_pass_two();
     bool process_end_of_image();
     void load_mcu(const void* src);
     void clear();
+    bool open_slice_encoder(const jpeg_encoder &master);
+    bool code_slice(int pass_num, output_stream *pStream, const uint8 *pImage_data, int first_mcu_row, int num_mcu_rows);
     void init();
   };
 
@@ -27,6 +27,7 @@ static int print_usage()
   printf("-d: Test jpgd.h. source_file must be JPEG, and dest_file must be .TGA\n");
   printf("\nOptions supported in all modes:\n");
   printf("-glogfilename.txt: Append output to log file\n");
+  printf("-i0, -i1, -i2: jpgd.cpp/jpge.cpp DCT/color conversion instruction set: 0=scalar, 1=SSE2, 2=AVX2 (default is the best supported)\n");
   printf("\nOptions supported in compression mode (the default):\n");
   printf("-o: Enable optimized Huffman tables (slower, but smaller files)\n");
   printf("-luma: Output Y-only image\n");
@@ -289,7 +290,8 @@ static int test_jpgd(const char *pSrc_filename, const char *pDst_filename)
     
   log_printf("Source JPEG file: \"%s\", image resolution: %ix%i, actual comps: %i\n", pSrc_filename, width, height, actual_comps);
   
-  log_printf("Decompression time: %3.3fms\n", tm.get_elapsed_ms());
+  static const char* s_simd_level_names[] = { "scalar", "SSE2", "AVX2" };
+  log_printf("Decompression time: %3.3fms (%s)\n", tm.get_elapsed_ms(), s_simd_level_names[jpgd::get_simd_level()]);
 
   if (!stbi_write_tga(pDst_filename, width, height, req_comps, pImage_data))
   {
@@ -332,6 +334,19 @@ int main(int arg_c, char* ppArgs[])
     case 'x':
       run_exhausive_test = true;
       break;
+    case 'i':
+    {
+      const int level = atoi(&ppArgs[arg_index][2]);
+      if ((level < jpgd::JPGD_SIMD_NONE) || (level > jpgd::JPGD_SIMD_AVX2))
+      {
+        log_printf("Unrecognized instruction set: %s\n", ppArgs[arg_index]);
+        return EXIT_FAILURE;
+      }
+      if (jpgd::set_simd_level(static_cast<jpgd::jpgd_simd_level>(level)) != level)
+        log_printf("Instruction set %i is not supported by this CPU, using %i\n", level, jpgd::get_simd_level());
+      jpge::set_simd_level(static_cast<jpge::simd_level_t>(level));
+      break;
+    }
     case 'm':
       test_memory_compression = true;
       break;
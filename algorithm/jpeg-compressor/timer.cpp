@@ -26,16 +26,16 @@ inline void query_counter_frequency(timer_ticks *pTicks)
    QueryPerformanceFrequency(reinterpret_cast<LARGE_INTEGER*>(pTicks));
 }
 #elif defined(__GNUC__)
-#include <sys/timex.h>
+// monotonic nanosecond ticks, gettimeofday() is only microseconds and jumps with the wall clock
 inline void query_counter(timer_ticks *pTicks)
 {
-   struct timeval cur_time;
-   gettimeofday(&cur_time, NULL);
-   *pTicks = static_cast<unsigned long long>(cur_time.tv_sec)*1000000ULL + static_cast<unsigned long long>(cur_time.tv_usec);
+   struct timespec cur_time;
+   clock_gettime(CLOCK_MONOTONIC, &cur_time);
+   *pTicks = static_cast<unsigned long long>(cur_time.tv_sec)*1000000000ULL + static_cast<unsigned long long>(cur_time.tv_nsec);
 }
 inline void query_counter_frequency(timer_ticks *pTicks)
 {
-   *pTicks = 1000000;
+   *pTicks = 1000000000;
 }
 #endif
 
@@ -110,7 +110,8 @@ timer_ticks timer::get_elapsed_us() const
       query_counter(&stop_time);
 
    timer_ticks delta = stop_time - m_start_time;
-   return (delta * 1000000ULL + (g_freq >> 1U)) / g_freq;
+   // whole seconds first, delta * 1000000 alone wraps after hours of nanosecond ticks
+   return (delta / g_freq) * 1000000ULL + ((delta % g_freq) * 1000000ULL + (g_freq >> 1U)) / g_freq;
 }
 
 void timer::init()
@@ -1,6 +1,5 @@
 #include <iostream>
 #include <iomanip>
-#include <chrono>
 
 //#define DEBUG
 
@@ -8,22 +7,14 @@
 
 int main(int argc, char* argv[]){
 	
-	using namespace std::chrono;
-	steady_clock::time_point startTime = steady_clock::now();
-	auto generateCallback = [&](float percent, std::string msg) {
-		if (percent != 0.f) {
-			steady_clock::time_point currentTime = steady_clock::now();
-			const float elapsedMS = float(duration_cast<microseconds>(currentTime - startTime).count());
-			const float remainingMS = (elapsedMS / percent)*(1.f - percent);
-			const int remainingS = int(remainingMS / (1e6f));
-			std::cout << remainingS << "sec remaining";
+	auto generateCallback = [](const ProgressEvent& event) {
+		std::cout << ProgressEvent::PhaseName(event.phase) << " " << int(event.Fraction() * 100.f) << "% ";
+		if (event.etaSeconds >= 0.0) {
+			std::cout << int(event.etaSeconds) << "sec remaining";
 		} else {
 			std::cout << "+Inf sec remaining";
 		}
-		if (msg.empty() == false) {
-			std::cout << " msg: " << msg << std::endl;
-		}
-		std::cout.flush();
+		std::cout << std::endl;
 	};
 
 	TextureSynthesiser textureGenerator {
@@ -35,8 +26,14 @@ int main(int argc, char* argv[]){
 		/*coherenceThreshold*/ 0.2f // if x>threshold -> skip
 	};
 
+	if (textureGenerator.IsInputLoaded() == false) {
+		std::cout << "cannot read 1.jpg" << std::endl;
+		return EXIT_FAILURE;
+	}
 	textureGenerator.Generate(generateCallback);
 	textureGenerator.SaveToFile("1_out.jpg");
+	PROFILE_REPORT(std::cout);
+	TRACE_WRITE("1_trace.json");
 
 	return 0;
 }
@@ -0,0 +1,365 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <chrono>
+
+#include "TextureSynthesiser.h"
+
+/*
+	Times the hot primitives of the synthesis on their own and prints one JSON report, like benchmark.cpp.
+	usage: microbenchmark [--exemplar 1.jpg] [--radii 1,2,5] [--samples 9] [--min-time 0.05] [--filter name]
+		[--out report.json]
+	Every case runs in batches long enough to last --min-time seconds; the report has the median and the
+	fastest sample per call. The "layout" of a case is the access pattern it is fed with:
+		sequential	neighbouring coordinates in scanline order, the way the pixel based modes sweep
+		random		uniformly spread coordinates, every access a likely cache miss
+		border		coordinates within the radius of the image edge, the clipping and wrapping paths
+	Coordinates are drawn up front with a fixed seed, only the primitive itself is inside the timed loop.
+*/
+
+namespace {
+
+constexpr int COORDINATE_COUNT = 4096;
+
+struct MicrobenchmarkOptions {
+	std::string			exemplarPath = "1.jpg";
+	std::vector<int>	radii{1, 2, 5};
+	int					samples = 9;
+	double				minSeconds = 0.05;
+	std::string			filter;
+	std::string			outputPath;
+};
+
+struct CoordinatePair {
+	Coordinate	first;
+	Coordinate	second;
+};
+
+// keeps the results alive so the timed calls are not optimised away
+volatile double resultSink = 0.0;
+
+std::vector<int> SplitIntList(const std::string& list){
+	std::vector<int> values;
+	std::stringstream stream{list};
+	std::string item;
+	while (std::getline(stream, item, ',')) {
+		if (item.empty() == false) {
+			values.push_back(std::stoi(item));
+		}
+	}
+	return values;
+}
+
+bool ParseOptions(int argc, char* argv[], MicrobenchmarkOptions& options){
+	for (int i = 1; i < argc; ++i) {
+		const std::string arg = argv[i];
+		if (i + 1 >= argc) {
+			return false;
+		}
+		const std::string value = argv[++i];
+		if (arg == "--exemplar") {
+			options.exemplarPath = value;
+		} else if (arg == "--radii") {
+			options.radii = SplitIntList(value);
+		} else if (arg == "--samples") {
+			options.samples = mymax(std::stoi(value), 1);
+		} else if (arg == "--min-time") {
+			options.minSeconds = std::stod(value);
+		} else if (arg == "--filter") {
+			options.filter = value;
+		} else if (arg == "--out") {
+			options.outputPath = value;
+		} else {
+			return false;
+		}
+	}
+	return options.radii.empty() == false;
+}
+
+// Coordinates in a width x height area. Border coordinates are up to margin pixels inside or outside the edge.
+std::vector<Coordinate> MakeCoordinates(const std::string& layout, const Dimension& dimension, int margin, unsigned int seed){
+	RandomGenerator randomUnit{0.0, 1.0, seed};
+	auto randomIn = [&](int from, int to){
+		return mymin(from + int(randomUnit() * (to - from)), to - 1);
+	};
+	std::vector<Coordinate> coordinates(COORDINATE_COUNT);
+	for (int i = 0; i < COORDINATE_COUNT; ++i) {
+		Coordinate& coord = coordinates[i];
+		if (layout == "sequential") {
+			coord = OffsetToCoordinate(i % dimension.size(), dimension);
+		} else if (layout == "random") {
+			coord = Coordinate{randomIn(0, dimension.width), randomIn(0, dimension.height)};
+		} else {
+			// a random point on the edge, pushed in or out by up to margin
+			const int edgePosition = randomIn(0, 2 * (dimension.width + dimension.height));
+			const int depth = randomIn(-margin, margin + 1);
+			if (edgePosition < dimension.width) {
+				coord = Coordinate{edgePosition, depth};
+			} else if (edgePosition < 2 * dimension.width) {
+				coord = Coordinate{edgePosition - dimension.width, dimension.height - 1 - depth};
+			} else if (edgePosition < 2 * dimension.width + dimension.height) {
+				coord = Coordinate{depth, edgePosition - 2 * dimension.width};
+			} else {
+				coord = Coordinate{dimension.width - 1 - depth, edgePosition - 2 * dimension.width - dimension.height};
+			}
+		}
+	}
+	return coordinates;
+}
+
+// The first coordinate follows the layout, the second one is a fixed random point, the way the search loops pair
+// one pixel under consideration with all the candidates.
+std::vector<CoordinatePair> MakeCoordinatePairs(
+	const std::string& layout,
+	const Dimension& firstDimension,
+	const Dimension& secondDimension,
+	int margin,
+	unsigned int seed
+){
+	const std::vector<Coordinate> firsts = MakeCoordinates(layout, firstDimension, margin, seed);
+	const std::vector<Coordinate> seconds = MakeCoordinates(
+		layout == "sequential" ? "random" : layout, secondDimension, margin, seed + 1
+	);
+	std::vector<CoordinatePair> pairs(COORDINATE_COUNT);
+	for (int i = 0; i < COORDINATE_COUNT; ++i) {
+		pairs[i] = CoordinatePair{firsts[i], layout == "sequential" ? seconds[i / 256] : seconds[i]};
+	}
+	return pairs;
+}
+
+class MicrobenchmarkReport {
+
+private:
+	const MicrobenchmarkOptions&	options;
+	std::ostringstream				report;
+	bool							firstResult = true;
+
+public:
+	MicrobenchmarkReport(const MicrobenchmarkOptions& options):
+		options(options)
+	{
+		report << "{\n";
+		report << "\t\"samples\": " << options.samples << ",\n";
+		report << "\t\"minSeconds\": " << options.minSeconds << ",\n";
+		report << "\t\"results\": [";
+	}
+
+	// kernel(i) does one call on the i-th prepared input and returns something to sink;
+	// itemsPerCall is what the throughput is counted in (pixels, coordinates)
+	template <typename Kernel>
+	void Run(const std::string& name, int radius, const std::string& layout, double itemsPerCall, const Kernel& kernel){
+		if (options.filter.empty() == false && name.find(options.filter) == std::string::npos) {
+			return;
+		}
+		std::cerr << name << " r=" << radius << " " << layout << std::endl;
+		using Clock = std::chrono::steady_clock;
+
+		// calibrate the batch so one sample takes about minSeconds
+		long long batch = 1;
+		while (true) {
+			const Clock::time_point startTime = Clock::now();
+			double sink = 0.0;
+			for (long long i = 0; i < batch; ++i) {
+				sink += kernel(int(i % COORDINATE_COUNT));
+			}
+			resultSink = resultSink + sink;
+			const double elapsed = std::chrono::duration<double>(Clock::now() - startTime).count();
+			if (elapsed >= options.minSeconds || batch >= (1LL << 40)) {
+				break;
+			}
+			batch = (elapsed > 0.0) ? mymax(batch * 2, (long long)(batch * options.minSeconds / elapsed * 1.2)) : batch * 2;
+		}
+
+		std::vector<double> nanoseconds;
+		for (int sample = 0; sample < options.samples; ++sample) {
+			const Clock::time_point startTime = Clock::now();
+			double sink = 0.0;
+			for (long long i = 0; i < batch; ++i) {
+				sink += kernel(int(i % COORDINATE_COUNT));
+			}
+			resultSink = resultSink + sink;
+			nanoseconds.push_back(std::chrono::duration<double, std::nano>(Clock::now() - startTime).count() / double(batch));
+		}
+		std::sort(nanoseconds.begin(), nanoseconds.end());
+		const double median = nanoseconds[nanoseconds.size() / 2];
+
+		report << (firstResult ? "\n" : ",\n") << "\t\t{";
+		firstResult = false;
+		report << "\"name\": \"" << name << "\"";
+		report << ", \"radius\": " << radius;
+		report << ", \"layout\": \"" << layout << "\"";
+		report << ", \"callsPerSample\": " << batch;
+		report << ", \"medianNsPerCall\": " << median;
+		report << ", \"minNsPerCall\": " << nanoseconds.front();
+		report << ", \"itemsPerSecond\": " << itemsPerCall * 1e9 / median;
+		report << "}";
+	}
+
+	std::string Finish(){
+		report << "\n\t]\n}\n";
+		return report.str();
+	}
+
+};
+
+} // namespace
+
+int main(int argc, char* argv[]){
+
+	MicrobenchmarkOptions options;
+	if (ParseOptions(argc, argv, options) == false) {
+		std::cerr << "usage: " << argv[0]
+			<< " [--exemplar 1.jpg] [--radii 1,2,5] [--samples 9] [--min-time 0.05] [--filter name] [--out report.json]"
+			<< std::endl;
+		return EXIT_FAILURE;
+	}
+	MappedFile exemplarFile;
+	if (exemplarFile.Open(options.exemplarPath) == false) {
+		std::cerr << "cannot open " << options.exemplarPath << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	MicrobenchmarkReport report{options};
+	const unsigned int seed = 1;
+	const char* const layouts[] = {"sequential", "random", "border"};
+	const Dimension outputDimension{256, 256};
+
+	for (const int radius : options.radii) {
+		// GetBlockDistance takes the radius from the synthesiser; a zero similarity threshold keeps
+		// every distance out of the early FLT_MAX return
+		TextureSynthesiser synthesiser {
+			options.exemplarPath,
+			outputDimension,
+			radius,
+			/* similarityThreshold */ 0.f,
+			TextureSynthesiser::GenerationMode::K_COHERENCE,
+			/* coherenceThreshold */ 0.2f
+		};
+		synthesiser.SetRandomSeed(seed);
+		synthesiser.FillReferenceOutputWithNoise();
+		const Dimension inputDimension = synthesiser.GetInputDimension();
+		TextureSynthesiser::SynthesisStats stats;
+
+		for (const char* layout : layouts) {
+			const std::vector<CoordinatePair> inputPairs = MakeCoordinatePairs(layout, inputDimension, inputDimension, radius, seed);
+			report.Run("GetBlockDistance<INPUT_INPUT>", radius, layout, 1.0, [&](int i){
+				return double(synthesiser.GetBlockDistance<TextureSynthesiser::INPUT_INPUT>(inputPairs[i].first, inputPairs[i].second, stats));
+			});
+			const std::vector<CoordinatePair> outputPairs = MakeCoordinatePairs(layout, inputDimension, outputDimension, radius, seed);
+			report.Run("GetBlockDistance<INPUT_OUTPUT>", radius, layout, 1.0, [&](int i){
+				return double(synthesiser.GetBlockDistance<TextureSynthesiser::INPUT_OUTPUT>(outputPairs[i].first, outputPairs[i].second, stats));
+			});
+		}
+	}
+
+	// the primitives below do not depend on the radius
+	TextureSynthesiser synthesiser {
+		options.exemplarPath,
+		outputDimension,
+		options.radii.front(),
+		/* similarityThreshold */ 0.02f,
+		TextureSynthesiser::GenerationMode::PATCH_BASED,
+		/* coherenceThreshold */ 0.2f
+	};
+	synthesiser.SetRandomSeed(seed);
+	const Dimension inputDimension = synthesiser.GetInputDimension();
+	std::vector<Pixel> inputPixels(inputDimension.size());
+	{
+		int width, height, components;
+		unsigned char* rgba = jpgd::decompress_jpeg_image_from_memory(
+			exemplarFile.Data(), int(exemplarFile.Size()), &width, &height, &components, 4
+		);
+		RgbaToPixels(rgba, inputPixels.data(), inputDimension.size());
+		free(rgba);
+	}
+
+	for (const char* layout : {"sequential", "random"}) {
+		const std::vector<CoordinatePair> pairs = MakeCoordinatePairs(layout, inputDimension, inputDimension, 0, seed);
+		report.Run("GetColorDistanceSquared", 0, layout, 1.0, [&](int i){
+			const Pixel& a = inputPixels[pairs[i].first.y * inputDimension.width + pairs[i].first.x];
+			const Pixel& b = inputPixels[pairs[i].second.y * inputDimension.width + pairs[i].second.x];
+			return double(synthesiser.GetColorDistanceSquared(a, b));
+		});
+	}
+
+	for (const char* layout : layouts) {
+		const std::vector<Coordinate> coordinates = MakeCoordinates(layout, outputDimension, options.radii.back(), seed);
+		report.Run("TileizeCoordinate", 0, layout, 1.0, [&](int i){
+			const Coordinate tileized = synthesiser.TileizeCoordinate(coordinates[i], outputDimension);
+			return double(tileized.x + tileized.y);
+		});
+	}
+
+	// LoadInputImage conversion: decoded RGBA to the float pixels
+	{
+		int width, height, components;
+		unsigned char* rgba = jpgd::decompress_jpeg_image_from_memory(
+			exemplarFile.Data(), int(exemplarFile.Size()), &width, &height, &components, 4
+		);
+		std::vector<Pixel> pixels(width * height);
+		report.Run("RgbaToPixels", 0, "sequential", double(pixels.size()), [&](int){
+			RgbaToPixels(rgba, pixels.data(), int(pixels.size()));
+			return double(pixels[0].r);
+		});
+		free(rgba);
+	}
+
+	// SaveToFile packing: the noise reference map is a random gather, the quilted one copies runs of pixels
+	std::vector<unsigned char> packedPixels;
+	synthesiser.FillReferenceOutputWithNoise();
+	report.Run("PackOutputPixels", 0, "random", double(outputDimension.size()), [&](int){
+		synthesiser.PackOutputPixels(packedPixels);
+		return double(packedPixels[0]);
+	});
+	synthesiser.Generate([](const ProgressEvent&){});
+	report.Run("PackOutputPixels", 0, "sequential", double(outputDimension.size()), [&](int){
+		synthesiser.PackOutputPixels(packedPixels);
+		return double(packedPixels[0]);
+	});
+
+	// the codecs, in pixels of the exemplar and of the output
+	report.Run("jpgd decode", 0, "sequential", double(inputDimension.size()), [&](int){
+		int width, height, components;
+		unsigned char* rgba = jpgd::decompress_jpeg_image_from_memory(
+			exemplarFile.Data(), int(exemplarFile.Size()), &width, &height, &components, 4
+		);
+		const double first = rgba ? double(rgba[0]) : 0.0;
+		free(rgba);
+		return first;
+	});
+	for (int scaleShift = 1; scaleShift <= 3; ++scaleShift) {
+		report.Run("jpgd decode 1/" + std::to_string(1 << scaleShift), 0, "sequential", double(inputDimension.size()), [&](int){
+			int width, height, components;
+			unsigned char* rgba = jpgd::decompress_jpeg_image_from_memory_scaled(
+				exemplarFile.Data(), int(exemplarFile.Size()), &width, &height, &components, 4, scaleShift
+			);
+			const double first = rgba ? double(rgba[0]) : 0.0;
+			free(rgba);
+			return first;
+		});
+	}
+	std::vector<unsigned char> encodedImage(outputDimension.size() * 3 + 1024);
+	report.Run("jpge encode", 0, "sequential", double(outputDimension.size()), [&](int){
+		int encodedSize = int(encodedImage.size());
+		jpge::compress_image_to_jpeg_file_in_memory(
+			encodedImage.data(), encodedSize, outputDimension.width, outputDimension.height, 3, packedPixels.data()
+		);
+		return double(encodedSize);
+	});
+
+	const std::string result = report.Finish();
+	if (options.outputPath.empty()) {
+		std::cout << result;
+	} else {
+		std::ofstream outputFile{options.outputPath};
+		outputFile << result;
+		if (outputFile.good() == false) {
+			std::cerr << "cannot write " << options.outputPath << std::endl;
+			return EXIT_FAILURE;
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,47 @@
+#include <iostream>
+#include <string>
+
+#include "TextureSynthesiser.h"
+
+// Builds <exemplar>.bundle next to the exemplar so later runs with the same
+// analysis parameters skip decoding and the coherence map build.
+// usage: preprocess <exemplar.jpg> [neighbourSize] [similarityThreshold] [coherenceThreshold]
+int main(int argc, char* argv[]){
+
+	if (argc < 2) {
+		std::cout << "usage: " << argv[0]
+			<< " <exemplar.jpg> [neighbourSize] [similarityThreshold] [coherenceThreshold]" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	const std::string inputImagePath = argv[1];
+	const int neighbourSize = argc > 2 ? std::stoi(argv[2]) : 5;
+	const float similarityThreshold = argc > 3 ? std::stof(argv[3]) : 0.02f;
+	const float coherenceThreshold = argc > 4 ? std::stof(argv[4]) : 0.2f;
+
+	auto preprocessCallback = [](const ProgressEvent& event) {
+		std::cout << int(event.Fraction() * 100.f) << "% " << ProgressEvent::PhaseName(event.phase) << "    \r";
+		std::cout.flush();
+	};
+
+	TextureSynthesiser textureGenerator {
+		inputImagePath,
+		/* output dimension */ Dimension{1, 1},
+		neighbourSize,
+		similarityThreshold,
+		TextureSynthesiser::GenerationMode::K_COHERENCE,
+		coherenceThreshold
+	};
+
+	if (textureGenerator.IsInputLoaded() == false) {
+		std::cout << "cannot read " << inputImagePath << std::endl;
+		return EXIT_FAILURE;
+	}
+	if (textureGenerator.SaveExemplarBundle(preprocessCallback) == false) {
+		std::cout << std::endl << "cannot write " << ExemplarBundle::PathFor(inputImagePath) << std::endl;
+		return EXIT_FAILURE;
+	}
+	std::cout << std::endl << "wrote " << ExemplarBundle::PathFor(inputImagePath) << std::endl;
+
+	return 0;
+}
@@ -1,5 +1,14 @@
+#include <QFileInfo>
 #include <QGuiApplication>
 #include <QQmlApplicationEngine>
+#include <QQmlContext>
+#include <QUrl>
+
+#include "ExemplarCache.h"
+#include "PreviewImageProvider.h"
+#include "SynthesisJobQueue.h"
+#include "SynthesisWorker.h"
+#include "ThumbnailProvider.h"
 
 int main(int argc, char *argv[])
 {
@@ -7,6 +16,22 @@ int main(int argc, char *argv[])
 	QGuiApplication app(argc, argv);
 
 	QQmlApplicationEngine engine;
+	// the engine owns the provider, the worker has to be stopped before the engine goes
+	PreviewImageProvider* preview = new PreviewImageProvider();
+	engine.addImageProvider(QStringLiteral("synthesis"), preview);
+	engine.addImageProvider(QStringLiteral("thumbnails"), new ThumbnailProvider());
+	// shared by the interactive synthesis and the queued jobs
+	ExemplarCache exemplars;
+	SynthesisController synthesis{preview, exemplars};
+	SynthesisJobQueue jobQueue{exemplars};
+	// absolute, like the paths of the thumbnail strip listing its folder
+	const QFileInfo exemplar(app.arguments().size() > 1 ? app.arguments().at(1) : QStringLiteral("1.jpg"));
+	synthesis.setExemplarPath(exemplar.absoluteFilePath());
+	QObject::connect(&app, &QCoreApplication::aboutToQuit, &synthesis, &SynthesisController::shutdown);
+	QObject::connect(&app, &QCoreApplication::aboutToQuit, &jobQueue, &SynthesisJobQueue::shutdown);
+	engine.rootContext()->setContextProperty(QStringLiteral("synthesis"), &synthesis);
+	engine.rootContext()->setContextProperty(QStringLiteral("jobQueue"), &jobQueue);
+	engine.rootContext()->setContextProperty(QStringLiteral("exemplarFolder"), QUrl::fromLocalFile(exemplar.absolutePath()));
 	engine.load(QUrl(QLatin1String("qrc:/main.qml")));
 
 	return app.exec();
@@ -1,11 +1,12 @@
 import QtQuick 2.7
 import QtQuick.Controls 2.0
 import QtQuick.Layouts 1.0
+import Qt.labs.folderlistmodel 2.1
 
 ApplicationWindow {
 
     property int windowWidth: 700
-    property int windowHeight: 390
+    property int windowHeight: 640
     property string backgroundColor: "#333333"
 
     id: mainWindow
@@ -15,18 +16,83 @@ ApplicationWindow {
     title: qsTr("Hello World")
     color: backgroundColor
 
+    // every edit of the settings asks for a new output, the controller debounces them
+    function regenerate() {
+        synthesis.generate(
+            parseInt(outputWidthInput.text),
+            parseInt(outputHeightInput.text),
+            parseInt(searchSizeInput.text),
+            parseFloat(similarityInput.text),
+            generationCob.currentIndex,
+            parseInt(seedInput.text)
+        )
+    }
+
+    function enqueueVariation() {
+        jobQueue.enqueue(
+            synthesis.exemplarPath,
+            parseInt(outputWidthInput.text),
+            parseInt(outputHeightInput.text),
+            parseInt(searchSizeInput.text),
+            parseFloat(similarityInput.text),
+            generationCob.currentIndex,
+            parseInt(seedInput.text),
+            0
+        )
+    }
+
+    function regenerateIfValid(field) {
+        if (field.acceptableInput) {
+            regenerate()
+        }
+    }
+
     ColumnLayout {
         id: columnLayout1
         width: 700
-        height: 400
+        height: 630
 
-        Flickable {
+        // the exemplars next to the current one; the folder is listed and the thumbnails decoded off the
+        // UI thread, and only the delegates in view ask for theirs
+        ListView {
             id: scrollablePanel
             width: 700
             height: 88
             Layout.fillWidth: true
             Layout.preferredHeight: 80
             Layout.fillHeight: false
+            orientation: ListView.Horizontal
+            spacing: 4
+            clip: true
+            model: FolderListModel {
+                folder: exemplarFolder
+                nameFilters: ["*.jpg", "*.jpeg"]
+                showDirs: false
+            }
+            delegate: MouseArea {
+                width: scrollablePanel.height
+                height: scrollablePanel.height
+                onClicked: {
+                    synthesis.exemplarPath = filePath
+                    mainWindow.regenerate()
+                }
+
+                Rectangle {
+                    anchors.fill: parent
+                    color: "transparent"
+                    border.color: "#ffffff"
+                    border.width: filePath === synthesis.exemplarPath ? 2 : 0
+                }
+
+                Image {
+                    anchors.fill: parent
+                    anchors.margins: 3
+                    source: "image://thumbnails/" + encodeURIComponent(filePath)
+                    sourceSize.width: scrollablePanel.height
+                    sourceSize.height: scrollablePanel.height
+                    fillMode: Image.PreserveAspectFit
+                }
+            }
         }
 
         RowLayout {
@@ -48,10 +114,10 @@ ApplicationWindow {
                     x: 8
                     y: 0
                     width: 292
-                    height: 295
+                    height: 375
                     columnSpacing: 10
                     rowSpacing: 10
-                    rows: 9
+                    rows: 11
                     columns: 5
 
                     Label {
@@ -91,8 +157,10 @@ ApplicationWindow {
 
                     ComboBox {
                         id: generationCob
-                        currentIndex: 3
-                        textRole: "Hello"
+                        // in the order of TextureSynthesiser::GenerationMode
+                        model: ["Brute force", "K-coherence", "Patch based", "Graph cut"]
+                        currentIndex: 2
+                        onActivated: mainWindow.regenerate()
                         Layout.fillWidth: true
                         Layout.preferredHeight: 30
                         Layout.columnSpan: 3
@@ -118,7 +186,9 @@ ApplicationWindow {
                     TextField {
                         id: outputWidthInput
                         color: "#ffffff"
-                        text: qsTr("")
+                        text: "256"
+                        validator: IntValidator { bottom: 1; top: 8192 }
+                        onTextChanged: mainWindow.regenerateIfValid(outputWidthInput)
                         Layout.fillWidth: true
                         Layout.preferredWidth: 60
                         Layout.preferredHeight: 30
@@ -134,7 +204,9 @@ ApplicationWindow {
                     TextField {
                         id: outputHeightInput
                         color: "#ffffff"
-                        text: qsTr("")
+                        text: "256"
+                        validator: IntValidator { bottom: 1; top: 8192 }
+                        onTextChanged: mainWindow.regenerateIfValid(outputHeightInput)
                         Layout.fillWidth: true
                         Layout.preferredWidth: 60
                         Layout.preferredHeight: 30
@@ -151,7 +223,9 @@ ApplicationWindow {
                     TextField {
                         id: similarityInput
                         color: "#ffffff"
-                        text: qsTr("")
+                        text: "0.02"
+                        validator: DoubleValidator { bottom: 0 }
+                        onTextChanged: mainWindow.regenerateIfValid(similarityInput)
                         Layout.fillWidth: true
                         Layout.preferredWidth: -1
                         Layout.preferredHeight: 30
@@ -169,7 +243,28 @@ ApplicationWindow {
                     TextField {
                         id: searchSizeInput
                         color: "#ffffff"
-                        text: qsTr("")
+                        text: "5"
+                        validator: IntValidator { bottom: 1; top: 64 }
+                        onTextChanged: mainWindow.regenerateIfValid(searchSizeInput)
+                        Layout.preferredHeight: 30
+                        Layout.fillWidth: true
+                        Layout.columnSpan: 3
+                    }
+
+                    Label {
+                        id: seedLbl
+                        color: "#ffffff"
+                        text: qsTr("Seed:")
+                        font.pointSize: 10
+                        Layout.columnSpan: 2
+                    }
+
+                    TextField {
+                        id: seedInput
+                        color: "#ffffff"
+                        text: "0"
+                        validator: IntValidator { bottom: 0 }
+                        onTextChanged: mainWindow.regenerateIfValid(seedInput)
                         Layout.preferredHeight: 30
                         Layout.fillWidth: true
                         Layout.columnSpan: 3
@@ -190,14 +285,46 @@ ApplicationWindow {
                         Layout.columnSpan: 3
                     }
 
+                    ProgressBar {
+                        id: generationPgb
+                        value: synthesis.progress
+                        visible: synthesis.running
+                        Layout.fillWidth: true
+                        Layout.columnSpan: 3
+                    }
+
                     Button {
                         id: generateBtn
-                        text: qsTr("Generate")
+                        text: synthesis.running ? qsTr("Cancel") : qsTr("Generate")
                         Layout.fillHeight: false
                         Layout.fillWidth: false
                         Layout.preferredHeight: 30
                         Layout.alignment: Qt.AlignRight | Qt.AlignVCenter
-                        Layout.columnSpan: 5
+                        Layout.columnSpan: 2
+                        onClicked: {
+                            if (synthesis.running) {
+                                synthesis.cancel()
+                            } else {
+                                mainWindow.regenerate()
+                            }
+                        }
+                    }
+
+                    Label {
+                        id: phaseLbl
+                        color: "#ffffff"
+                        text: synthesis.running ? synthesis.phase : ""
+                        font.pointSize: 10
+                        Layout.columnSpan: 3
+                    }
+
+                    Button {
+                        id: enqueueBtn
+                        text: qsTr("Add to queue")
+                        Layout.preferredHeight: 30
+                        Layout.alignment: Qt.AlignRight | Qt.AlignVCenter
+                        Layout.columnSpan: 2
+                        onClicked: mainWindow.enqueueVariation()
                     }
                 }
             }
@@ -247,7 +374,12 @@ ApplicationWindow {
                         Layout.fillHeight: false
                         Layout.columnSpan: 1
                         Layout.fillWidth: false
-                        source: "qrc:/icon.jpg"
+                        // a new frame number per preview, the provider draws the synthesis as it is then
+                        source: synthesis.previewSource !== "" ? synthesis.previewSource : "qrc:/icon.jpg"
+                        sourceSize.width: Layout.preferredWidth
+                        sourceSize.height: Layout.preferredHeight
+                        fillMode: Image.PreserveAspectFit
+                        cache: false
                     }
 
                     Item {
@@ -269,5 +401,123 @@ ApplicationWindow {
                 }
             }
         }
+
+        // the queued variations, the outputs go to the "variations" folder next to the exemplar
+        ColumnLayout {
+            id: jobPanel
+            Layout.fillWidth: true
+            Layout.preferredHeight: 180
+
+            RowLayout {
+                id: jobHeaderLayout
+                Layout.fillWidth: true
+                Layout.leftMargin: 8
+                Layout.rightMargin: 8
+
+                Label {
+                    id: jobsLbl
+                    color: "#ffffff"
+                    text: qsTr("Jobs")
+                    font.pointSize: 10
+                    Layout.fillWidth: true
+                }
+
+                Label {
+                    id: concurrentJobsLbl
+                    color: "#ffffff"
+                    text: qsTr("Concurrent jobs:")
+                    font.pointSize: 10
+                }
+
+                SpinBox {
+                    id: concurrentJobsSpb
+                    from: 1
+                    to: 16
+                    value: jobQueue.concurrentJobs
+                    onValueChanged: jobQueue.concurrentJobs = value
+                    Layout.preferredHeight: 30
+                }
+
+                Button {
+                    id: removeFinishedBtn
+                    text: qsTr("Clear finished")
+                    Layout.preferredHeight: 30
+                    onClicked: jobQueue.removeFinished()
+                }
+            }
+
+            ListView {
+                id: jobList
+                Layout.fillWidth: true
+                Layout.fillHeight: true
+                Layout.leftMargin: 8
+                Layout.rightMargin: 8
+                clip: true
+                spacing: 2
+                model: jobQueue
+                // status: 0 queued, 1 running, in the order of SynthesisJobQueue::JobStatus
+                delegate: RowLayout {
+                    width: jobList.width
+                    spacing: 6
+
+                    Image {
+                        source: outputSource
+                        sourceSize.width: 32
+                        sourceSize.height: 32
+                        asynchronous: true
+                        fillMode: Image.PreserveAspectFit
+                        Layout.preferredWidth: 32
+                        Layout.preferredHeight: 32
+                    }
+
+                    Label {
+                        color: "#ffffff"
+                        text: exemplarName + "  " + description
+                        elide: Text.ElideRight
+                        Layout.fillWidth: true
+                    }
+
+                    ProgressBar {
+                        value: progress
+                        Layout.preferredWidth: 100
+                    }
+
+                    Label {
+                        color: "#ffffff"
+                        text: phase !== "" ? phase : statusName
+                        elide: Text.ElideRight
+                        Layout.preferredWidth: 150
+                    }
+
+                    Label {
+                        color: "#ffffff"
+                        text: qsTr("Priority %1").arg(priority)
+                    }
+
+                    Button {
+                        text: "+"
+                        enabled: status === 0
+                        Layout.preferredWidth: 30
+                        Layout.preferredHeight: 30
+                        onClicked: jobQueue.setPriority(jobId, priority + 1)
+                    }
+
+                    Button {
+                        text: "-"
+                        enabled: status === 0
+                        Layout.preferredWidth: 30
+                        Layout.preferredHeight: 30
+                        onClicked: jobQueue.setPriority(jobId, priority - 1)
+                    }
+
+                    Button {
+                        text: qsTr("Cancel")
+                        enabled: status <= 1
+                        Layout.preferredHeight: 30
+                        onClicked: jobQueue.cancel(jobId)
+                    }
+                }
+            }
+        }
     }
 }